@@ -0,0 +1,157 @@
+#pragma once
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <ez/KVOpenOptions.hpp>
+
+namespace ez::bench {
+	using Clock = std::chrono::steady_clock;
+
+	// Splitmix64, so a seed produces the same sequence with every compiler and standard library.
+	struct Random {
+		uint64_t state;
+
+		explicit Random(uint64_t seed)
+			: state(seed)
+		{}
+
+		uint64_t next();
+		// Uniform in [0, n)
+		uint64_t below(uint64_t n);
+		// Uniform in [0, 1)
+		double unit();
+	};
+
+	// Finalizer from splitmix64, used to derive deterministic sizes and contents from an index.
+	uint64_t mix(uint64_t x);
+	// The hash YCSB uses to scatter record numbers over the key space.
+	uint64_t fnv64(uint64_t x);
+
+	// The zipfian generator from YCSB, item zero is the most popular.
+	class Zipfian {
+	public:
+		Zipfian(uint64_t items, double theta = 0.99);
+
+		uint64_t next(Random& random) const;
+	private:
+		uint64_t items;
+		double theta, zetan, alpha, eta;
+	};
+
+	enum class Distribution {
+		Uniform,
+		// Zipfian with the popular items scattered over the key space.
+		Zipfian,
+		// Zipfian over the most recently inserted items.
+		Latest,
+	};
+	const char* distributionName(Distribution dist);
+
+	// Picks a record number below the current number of records.
+	class KeyChooser {
+	public:
+		KeyChooser(Distribution dist, uint64_t items);
+
+		uint64_t next(Random& random, uint64_t count) const;
+	private:
+		Distribution dist;
+		uint64_t items;
+		Zipfian zipf;
+	};
+
+	// A range of sizes in bytes, the size used for an index is fixed so every run stores the same data.
+	struct SizeRange {
+		const char* name;
+		std::size_t min, max;
+
+		std::size_t pick(uint64_t index) const;
+		std::size_t average() const;
+	};
+
+	// The key for a record number, with a length taken from the range.
+	std::string makeKey(const SizeRange& size, uint64_t index);
+	// Deterministic incompressible bytes, the view stays valid for the lifetime of the program.
+	std::string_view makeValue(std::size_t len, uint64_t index);
+
+	class Latencies {
+	public:
+		void reserve(std::size_t count);
+		void add(Clock::duration time);
+		void merge(const Latencies& other);
+
+		std::size_t count() const noexcept;
+		// Nearest rank percentile in microseconds, q in [0, 1]
+		double percentile(double q);
+	private:
+		std::vector<uint64_t> nanos;
+		bool sorted = false;
+	};
+
+	// Extra fields describing the configuration of a result.
+	class Params {
+	public:
+		Params& add(std::string_view key, std::string_view value);
+		Params& add(std::string_view key, const char* value);
+		Params& add(std::string_view key, uint64_t value);
+
+		const std::string& json() const noexcept;
+	private:
+		std::string fields;
+	};
+
+	struct Result {
+		std::string suite, name;
+		Params params;
+		// Whether each latency sample covers a single operation or a whole pass over the store.
+		const char* per = "op";
+		std::size_t threads = 1;
+		std::size_t ops = 0;
+		// Operations that did not return what the benchmark expected, non zero means the numbers are suspect.
+		std::size_t errors = 0;
+		double seconds = 0.0;
+		Latencies latencies;
+	};
+
+	struct Settings {
+		std::filesystem::path dir;
+		uint64_t seed = 42;
+
+		// Store sizes for the microbenchmarks.
+		std::vector<std::size_t> records;
+		std::size_t ops = 0;
+		// Configurations larger than this are skipped.
+		std::size_t maxBytes = std::size_t(256) << 20;
+
+		std::size_t ycsbRecords = 0;
+		std::size_t ycsbOps = 0;
+		std::size_t ycsbValue = 1000;
+		std::vector<std::size_t> threads;
+
+		bool durable = false;
+
+		KVOpenOptions options() const;
+	};
+
+	// Writes one json object per line, so runs can be compared with any scripting language.
+	class Report {
+	public:
+		Report(std::FILE* out, std::string filter);
+
+		// Whether the filter selects "suite/name"
+		bool wants(std::string_view suite, std::string_view name) const;
+
+		void meta(const Settings& settings);
+		void write(Result& result);
+	private:
+		std::FILE* out;
+		std::string filter;
+	};
+
+	void runMicro(const Settings& settings, Report& report);
+	void runYcsb(const Settings& settings, Report& report);
+}
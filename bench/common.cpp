@@ -0,0 +1,226 @@
+#include "bench.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#include <fmt/core.h>
+
+#ifndef EZ_KVSTORE_VERSION
+#define EZ_KVSTORE_VERSION "unknown"
+#endif
+
+namespace ez::bench {
+	uint64_t Random::next() {
+		state += 0x9E3779B97F4A7C15ull;
+		return mix(state);
+	}
+	uint64_t Random::below(uint64_t n) {
+		return n == 0 ? 0 : next() % n;
+	}
+	double Random::unit() {
+		return double(next() >> 11) * (1.0 / 9007199254740992.0);
+	}
+
+	uint64_t mix(uint64_t x) {
+		x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+		x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+		return x ^ (x >> 31);
+	}
+	uint64_t fnv64(uint64_t x) {
+		uint64_t hash = 0xCBF29CE484222325ull;
+		for (int i = 0; i < 8; ++i) {
+			hash ^= x & 0xFF;
+			hash *= 0x100000001B3ull;
+			x >>= 8;
+		}
+		return hash;
+	}
+
+	static double zeta(uint64_t items, double theta) {
+		double sum = 0.0;
+		for (uint64_t i = 1; i <= items; ++i) {
+			sum += 1.0 / std::pow(double(i), theta);
+		}
+		return sum;
+	}
+
+	Zipfian::Zipfian(uint64_t _items, double _theta)
+		: items(std::max<uint64_t>(_items, 2))
+		, theta(_theta)
+	{
+		zetan = zeta(items, theta);
+		alpha = 1.0 / (1.0 - theta);
+		eta = (1.0 - std::pow(2.0 / double(items), 1.0 - theta)) / (1.0 - zeta(2, theta) / zetan);
+	}
+	uint64_t Zipfian::next(Random& random) const {
+		double u = random.unit();
+		double uz = u * zetan;
+		if (uz < 1.0) {
+			return 0;
+		}
+		if (uz < 1.0 + std::pow(0.5, theta)) {
+			return 1;
+		}
+		uint64_t item = uint64_t(double(items) * std::pow(eta * u - eta + 1.0, alpha));
+		return std::min(item, items - 1);
+	}
+
+	const char* distributionName(Distribution dist) {
+		switch (dist) {
+		case Distribution::Uniform:
+			return "uniform";
+		case Distribution::Zipfian:
+			return "zipfian";
+		case Distribution::Latest:
+			return "latest";
+		}
+		return "unknown";
+	}
+
+	KeyChooser::KeyChooser(Distribution _dist, uint64_t _items)
+		: dist(_dist)
+		, items(_items)
+		, zipf(_dist == Distribution::Uniform ? 2 : _items)
+	{}
+	uint64_t KeyChooser::next(Random& random, uint64_t count) const {
+		if (count == 0) {
+			return 0;
+		}
+		switch (dist) {
+		case Distribution::Uniform:
+			return random.below(count);
+		case Distribution::Zipfian:
+			return fnv64(zipf.next(random)) % count;
+		case Distribution::Latest:
+		default:
+			return count - 1 - std::min(zipf.next(random), count - 1);
+		}
+	}
+
+	std::size_t SizeRange::pick(uint64_t index) const {
+		if (max <= min) {
+			return min;
+		}
+		return min + std::size_t(mix(index ^ 0x5A5A5A5Aull) % (max - min + 1));
+	}
+	std::size_t SizeRange::average() const {
+		return (min + max) / 2;
+	}
+
+	std::string makeKey(const SizeRange& size, uint64_t index) {
+		// The record number keeps the keys unique, the hash spreads them like real keys would be.
+		std::string key = fmt::format("{:016x}:{}", fnv64(index), index);
+		std::size_t len = std::max(size.pick(index), std::size_t(1));
+		if (key.size() > len) {
+			// Keep the unique suffix when the key has to be short.
+			key.erase(0, key.size() - len);
+		}
+		while (key.size() < len) {
+			key.push_back(char('a' + (mix(index + key.size()) % 26)));
+		}
+		return key;
+	}
+	std::string_view makeValue(std::size_t len, uint64_t index) {
+		static const std::string pool = [] {
+			std::string result(std::size_t(1) << 20, '\0');
+			Random random(0xC0FFEE);
+			for (char& c : result) {
+				c = char(random.next());
+			}
+			return result;
+		}();
+
+		len = std::min(len, pool.size());
+		std::size_t offset = mix(index) % (pool.size() - len + 1);
+		return std::string_view(pool.data() + offset, len);
+	}
+
+	void Latencies::reserve(std::size_t count) {
+		nanos.reserve(count);
+	}
+	void Latencies::add(Clock::duration time) {
+		nanos.push_back(uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(time).count()));
+		sorted = false;
+	}
+	void Latencies::merge(const Latencies& other) {
+		nanos.insert(nanos.end(), other.nanos.begin(), other.nanos.end());
+		sorted = false;
+	}
+	std::size_t Latencies::count() const noexcept {
+		return nanos.size();
+	}
+	double Latencies::percentile(double q) {
+		if (nanos.empty()) {
+			return 0.0;
+		}
+		if (!sorted) {
+			std::sort(nanos.begin(), nanos.end());
+			sorted = true;
+		}
+		std::size_t rank = std::size_t(std::ceil(q * double(nanos.size())));
+		rank = std::clamp<std::size_t>(rank, 1, nanos.size());
+		return double(nanos[rank - 1]) / 1000.0;
+	}
+
+	Params& Params::add(std::string_view key, std::string_view value) {
+		fields += fmt::format("\"{}\":\"{}\",", key, value);
+		return *this;
+	}
+	Params& Params::add(std::string_view key, const char* value) {
+		return add(key, std::string_view(value));
+	}
+	Params& Params::add(std::string_view key, uint64_t value) {
+		fields += fmt::format("\"{}\":{},", key, value);
+		return *this;
+	}
+	const std::string& Params::json() const noexcept {
+		return fields;
+	}
+
+	KVOpenOptions Settings::options() const {
+		return durable ? KVOpenOptions::durable() : KVOpenOptions::fastWrite();
+	}
+
+	Report::Report(std::FILE* _out, std::string _filter)
+		: out(_out)
+		, filter(std::move(_filter))
+	{}
+	bool Report::wants(std::string_view suite, std::string_view name) const {
+		if (filter.empty()) {
+			return true;
+		}
+		std::string full = fmt::format("{}/{}", suite, name);
+		return full.find(filter) != std::string::npos;
+	}
+	void Report::meta(const Settings& settings) {
+		fmt::print(out,
+			"{{\"suite\":\"meta\",\"version\":\"{}\",\"seed\":{},\"durable\":{},\"hardware_threads\":{}}}\n",
+			EZ_KVSTORE_VERSION,
+			settings.seed,
+			settings.durable,
+			std::thread::hardware_concurrency()
+		);
+		std::fflush(out);
+	}
+	void Report::write(Result& result) {
+		double opsPerSec = result.seconds > 0.0 ? double(result.ops) / result.seconds : 0.0;
+		fmt::print(out,
+			"{{\"suite\":\"{}\",\"name\":\"{}\",{}\"per\":\"{}\",\"threads\":{},\"ops\":{},\"errors\":{},"
+			"\"seconds\":{:.6f},\"ops_per_sec\":{:.1f},\"p50_us\":{:.3f},\"p99_us\":{:.3f},\"p999_us\":{:.3f}}}\n",
+			result.suite,
+			result.name,
+			result.params.json(),
+			result.per,
+			result.threads,
+			result.ops,
+			result.errors,
+			result.seconds,
+			opsPerSec,
+			result.latencies.percentile(0.50),
+			result.latencies.percentile(0.99),
+			result.latencies.percentile(0.999)
+		);
+		std::fflush(out);
+	}
+}
@@ -0,0 +1,165 @@
+#include "bench.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include <fmt/core.h>
+
+using namespace ez::bench;
+
+static const char* const usage =
+R"(Usage: kvstore_bench [options]
+
+Runs the kvstore microbenchmarks and YCSB style workloads, writing one json object per line.
+
+Options:
+  --quick           Small stores and few operations, for a smoke test.
+  --filter TEXT     Only run benchmarks whose "suite/name" contains TEXT, eg. "micro/get" or "ycsb/workload_a".
+  --seed N          Seed for the key choices, runs with the same seed do the same work. (42)
+  --ops N           Operations per microbenchmark.
+  --records N,...   Store sizes for the microbenchmarks.
+  --max-mb N        Skip microbenchmark configurations larger than this many megabytes. (256)
+  --ycsb-records N  Records loaded before each YCSB workload.
+  --ycsb-ops N      Operations per YCSB workload, split over the threads.
+  --threads N,...   Thread counts for the YCSB workloads.
+  --durable         Use KVOpenOptions::durable() instead of fastWrite().
+  --dir PATH        Directory for the temporary stores.
+  --out PATH        Write the results to a file instead of stdout.
+)";
+
+static std::vector<std::size_t> parseList(const char* text) {
+	std::vector<std::size_t> result;
+	const char* it = text;
+	while (*it) {
+		char* end = nullptr;
+		result.push_back(std::strtoull(it, &end, 10));
+		if (end == it) {
+			break;
+		}
+		it = *end == ',' ? end + 1 : end;
+	}
+	return result;
+}
+
+int main(int argc, char** argv) {
+	Settings settings;
+	settings.dir = std::filesystem::temp_directory_path() / "ez_kvstore_bench";
+
+	bool quick = false;
+	std::string filter, out;
+	std::vector<std::size_t> records, threads;
+	std::size_t ops = 0, ycsbRecords = 0, ycsbOps = 0;
+
+	for (int i = 1; i < argc; ++i) {
+		std::string_view arg = argv[i];
+		// Every option except the flags takes a value.
+		auto value = [&]() -> const char* {
+			if (i + 1 >= argc) {
+				fmt::print(stderr, "Missing value for {}\n", arg);
+				std::exit(1);
+			}
+			return argv[++i];
+		};
+
+		if (arg == "--help" || arg == "-h") {
+			fmt::print("{}", usage);
+			return 0;
+		}
+		else if (arg == "--quick") {
+			quick = true;
+		}
+		else if (arg == "--durable") {
+			settings.durable = true;
+		}
+		else if (arg == "--filter") {
+			filter = value();
+		}
+		else if (arg == "--seed") {
+			settings.seed = std::strtoull(value(), nullptr, 10);
+		}
+		else if (arg == "--ops") {
+			ops = std::strtoull(value(), nullptr, 10);
+		}
+		else if (arg == "--records") {
+			records = parseList(value());
+		}
+		else if (arg == "--max-mb") {
+			settings.maxBytes = std::size_t(std::strtoull(value(), nullptr, 10)) << 20;
+		}
+		else if (arg == "--ycsb-records") {
+			ycsbRecords = std::strtoull(value(), nullptr, 10);
+		}
+		else if (arg == "--ycsb-ops") {
+			ycsbOps = std::strtoull(value(), nullptr, 10);
+		}
+		else if (arg == "--threads") {
+			threads = parseList(value());
+		}
+		else if (arg == "--dir") {
+			settings.dir = value();
+		}
+		else if (arg == "--out") {
+			out = value();
+		}
+		else {
+			fmt::print(stderr, "Unknown option {}\n\n{}", arg, usage);
+			return 1;
+		}
+	}
+
+	std::size_t hardware = std::max(std::thread::hardware_concurrency(), 1u);
+	if (quick) {
+		settings.records = { 1000 };
+		settings.ops = 2000;
+		settings.ycsbRecords = 1000;
+		settings.ycsbOps = 4000;
+		settings.threads = { 1, 2 };
+	}
+	else {
+		settings.records = { 10000, 100000 };
+		settings.ops = 20000;
+		settings.ycsbRecords = 100000;
+		settings.ycsbOps = 100000;
+		settings.threads = { 1 };
+		if (hardware > 1) {
+			settings.threads.push_back(hardware);
+		}
+	}
+	if (!records.empty()) {
+		settings.records = records;
+	}
+	if (!threads.empty()) {
+		settings.threads = threads;
+	}
+	settings.ops = ops ? ops : settings.ops;
+	settings.ycsbRecords = ycsbRecords ? ycsbRecords : settings.ycsbRecords;
+	settings.ycsbOps = ycsbOps ? ycsbOps : settings.ycsbOps;
+
+	std::error_code ec;
+	std::filesystem::create_directories(settings.dir, ec);
+	if (ec) {
+		fmt::print(stderr, "Failed to create {}: {}\n", settings.dir.string(), ec.message());
+		return 1;
+	}
+
+	std::FILE* file = stdout;
+	if (!out.empty()) {
+		file = std::fopen(out.c_str(), "w");
+		if (!file) {
+			fmt::print(stderr, "Failed to open {}\n", out);
+			return 1;
+		}
+	}
+
+	Report report(file, filter);
+	report.meta(settings);
+	runMicro(settings, report);
+	runYcsb(settings, report);
+
+	if (file != stdout) {
+		std::fclose(file);
+	}
+	return 0;
+}
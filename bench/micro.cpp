@@ -0,0 +1,246 @@
+#include "bench.hpp"
+
+#include <algorithm>
+#include <functional>
+
+#include <fmt/core.h>
+#include <ez/KVStore.hpp>
+
+namespace ez::bench {
+	static const SizeRange keySizes[] = {
+		{ "fixed16", 16, 16 },
+		{ "var8_64", 8, 64 },
+	};
+	static const SizeRange valueSizes[] = {
+		{ "small", 16, 64 },
+		{ "medium", 256, 1024 },
+		{ "large", 4096, 16384 },
+	};
+
+	static const char* const microNames[] = {
+		"get", "getView", "contains", "contains_miss", "iterate", "cursor", "getMap", "set", "set_batched", "increment", "rename", "erase",
+	};
+
+	namespace {
+		class Micro {
+		public:
+			Micro(Report& _report, Params _params)
+				: report(_report)
+				, params(std::move(_params))
+			{}
+
+			// Time each call of func separately, func returns false when the store did not do what was expected.
+			void ops(const char* name, std::size_t count, const std::function<bool(std::size_t)>& func) {
+				if (!report.wants("micro", name)) {
+					return;
+				}
+
+				Result result = start(name);
+				result.latencies.reserve(count);
+
+				Clock::time_point first = Clock::now();
+				for (std::size_t i = 0; i < count; ++i) {
+					Clock::time_point begin = Clock::now();
+					bool ok = func(i);
+					result.latencies.add(Clock::now() - begin);
+					result.errors += ok ? 0 : 1;
+				}
+				result.seconds = std::chrono::duration<double>(Clock::now() - first).count();
+				result.ops = count;
+				report.write(result);
+			}
+			// Time whole passes over the store, func returns the number of entries it visited.
+			void passes(const char* name, std::size_t count, std::size_t expected, const std::function<std::size_t()>& func) {
+				if (!report.wants("micro", name)) {
+					return;
+				}
+
+				Result result = start(name);
+				result.per = "pass";
+
+				Clock::time_point first = Clock::now();
+				for (std::size_t i = 0; i < count; ++i) {
+					Clock::time_point begin = Clock::now();
+					std::size_t visited = func();
+					result.latencies.add(Clock::now() - begin);
+					result.errors += visited == expected ? 0 : 1;
+					result.ops += visited;
+				}
+				result.seconds = std::chrono::duration<double>(Clock::now() - first).count();
+				report.write(result);
+			}
+		private:
+			Result start(const char* name) {
+				Result result;
+				result.suite = "micro";
+				result.name = name;
+				result.params = params;
+				return result;
+			}
+
+			Report& report;
+			Params params;
+		};
+	}
+
+	static void runConfig(const Settings& settings, Report& report, std::size_t records, const SizeRange& keySize, const SizeRange& valueSize) {
+		std::filesystem::path path = settings.dir / "micro.db3";
+		KVStore store;
+		if (!store.create(path, true, settings.options())) {
+			fmt::print(stderr, "Failed to create {}\n", path.string());
+			return;
+		}
+
+		std::vector<std::string> keys;
+		keys.reserve(records);
+		for (std::size_t i = 0; i < records; ++i) {
+			keys.push_back(makeKey(keySize, i));
+		}
+
+		std::size_t loaded = 0;
+		store.bulkLoad([&](KVEntryView& entry) {
+			if (loaded == records) {
+				return false;
+			}
+			entry.key = keys[loaded];
+			entry.value = makeValue(valueSize.pick(loaded), loaded);
+			++loaded;
+			return true;
+		});
+
+		Params params;
+		params.add("records", uint64_t(records));
+		params.add("keys", keySize.name);
+		params.add("values", valueSize.name);
+		Micro micro(report, params);
+
+		// The same sequence of keys for every run with the same seed.
+		Random random(settings.seed ^ records);
+		std::vector<std::size_t> order(settings.ops);
+		for (std::size_t& index : order) {
+			index = random.below(records);
+		}
+
+		std::string buffer;
+		std::string_view view;
+		micro.ops("get", order.size(), [&](std::size_t i) {
+			return store.get(keys[order[i]], buffer);
+		});
+		micro.ops("getView", order.size(), [&](std::size_t i) {
+			return store.getView(keys[order[i]], view);
+		});
+		micro.ops("contains", order.size(), [&](std::size_t i) {
+			return store.contains(keys[order[i]]);
+		});
+
+		std::vector<std::string> missing;
+		missing.reserve(order.size());
+		for (std::size_t i = 0; i < order.size(); ++i) {
+			missing.push_back(makeKey(keySize, records + i));
+		}
+		micro.ops("contains_miss", missing.size(), [&](std::size_t i) {
+			return !store.contains(missing[i]);
+		});
+
+		// At least a few samples, but never much more work than the point lookups.
+		std::size_t passCount = std::clamp<std::size_t>(settings.ops / std::max<std::size_t>(records, 1), 3, 100);
+		micro.passes("iterate", passCount, records, [&] {
+			std::size_t count = 0;
+			for (const KVEntryView& entry : store) {
+				count += entry.key.empty() ? 0 : 1;
+			}
+			return count;
+		});
+		KVCursor cursor;
+		std::vector<KVEntryView> page;
+		micro.passes("cursor", passCount, records, [&] {
+			std::size_t count = 0;
+			store.openCursor(cursor);
+			while (cursor.next(page, 256) != 0) {
+				count += page.size();
+			}
+			return count;
+		});
+		micro.passes("getMap", passCount, records, [&] {
+			return store.getMap().size();
+		});
+
+		micro.ops("set", order.size(), [&](std::size_t i) {
+			std::size_t index = order[i];
+			return store.set(keys[index], makeValue(valueSize.pick(index), index + i + 1));
+		});
+
+		// Commit every so often, as a loader would.
+		constexpr std::size_t batchSize = 1000;
+		micro.ops("set_batched", order.size(), [&](std::size_t i) {
+			if (i % batchSize == 0) {
+				store.beginBatch();
+			}
+			std::size_t index = order[i];
+			bool ok = store.set(keys[index], makeValue(valueSize.pick(index), index + i));
+			if (i % batchSize == batchSize - 1 || i + 1 == order.size()) {
+				store.commitBatch();
+			}
+			return ok;
+		});
+
+		// Hot counters, a few keys hit over and over.
+		std::vector<std::string> counters;
+		for (std::size_t i = 0; i < std::min<std::size_t>(records, 1024); ++i) {
+			counters.push_back(keys[i] + "#");
+		}
+		micro.ops("increment", order.size(), [&](std::size_t i) {
+			return store.increment(counters[order[i] % counters.size()]);
+		});
+
+		// Each key can only be renamed and erased once, so these walk a shuffled prefix of the keys.
+		std::vector<std::size_t> shuffled(records);
+		for (std::size_t i = 0; i < records; ++i) {
+			shuffled[i] = i;
+		}
+		for (std::size_t i = records; i > 1; --i) {
+			std::swap(shuffled[i - 1], shuffled[random.below(i)]);
+		}
+		shuffled.resize(std::min(records, settings.ops));
+
+		std::vector<std::string> renamed;
+		renamed.reserve(shuffled.size());
+		for (std::size_t index : shuffled) {
+			renamed.push_back(keys[index] + "~");
+		}
+		micro.ops("rename", shuffled.size(), [&](std::size_t i) {
+			return store.rename(keys[shuffled[i]], renamed[i]);
+		});
+		micro.ops("erase", shuffled.size(), [&](std::size_t i) {
+			// Fall back to the original name when the rename benchmark was filtered out.
+			return store.erase(renamed[i]) || store.erase(keys[shuffled[i]]);
+		});
+
+		store.close();
+		std::error_code ec;
+		std::filesystem::remove(path, ec);
+		std::filesystem::remove(path.string() + "-wal", ec);
+		std::filesystem::remove(path.string() + "-shm", ec);
+	}
+
+	void runMicro(const Settings& settings, Report& report) {
+		bool any = false;
+		for (const char* name : microNames) {
+			any = any || report.wants("micro", name);
+		}
+		if (!any) {
+			return;
+		}
+
+		for (std::size_t records : settings.records) {
+			for (const SizeRange& keySize : keySizes) {
+				for (const SizeRange& valueSize : valueSizes) {
+					if (records * (keySize.average() + valueSize.average()) > settings.maxBytes) {
+						continue;
+					}
+					runConfig(settings, report, records, keySize, valueSize);
+				}
+			}
+		}
+	}
+}
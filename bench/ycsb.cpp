@@ -0,0 +1,237 @@
+#include "bench.hpp"
+
+#include <array>
+#include <atomic>
+#include <thread>
+
+#include <fmt/core.h>
+#include <ez/ConcurrentKVStore.hpp>
+
+namespace ez::bench {
+	namespace {
+		enum Op {
+			Read,
+			Update,
+			Insert,
+			Scan,
+			ReadModifyWrite,
+			NumOps,
+		};
+		const char* const opNames[NumOps] = { "read", "update", "insert", "scan", "rmw" };
+
+		// The core workloads of YCSB, as fractions of the operations.
+		struct Workload {
+			const char* name;
+			std::array<double, NumOps> mix;
+			// The skewed distribution the workload is defined with, every workload also runs with uniform keys.
+			Distribution skewed;
+		};
+		const Workload workloads[] = {
+			{ "workload_a", { 0.50, 0.50, 0.00, 0.00, 0.00 }, Distribution::Zipfian },
+			{ "workload_b", { 0.95, 0.05, 0.00, 0.00, 0.00 }, Distribution::Zipfian },
+			{ "workload_c", { 1.00, 0.00, 0.00, 0.00, 0.00 }, Distribution::Zipfian },
+			{ "workload_d", { 0.95, 0.00, 0.05, 0.00, 0.00 }, Distribution::Latest },
+			{ "workload_e", { 0.00, 0.00, 0.05, 0.95, 0.00 }, Distribution::Zipfian },
+			{ "workload_f", { 0.50, 0.00, 0.00, 0.00, 0.50 }, Distribution::Zipfian },
+		};
+		// Workload E scans between one and this many entries.
+		constexpr std::size_t maxScanLength = 100;
+
+		std::string ycsbKey(uint64_t index) {
+			return fmt::format("user{}", fnv64(index));
+		}
+
+		struct ThreadResult {
+			std::array<Latencies, NumOps> latencies;
+			std::array<std::size_t, NumOps> errors{};
+		};
+	}
+
+	static bool load(const Settings& settings, const std::filesystem::path& path, bool ordered) {
+		KVStore store;
+		if (!store.create(path, true, settings.options())) {
+			return false;
+		}
+		if (ordered && !store.enableKeyIndex()) {
+			return false;
+		}
+
+		std::size_t loaded = 0;
+		std::string key;
+		store.bulkLoad([&](KVEntryView& entry) {
+			if (loaded == settings.ycsbRecords) {
+				return false;
+			}
+			key = ycsbKey(loaded);
+			entry.key = key;
+			entry.value = makeValue(settings.ycsbValue, loaded);
+			++loaded;
+			return true;
+		});
+		return store.numValues() == settings.ycsbRecords;
+	}
+
+	static void runWorkload(const Settings& settings, Report& report, const Workload& workload, Distribution dist, std::size_t threads) {
+		std::filesystem::path path = settings.dir / "ycsb.db3";
+		bool ordered = workload.mix[Scan] > 0.0;
+		if (!load(settings, path, ordered)) {
+			fmt::print(stderr, "Failed to load {}\n", path.string());
+			return;
+		}
+
+		{
+			ConcurrentKVStore store;
+			if (!store.open(path, threads, settings.options())) {
+				fmt::print(stderr, "Failed to open {}\n", path.string());
+				return;
+			}
+
+			// Inserts claim a record number first, and reads only choose records below the watermark.
+			// Inserts finish out of order, so the watermark only moves past records whose insert and all of those before it have finished.
+			std::size_t perThread = settings.ycsbOps / threads;
+			std::atomic<uint64_t> nextInsert{ settings.ycsbRecords };
+			std::atomic<uint64_t> inserted{ settings.ycsbRecords };
+			std::vector<std::atomic<bool>> finished(workload.mix[Insert] > 0.0 ? perThread * threads : 0);
+			std::atomic<bool> go{ false };
+
+			auto finishInsert = [&](uint64_t index) {
+				finished[index - settings.ycsbRecords].store(true);
+				uint64_t mark = inserted.load();
+				while (mark < nextInsert.load() && finished[mark - settings.ycsbRecords].load()) {
+					// On failure another thread moved it, continue from where it got to.
+					if (inserted.compare_exchange_weak(mark, mark + 1)) {
+						++mark;
+					}
+				}
+			};
+
+			KeyChooser chooser(dist, settings.ycsbRecords);
+			std::vector<ThreadResult> results(threads);
+			std::vector<std::thread> workers;
+
+			for (std::size_t t = 0; t < threads; ++t) {
+				workers.emplace_back([&, t] {
+					ThreadResult& result = results[t];
+					Random random(mix(settings.seed + t));
+					std::string buffer;
+
+					while (!go.load(std::memory_order_acquire)) {
+						std::this_thread::yield();
+					}
+
+					for (std::size_t i = 0; i < perThread; ++i) {
+						double pick = random.unit();
+						int op = 0;
+						while (op < NumOps - 1 && pick >= workload.mix[op]) {
+							pick -= workload.mix[op];
+							++op;
+						}
+
+						uint64_t count = inserted.load(std::memory_order_acquire);
+						bool ok = true;
+						Clock::time_point begin = Clock::now();
+						switch (op) {
+						case Read:
+							ok = store.get(ycsbKey(chooser.next(random, count)), buffer);
+							break;
+						case Update: {
+							uint64_t index = chooser.next(random, count);
+							ok = store.set(ycsbKey(index), makeValue(settings.ycsbValue, index + i + 1));
+							break;
+						}
+						case Insert: {
+							uint64_t index = nextInsert.fetch_add(1);
+							ok = store.set(ycsbKey(index), makeValue(settings.ycsbValue, index));
+							finishInsert(index);
+							break;
+						}
+						case Scan: {
+							std::size_t length = 1 + random.below(maxScanLength);
+							ConcurrentKVStore::Reader reader = store.reader();
+							std::size_t visited = 0;
+							for (const KVEntryView& entry : reader->lowerBound(ycsbKey(chooser.next(random, count)))) {
+								visited += entry.value.size() == settings.ycsbValue ? 1 : 0;
+								if (visited == length) {
+									break;
+								}
+							}
+							ok = visited > 0;
+							break;
+						}
+						case ReadModifyWrite: {
+							uint64_t index = chooser.next(random, count);
+							std::string key = ycsbKey(index);
+							ok = store.get(key, buffer) && store.set(key, makeValue(settings.ycsbValue, index + i + 1));
+							break;
+						}
+						}
+						result.latencies[op].add(Clock::now() - begin);
+						result.errors[op] += ok ? 0 : 1;
+					}
+				});
+			}
+
+			Clock::time_point first = Clock::now();
+			go.store(true, std::memory_order_release);
+			for (std::thread& worker : workers) {
+				worker.join();
+			}
+			double seconds = std::chrono::duration<double>(Clock::now() - first).count();
+
+			Params params;
+			params.add("records", uint64_t(settings.ycsbRecords));
+			params.add("distribution", distributionName(dist));
+
+			// One line for the whole mix, then one per kind of operation.
+			Result total;
+			total.suite = "ycsb";
+			total.name = workload.name;
+			total.params = params;
+			total.params.add("op", "all");
+			total.threads = threads;
+			total.seconds = seconds;
+
+			for (int op = 0; op < NumOps; ++op) {
+				Result part;
+				part.suite = "ycsb";
+				part.name = workload.name;
+				part.params = params;
+				part.params.add("op", opNames[op]);
+				part.threads = threads;
+				part.seconds = seconds;
+				for (ThreadResult& result : results) {
+					part.latencies.merge(result.latencies[op]);
+					part.errors += result.errors[op];
+				}
+				part.ops = part.latencies.count();
+				if (part.ops == 0) {
+					continue;
+				}
+
+				total.latencies.merge(part.latencies);
+				total.ops += part.ops;
+				total.errors += part.errors;
+				report.write(part);
+			}
+			report.write(total);
+		}
+
+		std::error_code ec;
+		std::filesystem::remove(path, ec);
+		std::filesystem::remove(path.string() + "-wal", ec);
+		std::filesystem::remove(path.string() + "-shm", ec);
+	}
+
+	void runYcsb(const Settings& settings, Report& report) {
+		for (const Workload& workload : workloads) {
+			if (!report.wants("ycsb", workload.name)) {
+				continue;
+			}
+			for (Distribution dist : { Distribution::Uniform, workload.skewed }) {
+				for (std::size_t threads : settings.threads) {
+					runWorkload(settings, report, workload, dist, std::max<std::size_t>(threads, 1));
+				}
+			}
+		}
+	}
+}
@@ -1,3 +1,4 @@
 ez_find_target_dependency(SQLiteCpp SQLiteCpp CONFIG)
 ez_find_target_dependency(fmt::fmt fmt CONFIG)
-ez_find_target_dependency(xxHash::xxhash xxHash CONFIG)
\ No newline at end of file
+ez_find_target_dependency(xxHash::xxhash xxHash CONFIG)
+ez_find_target_dependency(Threads::Threads Threads)
\ No newline at end of file
@@ -0,0 +1,90 @@
+#pragma once
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <ez/KVStore.hpp>
+
+namespace ez {
+	/*
+	* Thread safe access to a single store file.
+	* Keeps a pool of read only connections, each with its own prepared statements, and a single writer connection.
+	* The file is switched to WAL when opened, so readers never block the writer and vice versa.
+	*/
+	class ConcurrentKVStore {
+		struct Data;
+	public:
+		// Exclusive lease of one of the read connections, returned to the pool when destroyed.
+		// A thread can hold on to a reader for as long as it likes, to pin a connection to itself.
+		class Reader {
+		public:
+			Reader() = default;
+			~Reader();
+
+			Reader(Reader&& other) noexcept;
+			Reader& operator=(Reader&& other) noexcept;
+
+			Reader(const Reader&) = delete;
+			Reader& operator=(const Reader&) = delete;
+
+			explicit operator bool() const noexcept {
+				return store != nullptr;
+			}
+
+			const KVStore& operator*() const noexcept {
+				return *store;
+			}
+			const KVStore* operator->() const noexcept {
+				return store;
+			}
+		private:
+			friend class ConcurrentKVStore;
+			Reader(Data* _pool, KVStore* _store);
+
+			Data* pool = nullptr;
+			KVStore* store = nullptr;
+		};
+
+		ConcurrentKVStore();
+		~ConcurrentKVStore();
+
+		ConcurrentKVStore(ConcurrentKVStore&&) noexcept;
+		// Closes this store first when it is open.
+		ConcurrentKVStore& operator=(ConcurrentKVStore&&) noexcept;
+
+		ConcurrentKVStore(const ConcurrentKVStore&) = delete;
+		ConcurrentKVStore& operator=(const ConcurrentKVStore&) = delete;
+
+		// Open an existing store with the given number of read connections, zero uses one per hardware thread.
+		// The journal mode is always set to WAL, the rest of the options are applied to every connection.
+		bool open(const std::filesystem::path& path, std::size_t readers = 0, const KVOpenOptions& options = KVOpenOptions::readMostly());
+		void close();
+		bool isOpen() const noexcept;
+
+		std::size_t numReaders() const noexcept;
+
+		// Lease a read connection, blocks until one is available.
+		Reader reader() const;
+
+		// Reads that lease a connection for the duration of the call.
+		std::size_t numValues() const;
+		bool contains(std::string_view name) const;
+		bool get(std::string_view name, std::string& data) const;
+		std::size_t getMany(const std::vector<std::string_view>& names, KVBatchResult& result) const;
+
+		// Writes are serialized through the single writer connection.
+		bool set(std::string_view name, std::string_view data);
+		bool setRaw(std::string_view name, const void* data, std::size_t len);
+		bool erase(std::string_view name);
+		bool rename(std::string_view old, std::string_view name);
+		void clear();
+
+		// Run a function with exclusive access to the writer connection, for batches and bulk loads.
+		void write(const std::function<void(KVStore&)>& func);
+	private:
+		std::unique_ptr<Data> data;
+	};
+}
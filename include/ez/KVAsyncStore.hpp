@@ -0,0 +1,77 @@
+#pragma once
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include <ez/KVAsyncWriter.hpp>
+#include <ez/intern/KVAsync.hpp>
+
+namespace ez {
+	// Settings for KVAsyncStore
+	struct KVAsyncStoreOptions {
+		// Number of reader threads, each with its own read only connection.
+		std::size_t readers = 2;
+		// Maximum number of queued reads a reader takes on at once, consecutive gets among them are looked up together.
+		std::size_t maxPipeline = 64;
+		// Group commit settings and connection options for the writer, the store is always switched to WAL.
+		KVAsyncOptions writer;
+		// Where results are delivered, including resuming coroutines awaiting them.
+		// By default they are delivered on the executor thread, set this to post them to an event loop instead.
+		std::function<void(std::function<void()> task)> dispatch;
+	};
+
+	/*
+	* Asynchronous facade over a store file, for callers that must never block on disk io.
+	* Reads run on a small pool of reader threads that each own a read only connection, writes go through a KVAsyncWriter.
+	* Every call comes as a KVAsync result, which can be waited on or awaited from a coroutine, or with a callback.
+	* Reads see every write that completed before they were issued.
+	*/
+	class KVAsyncStore {
+	public:
+		using GetCallback = std::function<void(std::optional<std::string> value)>;
+		using WriteCallback = std::function<void(bool result)>;
+		using ScanCallback = std::function<void(KVScanPage page)>;
+
+		KVAsyncStore();
+		~KVAsyncStore();
+
+		KVAsyncStore(KVAsyncStore&&) noexcept;
+		// Closes this store first when it is open.
+		KVAsyncStore& operator=(KVAsyncStore&&) noexcept;
+
+		KVAsyncStore(const KVAsyncStore&) = delete;
+		KVAsyncStore& operator=(const KVAsyncStore&) = delete;
+
+		// Open an existing store file and start the executor threads.
+		bool open(const std::filesystem::path& path, const KVAsyncStoreOptions& options = {});
+		// Finish everything queued and stop the executor threads.
+		void close();
+		bool isOpen() const noexcept;
+
+		KVAsync<std::optional<std::string>> getAsync(std::string_view name);
+		void getAsync(std::string_view name, GetCallback callback);
+
+		KVAsync<bool> setAsync(std::string_view name, std::string_view value);
+		void setAsync(std::string_view name, std::string_view value, WriteCallback callback);
+
+		KVAsync<bool> eraseAsync(std::string_view name);
+		void eraseAsync(std::string_view name, WriteCallback callback);
+
+		// Up to count entries in hash order, starting from a token of a previous page or from the beginning when the token is empty.
+		KVAsync<KVScanPage> scanAsync(std::string_view token, std::size_t count);
+		void scanAsync(std::string_view token, std::size_t count, ScanCallback callback);
+
+		// Completes once every write issued before it has been committed.
+		KVAsync<bool> flushAsync();
+
+		// Number of reads queued but not yet started.
+		std::size_t pendingReads() const;
+	private:
+		struct Data;
+		std::unique_ptr<Data> data;
+	};
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <ez/KVOpenOptions.hpp>
+
+namespace ez {
+	// Settings for KVAsyncWriter
+	struct KVAsyncOptions {
+		// Maximum number of writes coalesced into a single transaction.
+		std::size_t maxBatch = 1024;
+		// Maximum amount of time the first write in a window waits for others to join it.
+		std::chrono::microseconds maxDelay{ 2000 };
+		// Options for the writer's own connection.
+		KVOpenOptions store;
+	};
+
+	/*
+	* Group commit writer for a KVStore file.
+	* Writes are queued and applied by a dedicated thread that owns its own connection,
+	* coalescing everything that arrives within a commit window into one transaction.
+	* Each write is completed once the transaction holding it has been committed.
+	*/
+	class KVAsyncWriter {
+	public:
+		// Called on the writer thread with the result of the write once it has been committed.
+		// Exceptions thrown by it are reported on std::cerr and otherwise ignored.
+		using Callback = std::function<void(bool)>;
+
+		KVAsyncWriter();
+		~KVAsyncWriter();
+
+		KVAsyncWriter(KVAsyncWriter&&) noexcept;
+		// Closes this writer first when it is open.
+		KVAsyncWriter& operator=(KVAsyncWriter&&) noexcept;
+
+		KVAsyncWriter(const KVAsyncWriter&) = delete;
+		KVAsyncWriter& operator=(const KVAsyncWriter&) = delete;
+
+		// Open an existing store file and start the writer thread.
+		bool open(const std::filesystem::path& path, const KVAsyncOptions& options = {});
+		// Drain the queue, commit everything and stop the writer thread.
+		void close();
+		bool isOpen() const noexcept;
+
+		std::future<bool> set(std::string_view name, std::string_view value);
+		void set(std::string_view name, std::string_view value, Callback callback);
+
+		std::future<bool> erase(std::string_view name);
+		void erase(std::string_view name, Callback callback);
+
+		// Completes once every write queued before it has been committed.
+		std::future<bool> flush();
+		void flush(Callback callback);
+
+		// Number of writes queued but not yet committed.
+		std::size_t pending() const;
+		// Number of transactions committed so far.
+		std::size_t numCommits() const;
+	private:
+		struct Data;
+		std::unique_ptr<Data> data;
+	};
+}
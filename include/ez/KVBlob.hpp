@@ -0,0 +1,43 @@
+#pragma once
+#include <cinttypes>
+#include <cstddef>
+
+struct sqlite3_blob;
+
+namespace ez {
+	/*
+	* Incremental access to a single stored value, without loading the whole value into memory.
+	* Obtained from KVStore::openBlob, after KVStore::reserve when writing a new value.
+	* The size of a value can not change through a blob, and the blob expires if the value is modified by any other means.
+	*/
+	class KVBlob {
+	public:
+		KVBlob();
+		~KVBlob();
+
+		KVBlob(KVBlob&& other) noexcept;
+		KVBlob& operator=(KVBlob&& other) noexcept;
+
+		KVBlob(const KVBlob&) = delete;
+		KVBlob& operator=(const KVBlob&) = delete;
+
+		bool isOpen() const noexcept;
+		bool isWritable() const noexcept;
+		std::size_t size() const noexcept;
+
+		// Read len bytes starting at offset, fails if the range is out of bounds or the blob expired.
+		bool readAt(std::size_t offset, void* dest, std::size_t len) const;
+		// Write len bytes starting at offset, fails if the range is out of bounds, the blob expired or it is read only.
+		bool writeAt(std::size_t offset, const void* src, std::size_t len);
+
+		void close();
+	private:
+		friend class KVStore;
+
+		sqlite3_blob* handle;
+		// Bytes of header in front of the value.
+		std::size_t offset;
+		std::size_t length;
+		bool writable;
+	};
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <cinttypes>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ez {
+	/*
+	* Interface for compressing stored values.
+	* Every value in a store with codecs enabled starts with a single header byte holding the id of the codec that encoded it.
+	* Id 0 means the value is stored as is, ids 1 and 2 are the built in KVLZCodec, custom codecs should use ids of 16 and up.
+	*/
+	class KVCodec {
+	public:
+		virtual ~KVCodec() = default;
+
+		virtual uint8_t id() const noexcept = 0;
+
+		// Append the encoded form of src to dst.
+		// Return false if the codec can't do better than storing the value as is.
+		virtual bool encode(std::string_view src, std::string& dst) const = 0;
+		// Append the decoded form of src to dst, return false if src is malformed.
+		virtual bool decode(std::string_view src, std::string& dst) const = 0;
+	};
+
+	/*
+	* Built in byte oriented LZ77 codec, in the style of LZ4.
+	* Favors speed over ratio, and can be given a shared dictionary to help with small values
+	* that don't contain enough repetition on their own.
+	*/
+	class KVLZCodec : public KVCodec {
+	public:
+		static constexpr uint8_t plain_id = 1;
+		static constexpr uint8_t dictionary_id = 2;
+		static constexpr std::size_t max_dictionary = 65535;
+
+		KVLZCodec();
+		// The dictionary is truncated to its last max_dictionary bytes.
+		explicit KVLZCodec(std::string_view dictionary);
+
+		uint8_t id() const noexcept override;
+
+		bool encode(std::string_view src, std::string& dst) const override;
+		bool decode(std::string_view src, std::string& dst) const override;
+
+		const std::string& dictionary() const noexcept;
+
+		// Build a dictionary out of the substrings that occur most often across the samples.
+		static std::string train(const std::vector<std::string_view>& samples, std::size_t size);
+	private:
+		std::string dict;
+		// Match finder table primed with the dictionary contents.
+		std::vector<int32_t> primed;
+	};
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <cinttypes>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <ez/intern/KVEntry.hpp>
+#include <ez/intern/KVValueCodec.hpp>
+#include <SQLiteCpp/Statement.h>
+
+struct sqlite3;
+
+namespace ez {
+	/*
+	* Resumable scan over a store in hash order, obtained from KVStore::openCursor.
+	* The prepared statement is kept for as long as the cursor lives, and is reused when the cursor is opened on the same store again.
+	* Entries are copied into an arena owned by the cursor, so steady state paging does not allocate.
+	* Entries written or erased between pages may be missed or seen twice, entries that were left alone are seen exactly once.
+	* The cursor must be closed before the store it was opened on.
+	*/
+	class KVCursor {
+	public:
+		KVCursor();
+		~KVCursor() = default;
+
+		KVCursor(KVCursor&&) noexcept = default;
+		KVCursor& operator=(KVCursor&&) noexcept = default;
+
+		KVCursor(const KVCursor&) = delete;
+		KVCursor& operator=(const KVCursor&) = delete;
+
+		bool isOpen() const noexcept;
+		void close();
+
+		// Move to the first entry with a hash of at least the given hash.
+		void seek(int64_t hash);
+		void rewind();
+
+		// Fill in up to count entries, returns how many were filled in. Fewer than count means the cursor reached the end.
+		// The views are valid until the cursor is next moved.
+		std::size_t next(KVEntryView* entries, std::size_t count);
+		std::size_t next(std::vector<KVEntryView>& entries, std::size_t count);
+		bool next(KVEntryView& entry);
+
+		bool atEnd() const noexcept;
+		// The hash the next entry is searched from.
+		int64_t position() const noexcept;
+
+		// End the read transaction held open between pages, the next call to next carries on from the same position.
+		void pause();
+
+		// The position as a printable string, for handing to a client and resuming later through KVStore::openCursor or resume.
+		std::string token() const;
+		// Fails on malformed tokens, leaving the position alone.
+		bool resume(std::string_view token);
+	private:
+		friend class KVStore;
+
+		struct Data {
+			std::optional<SQLite::Statement> stmt;
+			// The connection the statement was prepared on.
+			sqlite3* handle = nullptr;
+			std::shared_ptr<const KVValueCodec> codec;
+
+			int64_t from = 0;
+			// Whether the statement is stepping from the current position.
+			bool active = false;
+			bool done = true;
+
+			std::string arena, buffer;
+			std::vector<std::size_t> lengths;
+		};
+		std::unique_ptr<Data> data;
+	};
+}
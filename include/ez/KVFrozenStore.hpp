@@ -0,0 +1,79 @@
+#pragma once
+#include <cinttypes>
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <ez/memstream.hpp>
+#include <ez/intern/KVEntry.hpp>
+#include <ez/intern/KVIterator.hpp>
+
+namespace ez {
+	class KVFrozenStore;
+
+	class KVFrozenGenerator {
+	public:
+		KVFrozenGenerator(const KVFrozenStore& store);
+
+		bool advance(KVEntryView& value);
+
+		const KVFrozenStore* store;
+		uint64_t next;
+		std::size_t remaining;
+	};
+
+	/*
+	* Immutable, memory mapped form of a store, written by KVStore::exportFrozen.
+	* Lookups go through a minimal perfect hash over the key hashes straight into the mapping, without sqlite or any copies.
+	* Opening only maps the file and checks the header, pages are brought in on demand by the OS.
+	*/
+	class KVFrozenStore {
+	public:
+		using const_iterator = KVIterator<KVFrozenGenerator, KVEntryView>;
+		using iterator = const_iterator;
+
+		KVFrozenStore();
+		~KVFrozenStore();
+
+		KVFrozenStore(KVFrozenStore&& other) noexcept;
+		KVFrozenStore& operator=(KVFrozenStore&& other) noexcept;
+
+		KVFrozenStore(const KVFrozenStore&) = delete;
+		KVFrozenStore& operator=(const KVFrozenStore&) = delete;
+
+		void swap(KVFrozenStore& other) noexcept;
+
+		bool open(const std::filesystem::path& path);
+		void close();
+		bool isOpen() const noexcept;
+
+		std::size_t size() const noexcept;
+		bool empty() const noexcept;
+
+		bool contains(std::string_view name) const;
+		bool get(std::string_view name, std::string& data) const;
+		// Views point straight into the mapping, and stay valid until the store is closed.
+		bool getView(std::string_view name, std::string_view& data) const;
+		bool getRaw(std::string_view name, const void*& data, std::size_t& len) const;
+		bool getStream(std::string_view name, ez::imemstream& stream) const;
+
+		// Entries in the order they are laid out in the file, which is the order of the source store.
+		const_iterator begin() const;
+		const_iterator end() const;
+
+		std::vector<KVEntry> getEntries() const;
+		std::unordered_map<std::string, std::string> getMap() const;
+	private:
+		friend class KVFrozenGenerator;
+
+		// Read the record at the given offset and the offset of the one after it, fails if it runs past the end of the file.
+		bool record(uint64_t offset, uint64_t& hash, KVEntryView& entry, uint64_t& next) const;
+
+		const char* mapping;
+		std::size_t length;
+		// Platform handle of the mapping, only used on windows.
+		void* handle;
+	};
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <ez/KVOpenOptions.hpp>
+#include <ez/intern/KVCompact.hpp>
+
+namespace ez {
+	// Settings for KVMaintenance
+	struct KVMaintenanceOptions {
+		// Time between passes.
+		std::chrono::milliseconds interval{ 10000 };
+		// Most pages returned to the file system per pass, which bounds how long the write lock is held.
+		std::size_t stepPages = 256;
+		// A pass only compacts once both of these are reached.
+		std::size_t minFreePages = 64;
+		double minFragmentation = 0.05;
+		// Options for the maintenance thread's own connection.
+		// Journal modes are stored in the file, so switching to something like KVOpenOptions::fastWrite is left to the caller.
+		KVOpenOptions store;
+	};
+
+	/*
+	* Background space reclamation for a store file.
+	* A dedicated thread with its own connection wakes up every interval, and returns free pages to the file system
+	* in bounded steps while the file is fragmented enough to be worth it.
+	* Only stores with incremental auto vacuum can be compacted this way, see KVOpenOptions::autoVacuum and KVStore::vacuum.
+	*/
+	class KVMaintenance {
+	public:
+		KVMaintenance();
+		~KVMaintenance();
+
+		KVMaintenance(KVMaintenance&&) noexcept;
+		// Closes this handle first when it is open.
+		KVMaintenance& operator=(KVMaintenance&&) noexcept;
+
+		KVMaintenance(const KVMaintenance&) = delete;
+		KVMaintenance& operator=(const KVMaintenance&) = delete;
+
+		// Open an existing store file and start the maintenance thread.
+		bool open(const std::filesystem::path& path, const KVMaintenanceOptions& options = {});
+		// Stop the maintenance thread, waiting for a pass in progress to finish.
+		void close();
+		bool isOpen() const noexcept;
+
+		// Run a pass right away instead of waiting for the interval.
+		void wake();
+
+		// Space usage as of the last pass.
+		KVSpaceStats getSpaceStats() const;
+		std::size_t numPasses() const;
+		std::size_t pagesFreed() const;
+	private:
+		struct Data;
+		std::unique_ptr<Data> data;
+	};
+}
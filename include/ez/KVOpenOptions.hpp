@@ -0,0 +1,87 @@
+#pragma once
+#include <cinttypes>
+
+namespace ez {
+	/*
+	* Connection tuning applied every time a KVStore is created or opened.
+	* Most sqlite pragmas only last as long as the connection, so they have to be reapplied on each open.
+	* A value of zero leaves the corresponding sqlite default in place.
+	*/
+	struct KVOpenOptions {
+		enum class Journal {
+			// Leave the journal mode stored in the file alone.
+			Default,
+			Delete,
+			Truncate,
+			Persist,
+			Memory,
+			WAL,
+			Off,
+		};
+		enum class Sync {
+			Off = 0,
+			Normal = 1,
+			Full = 2,
+			Extra = 3,
+		};
+		enum class TempStore {
+			Default = 0,
+			File = 1,
+			Memory = 2,
+		};
+		enum class AutoVacuum {
+			// Free pages stay in the file until it is vacuumed.
+			None = 0,
+			// Free pages are returned to the file system at every commit.
+			Full = 1,
+			// Free pages are kept until KVStore::compact returns them, a few at a time.
+			Incremental = 2,
+		};
+
+		// Journal mode, this is persistent so it is only applied on writable connections.
+		Journal journal = Journal::Default;
+		Sync synchronous = Sync::Normal;
+		TempStore tempStore = TempStore::Default;
+		// Only applied when creating a store, changing it later takes a full KVStore::vacuum.
+		AutoVacuum autoVacuum = AutoVacuum::None;
+
+		// Maximum number of bytes of the file to memory map.
+		int64_t mmapSize = 0;
+		// Size of the page cache in bytes.
+		int64_t cacheSize = 0;
+		// Page size in bytes, only applied when creating a store. Must be a power of two between 512 and 65536.
+		int32_t pageSize = 0;
+		// Milliseconds to wait for a lock held by another connection before failing.
+		int32_t busyTimeout = 0;
+
+		// Full sync on every commit, for data that must never be lost.
+		static KVOpenOptions durable() {
+			KVOpenOptions options;
+			options.journal = Journal::WAL;
+			options.synchronous = Sync::Full;
+			options.cacheSize = int64_t(16) << 20;
+			options.busyTimeout = 5000;
+			return options;
+		}
+		// WAL with normal sync, a power loss may roll back the most recent commits but never corrupts the store.
+		static KVOpenOptions fastWrite() {
+			KVOpenOptions options;
+			options.journal = Journal::WAL;
+			options.synchronous = Sync::Normal;
+			options.tempStore = TempStore::Memory;
+			options.cacheSize = int64_t(64) << 20;
+			options.busyTimeout = 5000;
+			return options;
+		}
+		// Large memory map and page cache, for stores that are mostly read.
+		static KVOpenOptions readMostly() {
+			KVOpenOptions options;
+			options.journal = Journal::WAL;
+			options.synchronous = Sync::Normal;
+			options.mmapSize = int64_t(256) << 20;
+			options.cacheSize = int64_t(64) << 20;
+			options.busyTimeout = 5000;
+			return options;
+		}
+	};
+}
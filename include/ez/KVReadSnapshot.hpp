@@ -0,0 +1,67 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <ez/KVStore.hpp>
+
+namespace ez {
+	/*
+	* Point in time view of a store file, obtained from KVStore::snapshot.
+	* Reads go through a separate read only connection that keeps a single read transaction open,
+	* so every read sees the file as it was when the snapshot was taken, whatever is written in the meantime.
+	* The file is kept in WAL mode, so writers are never blocked by a snapshot, but the log can not be checkpointed past it until it is closed.
+	* Unlike KVStore::getSnapshot nothing is copied up front, a snapshot costs a connection rather than memory.
+	*/
+	class KVReadSnapshot {
+	public:
+		using const_iterator = KVStore::const_iterator;
+		using iterator = const_iterator;
+		using ordered_range = KVStore::ordered_range;
+
+		KVReadSnapshot() = default;
+		~KVReadSnapshot();
+
+		KVReadSnapshot(KVReadSnapshot&&) noexcept = default;
+		KVReadSnapshot& operator=(KVReadSnapshot&&) noexcept = default;
+
+		KVReadSnapshot(const KVReadSnapshot&) = delete;
+		KVReadSnapshot& operator=(const KVReadSnapshot&) = delete;
+
+		bool isOpen() const noexcept;
+		// End the read transaction and close the connection.
+		void close();
+
+		std::size_t numValues() const;
+		std::size_t size() const;
+		bool empty() const;
+		std::string getKind() const;
+
+		bool contains(std::string_view name) const;
+		bool get(std::string_view name, std::string& data) const;
+		// The view is valid until the next read through the snapshot.
+		bool getView(std::string_view name, std::string_view& data) const;
+		bool getStream(std::string_view name, ez::imemstream& stream) const;
+
+		std::size_t containsMany(const std::vector<std::string_view>& names, std::vector<bool>& found) const;
+		std::size_t getMany(const std::vector<std::string_view>& names, KVBatchResult& result) const;
+
+		const_iterator begin() const;
+		const_iterator end() const;
+
+		ordered_range lowerBound(std::string_view key) const;
+		ordered_range range(std::string_view first, std::string_view last) const;
+		ordered_range prefix(std::string_view prefix) const;
+
+		bool openCursor(KVCursor& cursor) const;
+		bool openCursor(KVCursor& cursor, std::string_view token) const;
+
+		std::vector<KVEntry> getEntries() const;
+		std::unordered_map<std::string, std::string> getMap() const;
+	private:
+		friend class KVStore;
+
+		KVStore store;
+	};
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <cinttypes>
+#include <cstddef>
+#include <string_view>
+#include <vector>
+#include <ez/intern/KVEntry.hpp>
+
+namespace ez {
+	/*
+	* Read only in memory copy of a store, obtained from KVStore::getSnapshot.
+	* All the keys and values live in a single contiguous arena, and the entries are views into it.
+	* Lookups go through an open addressing index over the hashes stored in the file, so they cost no more than a hash and a probe or two.
+	*/
+	class KVSnapshot {
+	public:
+		using const_iterator = std::vector<KVEntryView>::const_iterator;
+		using iterator = const_iterator;
+
+		KVSnapshot();
+
+		KVSnapshot(KVSnapshot&&) noexcept = default;
+		KVSnapshot& operator=(KVSnapshot&&) noexcept = default;
+
+		// The entries point into the arena, so copying would need to fix them all up.
+		KVSnapshot(const KVSnapshot&) = delete;
+		KVSnapshot& operator=(const KVSnapshot&) = delete;
+
+		bool empty() const noexcept;
+		std::size_t size() const noexcept;
+		// Number of bytes of keys and values held.
+		std::size_t bytes() const noexcept;
+
+		// Entries are in the order of the hashes in the file.
+		const_iterator begin() const noexcept;
+		const_iterator end() const noexcept;
+		const KVEntryView& operator[](std::size_t index) const noexcept;
+
+		// Returns nullptr if the key is missing.
+		const KVEntryView* find(std::string_view key) const;
+		bool contains(std::string_view key) const;
+		bool get(std::string_view key, std::string_view& value) const;
+	private:
+		friend class KVStore;
+
+		int64_t hashKey(std::string_view key) const;
+		void buildIndex();
+
+		std::vector<char> arena;
+		std::vector<KVEntryView> entries;
+		// The hash each entry is stored under in the file.
+		std::vector<int64_t> hashes;
+		// Open addressing table of entry index + 1, zero marks an empty slot.
+		std::vector<uint32_t> index;
+		bool legacyHash;
+	};
+}
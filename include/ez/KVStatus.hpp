@@ -1,7 +1,105 @@
 #pragma once
+#include <array>
+#include <chrono>
+#include <cinttypes>
+#include <cstddef>
+#include <functional>
+#include <string_view>
+
+#include <ez/intern/KVValueCache.hpp>
+#include <ez/intern/KVBloomFilter.hpp>
 
 namespace ez {
+	// The operations a KVStore keeps statistics for.
+	enum class KVOp {
+		// get, getView, getRaw, getStream, getMany and getViewMany
+		Get,
+		// set, setRaw and bulkLoad
+		Set,
+		Erase,
+		Rename,
+		// contains and containsMany
+		Contains,
+		// getEntries, getMap, getSnapshot and the parallel scans. Iterators and ordered ranges run at the pace of the caller, so they are not timed.
+		Scan,
+		// commitBatch
+		Commit,
+	};
+	static constexpr std::size_t kvNumOps = 7;
+
+	const char* kvOpName(KVOp op) noexcept;
+
+	// Latency histogram with power of two buckets, bucket i counts the samples of [2^(i-1), 2^i) nanoseconds.
+	struct KVHistogram {
+		static constexpr std::size_t numBuckets = 40;
+
+		std::array<uint64_t, numBuckets> buckets{};
+		uint64_t samples = 0;
+		uint64_t totalNanos = 0;
+		uint64_t maxNanos = 0;
+
+		static std::size_t bucketOf(uint64_t nanos) noexcept;
+
+		std::chrono::nanoseconds mean() const noexcept;
+		std::chrono::nanoseconds max() const noexcept;
+		// Upper bound of the bucket holding the q'th quantile, q in [0, 1]. Never more than the slowest sample.
+		std::chrono::nanoseconds percentile(double q) const noexcept;
+	};
+
+	struct KVOpStats {
+		// Keys for point operations, calls for scans and commits.
+		uint64_t count = 0;
+		uint64_t bytesRead = 0;
+		uint64_t bytesWritten = 0;
+		// Batched calls add a single sample, no matter how many keys they cover.
+		KVHistogram latency;
+	};
+
+	// Collected from sqlite each time the status is requested.
+	struct KVSqliteStats {
+		// Page cache of this connection.
+		int64_t cacheHits = 0;
+		int64_t cacheMisses = 0;
+		int64_t cacheWrites = 0;
+		int64_t cacheSpills = 0;
+		// Bytes of heap used by the page cache, the schema and the prepared statements of this connection.
+		int64_t cacheUsed = 0;
+		int64_t schemaUsed = 0;
+		int64_t statementsUsed = 0;
+		// Heap used by sqlite, shared by every connection in the process.
+		int64_t memoryUsed = 0;
+		int64_t memoryHighwater = 0;
+
+		int64_t pageSize = 0;
+		int64_t pageCount = 0;
+		int64_t freePages = 0;
+		// Size of the write ahead log, zero when the store is not in WAL mode.
+		int64_t walBytes = 0;
+
+		double cacheHitRate() const noexcept {
+			int64_t total = cacheHits + cacheMisses;
+			return total == 0 ? 0.0 : double(cacheHits) / double(total);
+		}
+	};
+
 	struct KVStatus {
+		std::array<KVOpStats, kvNumOps> ops;
+		// Operations that took at least the slow operation threshold.
+		uint64_t slowOps = 0;
+
+		KVSqliteStats sqlite;
+		KVCacheStats cache;
+		KVFilterStats filter;
 
+		const KVOpStats& operator[](KVOp op) const noexcept {
+			return ops[static_cast<std::size_t>(op)];
+		}
+
+		uint64_t bytesRead() const noexcept;
+		uint64_t bytesWritten() const noexcept;
 	};
-}
\ No newline at end of file
+
+	// Called after an operation that took at least the threshold, with the key if the operation had one.
+	// Runs on the thread that performed the operation and must not throw.
+	using KVSlowOpCallback = std::function<void(KVOp op, std::string_view key, std::chrono::nanoseconds time)>;
+}
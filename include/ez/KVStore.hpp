@@ -2,9 +2,12 @@
 #include <string_view>
 #include <filesystem>
 #include <cinttypes>
+#include <cstring>
 #include <iterator>
 #include <vector>
 #include <unordered_map>
+#include <map>
+#include <functional>
 #include <ez/memstream.hpp>
 
 #include <SQLiteCpp/Database.h>
@@ -14,16 +17,48 @@
 #include <ez/intern/KVEntry.hpp>
 #include <ez/intern/KVIterator.hpp>
 #include <ez/intern/KVGenerators.hpp>
+#include <ez/intern/KVBatchResult.hpp>
+#include <ez/intern/KVBulk.hpp>
+#include <ez/intern/KVCompact.hpp>
+#include <ez/intern/KVScan.hpp>
+#include <ez/intern/KVValueCache.hpp>
+#include <ez/intern/KVBloomFilter.hpp>
+#include <ez/intern/KVValueCodec.hpp>
+#include <ez/intern/KVStatusRecorder.hpp>
+#include <ez/intern/KVTyped.hpp>
+#include <ez/KVOpenOptions.hpp>
+#include <ez/KVBlob.hpp>
+#include <ez/KVCursor.hpp>
+#include <ez/KVSnapshot.hpp>
+#include <ez/KVCodec.hpp>
+#include <ez/KVStatus.hpp>
 
 namespace ez {
+	class KVReadSnapshot;
+	class KVTable;
+
 	/*
 	* Simple key-value file format. Built on top of sqlite3.
-	* Only has a single table, for simplicity.
+	* Everything goes into a single default table, unless a named table is opened with KVStore::table.
+	* Rows are keyed by a hash of the key, keys that collide are stored in the next free slot and the stored key is always checked.
 	*/
 	class KVStore {
 	public:
 		using const_iterator = KVIterator<KVEntryViewGenerator, KVEntryView>;
 		using iterator = const_iterator;
+		using ordered_iterator = KVIterator<KVOrderedGenerator, KVEntryView>;
+		using ordered_range = KVRange<ordered_iterator>;
+
+		// Callback for batched lookups, receives the index of the key in the request and its value.
+		// The value is only valid for the duration of the call.
+		using LookupCallback = std::function<void(std::size_t index, std::string_view value)>;
+		// Source for bulk loading, fills in the next entry and returns true, or returns false once exhausted.
+		// The views only need to remain valid until the next call.
+		using BulkSource = std::function<bool(KVEntryView& entry)>;
+		// Visitors for parallel scans, called concurrently from the worker threads along with the index of the partition being scanned.
+		// The entries are only valid for the duration of the call.
+		using ScanVisitor = std::function<void(std::size_t partition, const KVEntryView& entry)>;
+		using ScanBatchVisitor = std::function<void(std::size_t partition, const KVEntryView* entries, std::size_t count)>;
 
 		KVStore();
 
@@ -38,11 +73,13 @@ namespace ez {
 
 		bool isOpen() const noexcept;
 
-		bool create(const std::filesystem::path& path, bool overwrite = false);
-		bool open(const std::filesystem::path & path, bool readonly = false);
+		bool create(const std::filesystem::path& path, bool overwrite = false, const KVOpenOptions& options = {});
+		// Files written by older versions keep their layout until upgrade is called, they can still be read and written as they are.
+		bool open(const std::filesystem::path & path, bool readonly = false, const KVOpenOptions& options = {});
 		void close();
 		
 		// Return the number of values in the current table.
+		// Constant time, unless the file predates the entry count and was opened read only.
 		std::size_t numValues() const;
 		std::size_t size() const;
 		bool empty() const;
@@ -59,18 +96,198 @@ namespace ez {
 		// Return an error object that can be queryed for info about what went wrong.
 		bool get(std::string_view name, std::string & data) const;
 		bool getView(std::string_view name, std::string_view& data) const;
+		// Same as getView, copied is set when the view refers to a decoded or cached copy instead of the stored bytes.
+		bool getView(std::string_view name, std::string_view& data, bool& copied) const;
 		bool getRaw(std::string_view name, const void*& data, std::size_t& len) const;
 		bool getStream(std::string_view name, ez::imemstream & stream) const;
 
+		// Batched lookups, all the keys are hashed and sorted up front then resolved in as few statement executions as possible.
+		// Each returns the number of keys found, duplicate keys in the request are counted once per occurrence.
+		std::size_t containsMany(const std::string_view* names, std::size_t count, std::vector<bool>& found) const;
+		std::size_t containsMany(const std::vector<std::string_view>& names, std::vector<bool>& found) const;
+		std::size_t getMany(const std::string_view* names, std::size_t count, KVBatchResult& result) const;
+		std::size_t getMany(const std::vector<std::string_view>& names, KVBatchResult& result) const;
+		std::size_t getViewMany(const std::string_view* names, std::size_t count, const LookupCallback& callback) const;
+		std::size_t getViewMany(const std::vector<std::string_view>& names, const LookupCallback& callback) const;
+
 		bool set(std::string_view name, std::string_view data);
 		bool setRaw(std::string_view name, const void* data, std::size_t len);
 
+		// Read modify write operations, each run as a single upsert so they are atomic without a batch, and cost one statement instead of a get and a set.
+		// Counters are stored as 8 byte native integers, the same as set<int64_t>, and start out at zero.
+		// Fails when the stored value is not 8 bytes long, value receives the new count.
+		bool increment(std::string_view name, int64_t delta, int64_t& value);
+		bool increment(std::string_view name, int64_t delta = 1);
+		// Append bytes to the end of a value, creating it when missing.
+		bool append(std::string_view name, std::string_view data);
+		// Replace the value with desired only if it currently equals expected, returns whether it was replaced.
+		bool compareAndSet(std::string_view name, std::string_view expected, std::string_view desired);
+		// Set the value only if the key is missing, returns whether it was set.
+		bool setIfAbsent(std::string_view name, std::string_view data);
+
+		// Typed values, stored as the raw bytes of a trivially copyable type with no strings in between.
+		// Reads fail when the stored size doesn't match the type. Values written with a layout have to be read with the same layout version.
+		template<typename T, std::enable_if_t<kv_trivial_v<T>, int> = 0>
+		bool get(std::string_view name, T& value) const {
+			const void* raw;
+			std::size_t len;
+			if (!getRaw(name, raw, len) || len != sizeof(T)) {
+				return false;
+			}
+			std::memcpy(&value, raw, sizeof(T));
+			return true;
+		}
+		template<typename T, std::enable_if_t<kv_trivial_v<T>, int> = 0>
+		bool get(std::string_view name, T& value, const KVLayout& layout) const {
+			const void* raw;
+			std::size_t count;
+			if (!getTyped(name, &layout, sizeof(T), 1, kv_swap_size_v<T>, raw, count) || count != 1) {
+				return false;
+			}
+			std::memcpy(&value, raw, sizeof(T));
+			return true;
+		}
+		template<typename T, std::enable_if_t<kv_trivial_v<T>, int> = 0>
+		bool set(std::string_view name, const T& value) {
+			return setRaw(name, &value, sizeof(T));
+		}
+		template<typename T, std::enable_if_t<kv_trivial_v<T>, int> = 0>
+		bool set(std::string_view name, const T& value, const KVLayout& layout) {
+			return setTyped(name, layout, &value, sizeof(T), kv_swap_size_v<T>);
+		}
+
+		// Arrays of a trivially copyable type.
+		// The pointer is valid until the next read, it points into the stored bytes unless they had to be copied for alignment or byte order.
+		template<typename T, std::enable_if_t<kv_trivial_v<T>, int> = 0>
+		bool getSpan(std::string_view name, const T*& values, std::size_t& count) const {
+			static_assert(alignof(T) <= alignof(std::max_align_t), "ez::KVStore::getSpan does not support over aligned types!");
+			const void* raw;
+			if (!getTyped(name, nullptr, sizeof(T), alignof(T), kv_swap_size_v<T>, raw, count)) {
+				return false;
+			}
+			values = static_cast<const T*>(raw);
+			return true;
+		}
+		template<typename T, std::enable_if_t<kv_trivial_v<T>, int> = 0>
+		bool getSpan(std::string_view name, const T*& values, std::size_t& count, const KVLayout& layout) const {
+			static_assert(alignof(T) <= alignof(std::max_align_t), "ez::KVStore::getSpan does not support over aligned types!");
+			const void* raw;
+			if (!getTyped(name, &layout, sizeof(T), alignof(T), kv_swap_size_v<T>, raw, count)) {
+				return false;
+			}
+			values = static_cast<const T*>(raw);
+			return true;
+		}
+		template<typename T, std::enable_if_t<kv_trivial_v<T>, int> = 0>
+		bool getSpan(std::string_view name, std::vector<T>& values) const {
+			const void* raw;
+			std::size_t count;
+			if (!getTyped(name, nullptr, sizeof(T), 1, kv_swap_size_v<T>, raw, count)) {
+				return false;
+			}
+			values.resize(count);
+			std::memcpy(values.data(), raw, count * sizeof(T));
+			return true;
+		}
+		template<typename T, std::enable_if_t<kv_trivial_v<T>, int> = 0>
+		bool setSpan(std::string_view name, const T* values, std::size_t count) {
+			return setRaw(name, values, count * sizeof(T));
+		}
+		template<typename T, std::enable_if_t<kv_trivial_v<T>, int> = 0>
+		bool setSpan(std::string_view name, const T* values, std::size_t count, const KVLayout& layout) {
+			return setTyped(name, layout, values, count * sizeof(T), kv_swap_size_v<T>);
+		}
+
+		// Create or replace a value of len zero bytes, to be filled in piece by piece through openBlob.
+		bool reserve(std::string_view name, std::size_t len);
+		// Open a value for incremental reads, and writes when writable is true.
+		// Use with iblobstream and oblobstream to stream values without holding them in memory.
+		bool openBlob(std::string_view name, KVBlob& blob, bool writable = false);
+
 		bool erase(std::string_view name);
 
+		// Load a large number of entries as fast as possible.
+		// Entries are buffered into chunks, sorted by hash so the table is filled in primary key order, and each chunk is committed in its own transaction.
+		// When called inside of a batch, the chunks become part of the batch instead.
+		// Later duplicates of a key overwrite earlier ones, just like set.
+		KVBulkStats bulkLoad(const BulkSource& source, const KVBulkOptions& options = {});
+
+		// Bulk load from a range of KVEntry or KVEntryView
+		template<typename Iter>
+		KVBulkStats bulkLoad(Iter first, Iter last, const KVBulkOptions& options = {}) {
+			return bulkLoad([&](KVEntryView& entry) {
+				if (first == last) {
+					return false;
+				}
+				entry.key = first->key;
+				entry.value = first->value;
+				++first;
+				return true;
+			}, options);
+		}
+
 		bool rename(std::string_view old, std::string_view name);
 
 		void clear();
 
+		// Prefix every value with a header byte identifying how it was encoded, and compress values of at least threshold bytes.
+		// This is permanent for the file, existing values are given a header in a single transaction.
+		// Calling it again only changes the threshold for this handle, the file keeps the threshold it was first enabled with.
+		bool enableCodec(std::size_t threshold = 64);
+		bool hasCodec() const;
+		// Use a custom codec to encode new values, instead of the built in KVLZCodec.
+		// Custom codecs are not stored in the file, they have to be set on every handle that reads their values.
+		void setCodec(std::shared_ptr<const KVCodec> codec);
+		// Train a shared dictionary from a random sample of the stored values, to better compress small values.
+		// The dictionary is kept in ez_kvstore_meta, and can only be trained once per store.
+		bool trainDictionary(std::size_t size = 16 << 10, std::size_t samples = 1024);
+
+		// Keep recently read values in memory, limited to roughly the given number of bytes.
+		// Writes through this handle keep the cache up to date, writes through other connections are not seen by it.
+		// A capacity of zero disables the cache.
+		void setCacheCapacity(std::size_t bytes);
+		std::size_t getCacheCapacity() const;
+		KVCacheStats getCacheStats() const;
+
+		// Keep a bloom filter of the stored key hashes, so lookups of missing keys can skip the database entirely.
+		// The filter is built from the table when the store is opened, and grows as entries are added.
+		// Only use this when every write to the store goes through this handle.
+		void enableFilter(double falsePositiveRate = 0.01);
+		void disableFilter();
+		bool hasFilter() const;
+		// Rebuild the filter from scratch, dropping any erased keys it still holds.
+		void rebuildFilter();
+		KVFilterStats getFilterStats() const;
+
+		// Operation counts, bytes moved and latency histograms since the last reset, along with the sqlite page cache and memory counters.
+		// The operation counters are always kept, they cost a few relaxed atomic increments per call.
+		KVStatus getStatus() const;
+		// Zero the operation counters, the filter counters and the sqlite page cache counters.
+		void resetStatus();
+		// Call func after every operation that takes at least threshold, an empty func turns it off.
+		void setSlowOperationCallback(std::chrono::nanoseconds threshold, KVSlowOpCallback func);
+
+		// Page usage of the file, for deciding when compacting is worth it.
+		KVSpaceStats getSpaceStats() const;
+		// Return up to the given number of free pages to the file system, all of them when zero. Returns the number of pages freed.
+		// Only stores with incremental auto vacuum can be compacted, each call is a short write transaction of its own unless in a batch.
+		std::size_t compact(std::size_t pages = 0);
+		// Rebuild the whole file, dropping every free page and defragmenting the table, optionally switching the auto vacuum mode.
+		// Holds an exclusive lock for as long as it runs, and fails in a batch or while anything is reading from this handle.
+		bool vacuum();
+		bool vacuum(KVOpenOptions::AutoVacuum mode);
+
+		// Whether the file was written by an older version of the library, and keeps hashing keys the old way until upgraded.
+		bool needsUpgrade() const;
+		// Rehash every key into the current layout, committing chunk entries at a time so memory use stays bounded.
+		// Other connections must not write to the store while it runs, an upgrade that gets interrupted starts over the next time.
+		// Once upgraded, older versions of the library refuse to open the file. Fails in a batch or while anything is reading from this handle.
+		bool upgrade(std::size_t chunk = 1 << 16);
+
+		// Reset the cached statements, which ends the implicit read transaction they hold open.
+		// Any view previously returned by getView or getRaw is invalidated.
+		void finishReads() const;
+
 		bool inBatch() const;
 		bool beginBatch();
 		void commitBatch();
@@ -79,22 +296,157 @@ namespace ez {
 		const_iterator begin() const;
 		const_iterator end() const;
 
+		// Ordered scans, keys are compared as bytes.
+		// These work on any store, but without the key index every scan has to sort the whole table.
+		// Entries with a key not less than key.
+		ordered_range lowerBound(std::string_view key) const;
+		// Entries with first <= key < last.
+		ordered_range range(std::string_view first, std::string_view last) const;
+		// Entries whose key starts with prefix.
+		ordered_range prefix(std::string_view prefix) const;
+
+		// Position a cursor at the first entry, or where the given token from KVCursor::token left off.
+		// Reopening a cursor on the same store reuses its prepared statement, so paging through tokens never prepares twice.
+		bool openCursor(KVCursor& cursor) const;
+		bool openCursor(KVCursor& cursor, std::string_view token) const;
+
+		// Keep an index on the keys in the file, so ordered scans cost O(log n + k).
+		// Like any schema change, this fails while a scan is still in progress.
+		bool enableKeyIndex();
+		void dropKeyIndex();
+		bool hasKeyIndex() const;
+
 		std::vector<KVEntry> getEntries() const;
 		std::unordered_map<std::string, std::string> getMap() const;
+
+		// Copy every entry into a single arena, with an in memory index for lookups.
+		// Much cheaper than getEntries or getMap for large numbers of small entries.
+		KVSnapshot getSnapshot() const;
+		// Open a second connection pinned to the current state of the file, see KVReadSnapshot.
+		// Switches the file to WAL if it isn't already, and fails for in memory stores or when that isn't possible.
+		// Writes in a batch that has not been committed yet are not part of the snapshot.
+		KVReadSnapshot snapshot() const;
+
+		// Open a named table, a key space of its own within the same file, see KVTable.
+		// The table is created if it doesn't exist yet, unless the store is read only, in which case the returned table is not open.
+		KVTable table(std::string_view name);
+		bool hasTable(std::string_view name) const;
+		std::vector<std::string> tableNames() const;
+		// Drop a named table along with every entry in it, in a single statement no matter how large the table is.
+		// Like any schema change, this fails and returns false while an iterator, cursor or blob is open on any table of the store.
+		bool dropTable(std::string_view name);
+
+		// Compile the store into an immutable file for KVFrozenStore, meant for stores that are written once and then only read.
+		bool exportFrozen(const std::filesystem::path& path) const;
+
+		// Split the hash space into contiguous ranges, and scan each one on its own read only connection and thread.
+		// Only committed data is visible to the other connections, so while a batch is in progress
+		// or for in memory databases, the partitions are scanned one after the other on this connection instead.
+		void parallelScan(const ScanVisitor& visitor, const KVScanOptions& options = {}) const;
+		void parallelScanBatches(const ScanBatchVisitor& visitor, const KVScanOptions& options = {}) const;
+		// Gather every entry with a parallel scan, as one vector per partition or merged together.
+		std::vector<std::vector<KVEntry>> getPartitions(const KVScanOptions& options = {}) const;
+		std::vector<KVEntry> getEntries(const KVScanOptions& options) const;
+		std::unordered_map<std::string, std::string> getMap(const KVScanOptions& options) const;
 	private:
+		friend class KVReadSnapshot;
+		friend class KVTable;
+
+		// A table of entries, with its own prepared statements that are each prepared the first time they are needed.
+		struct Table {
+			// Name of the table in the sqlite schema.
+			std::string sql;
+			// Row of ez_kvstore_tables for named tables, zero for the default table.
+			int64_t id = 0;
+			mutable std::optional<SQLite::Statement>
+				containsStmt,
+				getStmt,
+				setStmt,
+				eraseStmt,
+				countStmt,
+				containsManyStmt,
+				getManyStmt,
+				incrementStmt,
+				appendStmt,
+				compareStmt,
+				insertStmt;
+		};
+		// The sql functions behind the read modify write operations, registered on every connection.
+		struct Update;
+
+		void installFunctions();
+		SQLite::Statement& updateStatement(std::optional<SQLite::Statement>& stmt, const char* query) const;
+
 		void resetStmts();
+		// Whether any statement on the connection is part way through, like an open iterator, cursor or blob.
+		bool hasBusyStatements() const;
 		void createTable();
+		void installCounter();
+		void upgradeCounter(int64_t version);
+		void rehashKeys(std::size_t chunk);
+		// Returns false with the connection closed again when a pragma fails.
+		bool applyOptions(const KVOpenOptions& options, bool creating, bool readonly);
+
+		Table* findTable(std::string_view name, bool create) const;
+		void createNamedTable(int64_t id) const;
+		std::size_t numValues(const Table& table) const;
+		bool contains(const Table& table, std::string_view name) const;
+		bool getRaw(const Table& table, std::string_view name, const void*& data, std::size_t& len) const;
+		bool setRaw(const Table& table, std::string_view name, const void* data, std::size_t len);
+		bool erase(const Table& table, std::string_view name);
+		bool rename(const Table& table, std::string_view old, std::string_view name);
+		void clear(const Table& table);
+
+		SQLite::Statement& setStatement(const Table& table) const;
+		SQLite::Statement& slotStatement(const Table& table) const;
+		int64_t hashKey(std::string_view name) const;
+		bool findSlot(const Table& table, std::string_view name, int64_t hash, int64_t& slot) const;
+		// Returns true when the key was not stored yet, and a new row was added for it.
+		bool storeSlot(const Table& table, SQLite::Statement& stmt, std::string_view name, int64_t hash);
+		void closeGap(const Table& table, int64_t slot);
+		bool lookup(const Table& table, std::string_view name, std::string_view& value, bool& copied) const;
+		// Typed values behind a layout header, and arrays, which may have to be copied to be aligned or converted.
+		bool getTyped(std::string_view name, const KVLayout* layout, std::size_t size, std::size_t align, std::size_t swapSize, const void*& values, std::size_t& count) const;
+		bool setTyped(std::string_view name, const KVLayout& layout, const void* value, std::size_t len, std::size_t swapSize);
+		std::string_view encodeValue(std::string_view value) const;
+		std::string_view decodeValue(std::string_view stored) const;
+		void loadCodec();
+		// The value cache and the bloom filter only cover the default table.
+		KVValueCache* cacheOf(const Table& table) const;
+		bool filterRejects(const Table& table, int64_t hash) const;
+		void filterInsert(const Table& table, int64_t hash);
+		using EntryFunc = std::function<void(const KVEntryView& entry)>;
+		using PartitionScan = std::function<void(const EntryFunc& func)>;
+		using PartitionTask = std::function<void(std::size_t partition, const PartitionScan& scan)>;
+		// Upper bound for the keys starting with prefix, none when every key from the prefix on starts with it.
+		static std::optional<std::string> prefixEnd(std::string_view prefix);
+		void scanPartitions(const KVScanOptions& options, const PartitionTask& task) const;
+		std::size_t lookupMany(const Table& table, const std::string_view* names, std::size_t count, bool values, const LookupCallback& callback) const;
 
 		struct Data {
 			// Mutable is necessary for lazy initialization.
 			mutable std::optional<SQLite::Database> db;
 			mutable std::optional<SQLite::Transaction> batch;
-			mutable std::optional<SQLite::Statement>
-				containsStmt,
-				getStmt,
-				setStmt,
-				eraseStmt,
-				countStmt;
+			mutable std::optional<KVValueCache> cache;
+			mutable std::optional<KVBloomFilter> filter;
+			mutable KVFilterStats filterStats;
+			mutable KVStatusRecorder status;
+			double filterRate = 0.0;
+			// Only set for stores with codecs enabled.
+			std::shared_ptr<KVValueCodec> codec;
+			std::vector<std::shared_ptr<const KVCodec>> customCodecs;
+			mutable std::string encodeBuffer, decodeBuffer, typedBuffer;
+			mutable std::vector<std::max_align_t> alignBuffer;
+			// Set by the increment function while its statement runs.
+			mutable int64_t counter = 0;
+			mutable bool counterMismatch = false;
+			// Whether the file maintains its own entry count.
+			bool hasCounter = false;
+			// Files older than version 3 opened read only keep their XXH64 key hashes.
+			bool legacyHash = false;
+			Table main{ "main" };
+			// Named tables opened so far, by name.
+			mutable std::map<std::string, std::unique_ptr<Table>, std::less<>> tables;
 		};
 		mutable std::unique_ptr<Data> data;
 	};
@@ -0,0 +1,69 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <ez/KVStore.hpp>
+
+namespace ez {
+	/*
+	* Handle to a named table of a store, obtained from KVStore::table.
+	* Each named table is a separate key space in the same file, with its own prepared statements,
+	* so unrelated data can share a file and a batch, and still be dropped all at once.
+	* The value cache, the bloom filter and the codec dictionary training only cover the default table, but values are encoded like everywhere else.
+	* Only valid while the store it came from is open and not moved, and stops working once the table is dropped.
+	*/
+	class KVTable {
+	public:
+		using const_iterator = KVStore::const_iterator;
+		using iterator = const_iterator;
+		using ordered_range = KVStore::ordered_range;
+
+		KVTable() = default;
+
+		// Whether the table exists in an open store.
+		bool isOpen() const;
+		const std::string& name() const noexcept;
+
+		std::size_t numValues() const;
+		std::size_t size() const;
+		bool empty() const;
+
+		bool contains(std::string_view name) const;
+		bool get(std::string_view name, std::string& data) const;
+		// The view is valid until the next read from the store.
+		bool getView(std::string_view name, std::string_view& data) const;
+		bool getStream(std::string_view name, ez::imemstream& stream) const;
+
+		std::size_t containsMany(const std::vector<std::string_view>& names, std::vector<bool>& found) const;
+		std::size_t getMany(const std::vector<std::string_view>& names, KVBatchResult& result) const;
+
+		bool set(std::string_view name, std::string_view data);
+		bool erase(std::string_view name);
+		bool rename(std::string_view old, std::string_view name);
+		// Replaces the table with an empty one instead of deleting row by row.
+		// While an iterator, cursor or blob is open on the store the table can't be replaced, and is emptied row by row instead.
+		void clear();
+
+		const_iterator begin() const;
+		const_iterator end() const;
+
+		// Ordered scans, which always sort the table as there is no key index for named tables.
+		ordered_range lowerBound(std::string_view key) const;
+		ordered_range range(std::string_view first, std::string_view last) const;
+		ordered_range prefix(std::string_view prefix) const;
+
+		std::vector<KVEntry> getEntries() const;
+		std::unordered_map<std::string, std::string> getMap() const;
+	private:
+		friend class KVStore;
+
+		KVTable(KVStore* store, std::string_view name);
+
+		const KVStore::Table* find() const;
+
+		KVStore* store = nullptr;
+		std::string tableName;
+	};
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <ez/KVStore.hpp>
+
+namespace ez {
+	// Iterates every shard in turn.
+	class KVShardedGenerator {
+	public:
+		KVShardedGenerator(std::vector<const KVStore*> stores);
+
+		bool advance(KVEntryView& value);
+
+		std::vector<const KVStore*> stores;
+		std::size_t next;
+		std::optional<KVStore::const_iterator> current;
+	};
+
+	/*
+	* A store split over several files, so writes to different shards can proceed in parallel.
+	* Keys are assigned to shards by their hash, and the shard count is fixed when the store is created.
+	* The files live in a directory along with a manifest recording the shard count.
+	* All of the methods are thread safe, each shard is guarded by its own lock.
+	*/
+	class ShardedKVStore {
+		struct Data;
+	public:
+		using const_iterator = KVIterator<KVShardedGenerator, KVEntryView>;
+		using iterator = const_iterator;
+
+		ShardedKVStore();
+		~ShardedKVStore();
+
+		ShardedKVStore(ShardedKVStore&&) noexcept;
+		ShardedKVStore& operator=(ShardedKVStore&&) noexcept;
+
+		ShardedKVStore(const ShardedKVStore&) = delete;
+		ShardedKVStore& operator=(const ShardedKVStore&) = delete;
+
+		// Create a new store in the directory, zero shards uses one per hardware thread.
+		bool create(const std::filesystem::path& directory, std::size_t shards = 0, bool overwrite = false, const KVOpenOptions& options = {});
+		bool open(const std::filesystem::path& directory, bool readonly = false, const KVOpenOptions& options = {});
+		void close();
+		bool isOpen() const noexcept;
+
+		std::size_t numShards() const noexcept;
+		// The shard a key is stored in.
+		std::size_t shardOf(std::string_view name) const;
+
+		std::size_t numValues() const;
+		std::size_t size() const;
+		bool empty() const;
+
+		bool contains(std::string_view name) const;
+		bool get(std::string_view name, std::string& data) const;
+		std::size_t getMany(const std::vector<std::string_view>& names, KVBatchResult& result) const;
+
+		bool set(std::string_view name, std::string_view data);
+		bool setRaw(std::string_view name, const void* data, std::size_t len);
+		bool erase(std::string_view name);
+		// Moving a key between shards copies it over and erases the original, which is not atomic.
+		bool rename(std::string_view old, std::string_view name);
+		void clear();
+
+		// Batches span every shard, the shards are committed in parallel.
+		// Each shard commits on its own, so a failure part way through may leave some shards committed.
+		bool inBatch() const;
+		bool beginBatch();
+		void commitBatch();
+		void cancelBatch();
+
+		// Entries are split up by shard as they arrive, and the shards are loaded in parallel.
+		KVBulkStats bulkLoad(const KVStore::BulkSource& source, const KVBulkOptions& options = {});
+
+		// Run a function on every shard at once, each on its own thread with the shard locked.
+		void parallel(const std::function<void(std::size_t shard, KVStore& store)>& func);
+		// Run a function with exclusive access to a single shard.
+		void write(std::size_t shard, const std::function<void(KVStore&)>& func);
+
+		// Iteration takes no locks, it must not overlap with writes.
+		const_iterator begin() const;
+		const_iterator end() const;
+	private:
+		std::unique_ptr<Data> data;
+	};
+}
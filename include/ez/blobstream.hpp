@@ -0,0 +1,173 @@
+#pragma once
+#include <algorithm>
+#include <istream>
+#include <ostream>
+#include <streambuf>
+#include <vector>
+#include <ez/KVBlob.hpp>
+
+namespace ez {
+	// Buffered stream buffer over a KVBlob, complementing membuf for values too large to load in one piece.
+	// Only a single chunk of the value is held in memory at a time.
+	// Writes can not grow the value, reserve the full size up front.
+	class blobbuf : public std::streambuf {
+	public:
+		using char_type = char;
+		using int_type = std::streambuf::int_type;
+		using pos_type = std::streambuf::pos_type;
+		using off_type = std::streambuf::off_type;
+		using traits_type = std::streambuf::traits_type;
+
+		static constexpr std::size_t default_chunk = std::size_t(64) << 10;
+
+		blobbuf(KVBlob& _blob, std::size_t chunk = default_chunk)
+			: blob(&_blob)
+			, buffer(chunk == 0 ? default_chunk : chunk)
+			, base(0)
+		{}
+		~blobbuf() override {
+			flush();
+		}
+
+		blobbuf(const blobbuf&) = delete;
+		blobbuf& operator=(const blobbuf&) = delete;
+	protected:
+		int_type underflow() override {
+			if (flush() != 0) {
+				return traits_type::eof();
+			}
+
+			std::size_t pos = position();
+			this->setp(nullptr, nullptr);
+			if (pos >= blob->size()) {
+				return traits_type::eof();
+			}
+
+			std::size_t count = std::min(buffer.size(), blob->size() - pos);
+			if (!blob->readAt(pos, buffer.data(), count)) {
+				return traits_type::eof();
+			}
+
+			base = pos;
+			this->setg(buffer.data(), buffer.data(), buffer.data() + count);
+			return traits_type::to_int_type(*this->gptr());
+		}
+
+		int_type overflow(int_type ch) override {
+			std::size_t pos = position();
+			if (flush() != 0) {
+				return traits_type::eof();
+			}
+
+			this->setg(nullptr, nullptr, nullptr);
+			if (pos >= blob->size()) {
+				return traits_type::eof();
+			}
+
+			std::size_t count = std::min(buffer.size(), blob->size() - pos);
+			base = pos;
+			this->setp(buffer.data(), buffer.data() + count);
+
+			if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+				*this->pptr() = traits_type::to_char_type(ch);
+				this->pbump(1);
+			}
+			return traits_type::not_eof(ch);
+		}
+
+		int sync() override {
+			return flush();
+		}
+
+		pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which = std::ios_base::in | std::ios_base::out) override
+		{
+			pos_type res = pos_type(off_type(-1));
+			if (flush() != 0) {
+				return res;
+			}
+
+			off_type target = 0;
+			switch (dir) {
+			case std::ios_base::beg:
+				target = off;
+				break;
+			case std::ios_base::cur:
+				target = off_type(position()) + off;
+				break;
+			case std::ios_base::end:
+				target = off_type(blob->size()) + off;
+				break;
+			default:
+				return res;
+			}
+			if (target < 0 || target > off_type(blob->size())) {
+				return res;
+			}
+
+			// Drop the buffered window, the next read or write starts at the new position.
+			base = std::size_t(target);
+			this->setg(nullptr, nullptr, nullptr);
+			this->setp(nullptr, nullptr);
+			return pos_type(target);
+		}
+
+		pos_type seekpos(pos_type sp, std::ios_base::openmode which = std::ios_base::in | std::ios_base::out) override
+		{
+			return this->seekoff(sp - pos_type(off_type(0)), std::ios_base::beg, which);
+		}
+	private:
+		std::size_t position() const {
+			if (this->pptr()) {
+				return base + std::size_t(this->pptr() - this->pbase());
+			}
+			if (this->gptr()) {
+				return base + std::size_t(this->gptr() - this->eback());
+			}
+			return base;
+		}
+
+		// Write out the pending part of the put area.
+		int flush() {
+			if (this->pptr() && this->pptr() > this->pbase()) {
+				std::size_t count = std::size_t(this->pptr() - this->pbase());
+				if (!blob->writeAt(base, this->pbase(), count)) {
+					return -1;
+				}
+				base += count;
+				this->setp(buffer.data(), buffer.data());
+			}
+			return 0;
+		}
+
+		KVBlob* blob;
+		std::vector<char> buffer;
+		std::size_t base;
+	};
+
+	class iblobstream : public std::istream {
+	public:
+		iblobstream(KVBlob& blob, std::size_t chunk = blobbuf::default_chunk)
+			: std::istream(nullptr)
+			, bbuf(blob, chunk)
+		{
+			this->init(&bbuf);
+		}
+	private:
+		blobbuf bbuf;
+	};
+
+	class oblobstream : public std::ostream {
+	public:
+		oblobstream(KVBlob& blob, std::size_t chunk = blobbuf::default_chunk)
+			: std::ostream(nullptr)
+			, bbuf(blob, chunk)
+		{
+			this->init(&bbuf);
+		}
+		~oblobstream() override {
+			bbuf.pubsync();
+		}
+	private:
+		blobbuf bbuf;
+	};
+}
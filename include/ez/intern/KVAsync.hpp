@@ -0,0 +1,105 @@
+#pragma once
+#include <cassert>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <ez/intern/KVEntry.hpp>
+
+namespace ez {
+	// One page of KVAsyncStore::scanAsync.
+	struct KVScanPage {
+		std::vector<KVEntry> entries;
+		// Pass back to scanAsync for the next page.
+		std::string token;
+		// No entries are left after this page.
+		bool done = false;
+	};
+
+	/*
+	Result of an asynchronous call, completed by the executor.
+	Can be waited on like a future, or awaited from a C++20 coroutine.
+	await_suspend takes any handle with a resume method, so the same class works whether or not the including code is built as C++20.
+	The awaiting coroutine is resumed wherever the result is delivered, see KVAsyncStoreOptions::dispatch.
+	*/
+	template<typename T>
+	class KVAsync {
+		struct State {
+			std::mutex mutex;
+			std::condition_variable done;
+			std::optional<T> value;
+			std::function<void()> continuation;
+		};
+	public:
+		KVAsync() = default;
+
+		// A result and the function that completes it.
+		static std::pair<KVAsync, std::function<void(T)>> make() {
+			KVAsync result;
+			result.state = std::make_shared<State>();
+			std::function<void(T)> complete = [state = result.state](T value) {
+				std::function<void()> continuation;
+				{
+					std::lock_guard<std::mutex> lock(state->mutex);
+					state->value.emplace(std::move(value));
+					continuation = std::move(state->continuation);
+				}
+				state->done.notify_all();
+				if (continuation) {
+					continuation();
+				}
+			};
+			return { std::move(result), std::move(complete) };
+		}
+
+		bool valid() const noexcept {
+			return bool(state);
+		}
+		bool ready() const {
+			assert(state);
+			std::lock_guard<std::mutex> lock(state->mutex);
+			return state->value.has_value();
+		}
+		void wait() const {
+			assert(state);
+			std::unique_lock<std::mutex> lock(state->mutex);
+			state->done.wait(lock, [&] { return state->value.has_value(); });
+		}
+		// Blocks until the result is in, the result can only be taken once.
+		T get() {
+			wait();
+			return take();
+		}
+
+		bool await_ready() const {
+			return ready();
+		}
+		template<typename Handle>
+		bool await_suspend(Handle handle) {
+			std::lock_guard<std::mutex> lock(state->mutex);
+			if (state->value) {
+				return false;
+			}
+			state->continuation = [handle]() mutable {
+				handle.resume();
+			};
+			return true;
+		}
+		T await_resume() {
+			return take();
+		}
+	private:
+		T take() {
+			std::shared_ptr<State> taken = std::move(state);
+			std::lock_guard<std::mutex> lock(taken->mutex);
+			return std::move(taken->value.value());
+		}
+
+		std::shared_ptr<State> state;
+	};
+}
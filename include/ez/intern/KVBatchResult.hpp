@@ -0,0 +1,72 @@
+#pragma once
+#include <cassert>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ez {
+	/*
+	Flat result set for batched lookups.
+	All the found values are copied into a single arena, one slot per requested key.
+	The arena is reused between calls, so passing the same result object in repeatedly avoids reallocation.
+	*/
+	class KVBatchResult {
+	public:
+		static constexpr std::size_t npos = ~std::size_t(0);
+
+		KVBatchResult() = default;
+
+		// Reset the result to hold 'count' slots, all of them not found.
+		void reset(std::size_t count) {
+			arena.clear();
+			slots.assign(count, Slot{ npos, 0 });
+			numFound = 0;
+		}
+		void clear() {
+			reset(0);
+		}
+
+		// Number of slots, which is the number of keys requested.
+		std::size_t size() const noexcept {
+			return slots.size();
+		}
+		// Number of keys that were found.
+		std::size_t count() const noexcept {
+			return numFound;
+		}
+
+		bool found(std::size_t i) const {
+			assert(i < slots.size());
+			return slots[i].offset != npos;
+		}
+		// The value for slot i, empty if the key was not found.
+		std::string_view value(std::size_t i) const {
+			assert(i < slots.size());
+			const Slot& slot = slots[i];
+			if (slot.offset == npos) {
+				return std::string_view{};
+			}
+			return std::string_view(arena.data() + slot.offset, slot.length);
+		}
+
+		// Copy a value into the arena for slot i.
+		void assign(std::size_t i, std::string_view data) {
+			assert(i < slots.size());
+			Slot& slot = slots[i];
+			if (slot.offset == npos) {
+				++numFound;
+			}
+			slot.offset = arena.size();
+			slot.length = data.length();
+			arena.append(data.data(), data.length());
+		}
+	private:
+		struct Slot {
+			std::size_t offset, length;
+		};
+
+		std::string arena;
+		std::vector<Slot> slots;
+		std::size_t numFound = 0;
+	};
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <cinttypes>
+#include <cstddef>
+#include <vector>
+
+namespace ez {
+	struct KVFilterStats {
+		// Number of lookups that consulted the filter.
+		std::size_t queries = 0;
+		// Lookups the filter answered on its own, without touching the database.
+		std::size_t definiteMisses = 0;
+		// Lookups the filter let through that turned out to be missing anyway.
+		std::size_t falsePositives = 0;
+
+		std::size_t entries = 0;
+		std::size_t bits = 0;
+		// The false positive rate the filter was sized for.
+		double targetRate = 0.0;
+
+		// Measured fraction of missing keys the filter failed to reject.
+		double falsePositiveRate() const noexcept {
+			std::size_t negatives = definiteMisses + falsePositives;
+			return negatives == 0 ? 0.0 : double(falsePositives) / double(negatives);
+		}
+	};
+
+	/*
+	Cache line blocked bloom filter over the key hashes.
+	Each hash selects a single 512 bit block and sets all of its bits inside of it,
+	so a query costs at most one cache miss.
+	Entries can only be added, erased keys stay in the filter until it is rebuilt.
+	*/
+	class KVBloomFilter {
+	public:
+		KVBloomFilter(std::size_t capacity, double rate);
+
+		void insert(int64_t hash) noexcept;
+		bool mayContain(int64_t hash) const noexcept;
+		void clear() noexcept;
+
+		// Number of entries the filter was sized for.
+		std::size_t capacity() const noexcept;
+		std::size_t size() const noexcept;
+		std::size_t numBits() const noexcept;
+		double rate() const noexcept;
+	private:
+		static constexpr std::size_t block_words = 8;
+
+		std::vector<uint64_t> words;
+		std::size_t numBlocks, numHashes, maxEntries, numEntries;
+		double targetRate;
+	};
+}
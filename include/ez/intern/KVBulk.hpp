@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+
+namespace ez {
+	// Settings for KVStore::bulkLoad
+	struct KVBulkOptions {
+		// Maximum number of entries buffered, sorted and committed together.
+		std::size_t chunkEntries = 1 << 16;
+		// Maximum number of key and value bytes buffered before a chunk is flushed, whichever limit is hit first.
+		std::size_t chunkBytes = std::size_t(64) << 20;
+	};
+
+	// Summary of a completed KVStore::bulkLoad
+	struct KVBulkStats {
+		std::size_t entries = 0;
+		std::size_t bytes = 0;
+		std::size_t chunks = 0;
+		double seconds = 0.0;
+
+		double entriesPerSecond() const noexcept {
+			return seconds > 0.0 ? double(entries) / seconds : 0.0;
+		}
+		double bytesPerSecond() const noexcept {
+			return seconds > 0.0 ? double(bytes) / seconds : 0.0;
+		}
+	};
+}
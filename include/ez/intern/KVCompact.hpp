@@ -0,0 +1,26 @@
+#pragma once
+#include <cinttypes>
+#include <cstddef>
+
+namespace ez {
+	// Page usage of a store file, from KVStore::getSpaceStats
+	struct KVSpaceStats {
+		int64_t pageSize = 0;
+		int64_t pageCount = 0;
+		// Pages no longer used by any table, still taking up room in the file.
+		int64_t freePages = 0;
+		// Whether KVStore::compact can return the free pages to the file system.
+		bool incremental = false;
+
+		int64_t fileBytes() const noexcept {
+			return pageSize * pageCount;
+		}
+		int64_t freeBytes() const noexcept {
+			return pageSize * freePages;
+		}
+		// Fraction of the file taken up by free pages.
+		double fragmentation() const noexcept {
+			return pageCount == 0 ? 0.0 : double(freePages) / double(pageCount);
+		}
+	};
+}
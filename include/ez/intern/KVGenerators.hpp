@@ -1,23 +1,44 @@
 #pragma once
+#include <memory>
+#include <optional>
 #include <ez/intern/KVEntry.hpp>
+#include <ez/intern/KVValueCodec.hpp>
 #include <SQLiteCpp/Database.h>
 #include <SQLiteCpp/Statement.h>
 
 namespace ez {
+	// The codec is only needed for stores with codecs enabled, values are decoded as they are read.
 	class KVEntryGenerator {
 	public:
-		KVEntryGenerator(SQLite::Database& db, std::string_view table);
+		KVEntryGenerator(SQLite::Database& db, std::string_view table, std::shared_ptr<const KVValueCodec> codec = nullptr);
 
 		bool advance(KVEntry& value);
 
 		SQLite::Statement stmt;
+		std::shared_ptr<const KVValueCodec> codec;
+		std::string buffer;
 	};
 	class KVEntryViewGenerator {
 	public:
-		KVEntryViewGenerator(SQLite::Database& db, std::string_view table);
+		KVEntryViewGenerator(SQLite::Database& db, std::string_view table, std::shared_ptr<const KVValueCodec> codec = nullptr);
 
 		bool advance(KVEntryView& value);
 
 		SQLite::Statement stmt;
+		std::shared_ptr<const KVValueCodec> codec;
+		std::string buffer;
 	};
-}
\ No newline at end of file
+
+	// Entries in key order, with first <= key and key < last when there is a last.
+	// Keys are compared as bytes.
+	class KVOrderedGenerator {
+	public:
+		KVOrderedGenerator(SQLite::Database& db, std::string_view table, std::string_view first, std::optional<std::string_view> last, std::shared_ptr<const KVValueCodec> codec = nullptr);
+
+		bool advance(KVEntryView& value);
+
+		SQLite::Statement stmt;
+		std::shared_ptr<const KVValueCodec> codec;
+		std::string buffer;
+	};
+}
@@ -74,4 +74,26 @@ namespace ez {
 	private:
 		std::shared_ptr<Data> data;
 	};
+
+	// A pair of iterators, so a generator can be used directly in a range based for loop.
+	template<typename Iterator>
+	class KVRange {
+	public:
+		using iterator = Iterator;
+		using const_iterator = Iterator;
+
+		KVRange(Iterator _first, Iterator _last = Iterator())
+			: first(std::move(_first))
+			, last(std::move(_last))
+		{}
+
+		Iterator begin() const {
+			return first;
+		}
+		Iterator end() const {
+			return last;
+		}
+	private:
+		Iterator first, last;
+	};
 }
\ No newline at end of file
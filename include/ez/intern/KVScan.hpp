@@ -0,0 +1,12 @@
+#pragma once
+#include <cstddef>
+
+namespace ez {
+	// Settings for the parallel scans of KVStore
+	struct KVScanOptions {
+		// Number of hash ranges scanned side by side, zero uses one per hardware thread.
+		std::size_t partitions = 0;
+		// Maximum number of entries handed to a batch visitor at once.
+		std::size_t batchSize = 256;
+	};
+}
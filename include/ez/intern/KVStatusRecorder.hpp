@@ -0,0 +1,42 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <string_view>
+
+#include <ez/KVStatus.hpp>
+
+namespace ez {
+	/*
+	Counters behind KVStore::getStatus.
+	Every counter is a relaxed atomic, so recording costs a handful of uncontended increments
+	and the counters can be read from another thread while the store is in use.
+	*/
+	class KVStatusRecorder {
+	public:
+		KVStatusRecorder() = default;
+		KVStatusRecorder(const KVStatusRecorder&) = delete;
+		KVStatusRecorder& operator=(const KVStatusRecorder&) = delete;
+
+		void record(KVOp op, std::chrono::nanoseconds time, uint64_t count, uint64_t bytesRead, uint64_t bytesWritten, std::string_view key = {});
+
+		void setSlowCallback(std::chrono::nanoseconds threshold, KVSlowOpCallback callback);
+
+		// Fills in the operation counters of the status.
+		void collect(KVStatus& status) const;
+		void reset();
+	private:
+		struct Counters {
+			std::atomic<uint64_t> count{ 0 }, bytesRead{ 0 }, bytesWritten{ 0 };
+			std::atomic<uint64_t> samples{ 0 }, totalNanos{ 0 }, maxNanos{ 0 };
+			std::array<std::atomic<uint64_t>, KVHistogram::numBuckets> buckets{};
+		};
+
+		std::array<Counters, kvNumOps> counters;
+		std::atomic<uint64_t> slowOps{ 0 };
+
+		std::chrono::nanoseconds slowThreshold{ 0 };
+		KVSlowOpCallback slowCallback;
+	};
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <cinttypes>
+#include <cstddef>
+#include <string_view>
+#include <type_traits>
+
+namespace ez {
+	enum class KVEndian : uint8_t {
+		Little = 1,
+		Big = 2,
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		Native = Big,
+#else
+		Native = Little,
+#endif
+	};
+
+	// Optional tag for typed values, kept in a small header in front of the value.
+	// Values written with a different version of the layout of a type are refused instead of being misread.
+	struct KVLayout {
+		// Bump whenever the layout of the stored type changes.
+		uint16_t version = 0;
+		// Byte order to store the value in, only used when writing, as the header tells readers which order was used.
+		// Arithmetic and enum values are converted on the way in and out, other types can only be stored in the native order.
+		KVEndian endian = KVEndian::Native;
+	};
+
+	// Size of the header written for a KVLayout.
+	inline constexpr std::size_t kvLayoutBytes = 4;
+
+	// Types stored as their raw bytes by the typed overloads of KVStore.
+	// Arrays, pointers and views are left out, so that string literals and views keep going to the string overloads.
+	template<typename T>
+	inline constexpr bool kv_trivial_v =
+		std::is_trivially_copyable_v<T> &&
+		!std::is_array_v<T> &&
+		!std::is_pointer_v<T> &&
+		!std::is_same_v<std::remove_cv_t<T>, std::string_view>;
+
+	// Width of the units whose byte order is converted, zero for types that can't be converted.
+	template<typename T>
+	inline constexpr std::size_t kv_swap_size_v = (std::is_arithmetic_v<T> || std::is_enum_v<T>) ? sizeof(T) : 0;
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <cinttypes>
+#include <cstddef>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace ez {
+	struct KVCacheStats {
+		std::size_t hits = 0;
+		std::size_t misses = 0;
+		std::size_t evictions = 0;
+		std::size_t entries = 0;
+		std::size_t bytes = 0;
+		std::size_t capacity = 0;
+
+		double hitRate() const noexcept {
+			std::size_t total = hits + misses;
+			return total == 0 ? 0.0 : double(hits) / double(total);
+		}
+	};
+
+	/*
+	Byte bounded value cache, keyed by the key hash.
+	Uses a segmented LRU, new entries start out in a probation segment and are only promoted
+	into the protected segment once they are hit again. A single large scan can therefore
+	only flush the probation segment, never the frequently read values.
+	The key is stored alongside the value, so hash collisions are treated as misses.
+	*/
+	class KVValueCache {
+	public:
+		KVValueCache(std::size_t capacity);
+
+		// Returns the cached value, or nullptr on a miss.
+		// The pointer is valid until the cache is next modified.
+		const std::string* find(int64_t hash, std::string_view key);
+
+		// Insert or replace a value.
+		void insert(int64_t hash, std::string_view key, std::string_view value);
+		// Replace a value only if it is already cached.
+		void update(int64_t hash, std::string_view key, std::string_view value);
+		void erase(int64_t hash);
+		void clear();
+
+		void setCapacity(std::size_t capacity);
+		std::size_t capacity() const noexcept;
+
+		KVCacheStats stats() const noexcept;
+	private:
+		struct Entry {
+			int64_t hash;
+			std::string key, value;
+			bool protect;
+		};
+		using list_t = std::list<Entry>;
+
+		static std::size_t charge(const Entry& entry) noexcept;
+
+		void promote(list_t::iterator it);
+		void evict();
+
+		list_t probation, protect;
+		std::unordered_map<int64_t, list_t::iterator> index;
+
+		std::size_t maxBytes, protectBytes, totalBytes;
+		KVCacheStats counters;
+	};
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <array>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <ez/KVCodec.hpp>
+
+namespace ez {
+	/*
+	Applies the per value header of a store with codecs enabled.
+	Holds every codec that may be needed to read the store, and the one used to encode new values.
+	*/
+	class KVValueCodec {
+	public:
+		static constexpr uint8_t raw_id = 0;
+
+		KVValueCodec(std::size_t _threshold);
+
+		// Values smaller than this are always stored as is.
+		std::size_t threshold;
+		// Values smaller than this use the dictionary codec, when there is one.
+		std::size_t dictionaryLimit;
+
+		// Make a codec available for decoding.
+		void add(std::shared_ptr<const KVCodec> codec);
+		// Make a codec available, and use it to encode new values.
+		void use(std::shared_ptr<const KVCodec> codec);
+		// Set the shared dictionary, for small values.
+		void setDictionary(std::string_view dictionary);
+		const KVLZCodec* dictionary() const noexcept;
+
+		// Encode a value along with its header into buffer, and return a view of it.
+		std::string_view encode(std::string_view value, std::string& buffer) const;
+		// Decode a stored value. Raw values are returned as a view into the stored bytes, anything else is decoded into the buffer.
+		// Returns false if the value is malformed, or was encoded with a codec that isn't available.
+		bool decode(std::string_view stored, std::string_view& value, std::string& buffer) const;
+		// Return the header of a stored value.
+		static uint8_t header(std::string_view stored) noexcept;
+	private:
+		std::array<std::shared_ptr<const KVCodec>, 256> codecs;
+		std::shared_ptr<const KVCodec> encoder;
+		std::shared_ptr<const KVLZCodec> dict;
+	};
+}
@@ -0,0 +1,220 @@
+#include <ez/ConcurrentKVStore.hpp>
+
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace ez {
+	struct ConcurrentKVStore::Data {
+		std::vector<std::unique_ptr<KVStore>> readers;
+
+		std::mutex poolMutex;
+		std::condition_variable available;
+		std::vector<KVStore*> idle;
+
+		std::mutex writeMutex;
+		KVStore writer;
+		// Set once every connection is open, read without taking any of the locks.
+		std::atomic<bool> running{ false };
+
+		KVStore* acquire() {
+			std::unique_lock<std::mutex> lock(poolMutex);
+			available.wait(lock, [&] { return !idle.empty(); });
+
+			KVStore* store = idle.back();
+			idle.pop_back();
+			return store;
+		}
+		void release(KVStore* store) {
+			// Otherwise the connection would keep reading from the snapshot it last saw.
+			try {
+				store->finishReads();
+			}
+			catch (std::exception&) {
+				// The error was already reported by the call that caused it.
+			}
+			{
+				std::lock_guard<std::mutex> lock(poolMutex);
+				idle.push_back(store);
+			}
+			available.notify_one();
+		}
+	};
+
+	ConcurrentKVStore::Reader::Reader(Data* _pool, KVStore* _store)
+		: pool(_pool)
+		, store(_store)
+	{}
+	ConcurrentKVStore::Reader::~Reader() {
+		if (store) {
+			pool->release(store);
+		}
+	}
+	ConcurrentKVStore::Reader::Reader(Reader&& other) noexcept
+		: pool(other.pool)
+		, store(other.store)
+	{
+		other.pool = nullptr;
+		other.store = nullptr;
+	}
+	ConcurrentKVStore::Reader& ConcurrentKVStore::Reader::operator=(Reader&& other) noexcept {
+		std::swap(pool, other.pool);
+		std::swap(store, other.store);
+		return *this;
+	}
+
+
+	ConcurrentKVStore::ConcurrentKVStore()
+		: data(new Data())
+	{}
+	ConcurrentKVStore::~ConcurrentKVStore() {
+		if (data) {
+			close();
+		}
+	}
+	ConcurrentKVStore::ConcurrentKVStore(ConcurrentKVStore&&) noexcept = default;
+	ConcurrentKVStore& ConcurrentKVStore::operator=(ConcurrentKVStore&& other) noexcept {
+		if (this != &other) {
+			if (data) {
+				close();
+			}
+			data = std::move(other.data);
+		}
+		return *this;
+	}
+
+	bool ConcurrentKVStore::open(const std::filesystem::path& path, std::size_t readers, const KVOpenOptions& options) {
+		if (!data || isOpen()) {
+			return false;
+		}
+
+		if (readers == 0) {
+			readers = std::max(std::thread::hardware_concurrency(), 1u);
+		}
+
+		// The writer has to switch the file to WAL before any of the readers open it.
+		KVOpenOptions writeOptions = options;
+		writeOptions.journal = KVOpenOptions::Journal::WAL;
+		if (!data->writer.open(path, false, writeOptions)) {
+			return false;
+		}
+
+		for (std::size_t i = 0; i < readers; ++i) {
+			std::unique_ptr<KVStore> store{ new KVStore() };
+			if (!store->open(path, true, options)) {
+				data->readers.clear();
+				data->writer.close();
+				return false;
+			}
+			data->readers.push_back(std::move(store));
+		}
+
+		for (std::unique_ptr<KVStore>& store : data->readers) {
+			data->idle.push_back(store.get());
+		}
+		data->running = true;
+
+		return true;
+	}
+	void ConcurrentKVStore::close() {
+		// Only the first of several concurrent calls closes the connections.
+		if (!data || !data->running.exchange(false)) {
+			return;
+		}
+
+		// Wait for every reader to be returned.
+		{
+			std::unique_lock<std::mutex> lock(data->poolMutex);
+			data->available.wait(lock, [&] { return data->idle.size() == data->readers.size(); });
+			data->idle.clear();
+		}
+		data->readers.clear();
+
+		std::lock_guard<std::mutex> lock(data->writeMutex);
+		data->writer.close();
+	}
+	bool ConcurrentKVStore::isOpen() const noexcept {
+		return data && data->running;
+	}
+
+	std::size_t ConcurrentKVStore::numReaders() const noexcept {
+		return data ? data->readers.size() : 0;
+	}
+
+	ConcurrentKVStore::Reader ConcurrentKVStore::reader() const {
+		assert(isOpen());
+		return Reader(data.get(), data->acquire());
+	}
+
+	std::size_t ConcurrentKVStore::numValues() const {
+		if (!isOpen()) {
+			return 0;
+		}
+		return reader()->numValues();
+	}
+	bool ConcurrentKVStore::contains(std::string_view name) const {
+		if (!isOpen()) {
+			return false;
+		}
+		return reader()->contains(name);
+	}
+	bool ConcurrentKVStore::get(std::string_view name, std::string& value) const {
+		if (!isOpen()) {
+			return false;
+		}
+		return reader()->get(name, value);
+	}
+	std::size_t ConcurrentKVStore::getMany(const std::vector<std::string_view>& names, KVBatchResult& result) const {
+		if (!isOpen()) {
+			result.reset(names.size());
+			return 0;
+		}
+		return reader()->getMany(names, result);
+	}
+
+	bool ConcurrentKVStore::set(std::string_view name, std::string_view value) {
+		if (!data) {
+			return false;
+		}
+		std::lock_guard<std::mutex> lock(data->writeMutex);
+		return data->writer.set(name, value);
+	}
+	bool ConcurrentKVStore::setRaw(std::string_view name, const void* raw, std::size_t len) {
+		if (!data) {
+			return false;
+		}
+		std::lock_guard<std::mutex> lock(data->writeMutex);
+		return data->writer.setRaw(name, raw, len);
+	}
+	bool ConcurrentKVStore::erase(std::string_view name) {
+		if (!data) {
+			return false;
+		}
+		std::lock_guard<std::mutex> lock(data->writeMutex);
+		return data->writer.erase(name);
+	}
+	bool ConcurrentKVStore::rename(std::string_view old, std::string_view name) {
+		if (!data) {
+			return false;
+		}
+		std::lock_guard<std::mutex> lock(data->writeMutex);
+		return data->writer.rename(old, name);
+	}
+	void ConcurrentKVStore::clear() {
+		if (!data) {
+			return;
+		}
+		std::lock_guard<std::mutex> lock(data->writeMutex);
+		data->writer.clear();
+	}
+
+	void ConcurrentKVStore::write(const std::function<void(KVStore&)>& func) {
+		if (!data) {
+			return;
+		}
+		std::lock_guard<std::mutex> lock(data->writeMutex);
+		func(data->writer);
+	}
+}
@@ -0,0 +1,358 @@
+#include <ez/KVAsyncStore.hpp>
+#include <ez/KVStore.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ez {
+	namespace {
+		enum class ReadKind {
+			Get,
+			Scan
+		};
+
+		struct Read {
+			ReadKind kind;
+			// The name for gets, the token for scans.
+			std::string key;
+			std::size_t count;
+			KVAsyncStore::GetCallback get;
+			KVAsyncStore::ScanCallback scan;
+		};
+	}
+
+	struct KVAsyncStore::Data {
+		KVAsyncWriter writer;
+		KVAsyncStoreOptions options;
+
+		std::vector<std::unique_ptr<KVStore>> readers;
+		std::vector<std::thread> threads;
+
+		mutable std::mutex mutex;
+		std::condition_variable wake;
+		std::deque<Read> queue;
+		// Both only change under the mutex, running is set while the threads are accepting reads.
+		bool running = false;
+		bool stopping = false;
+
+		void run(KVStore& store);
+		void push(Read&& read);
+		void reject(Read& read);
+		void process(KVStore& store, KVCursor& cursor, std::vector<Read>& window);
+
+		template<typename Callback, typename Value>
+		void deliver(Callback& callback, Value&& value) {
+			if (!callback) {
+				return;
+			}
+			if (options.dispatch) {
+				options.dispatch([callback = std::move(callback), value = std::forward<Value>(value)]() mutable {
+					callback(std::move(value));
+				});
+			}
+			else {
+				callback(std::forward<Value>(value));
+			}
+		}
+	};
+
+	void KVAsyncStore::Data::push(Read&& read) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (running && !stopping) {
+				queue.push_back(std::move(read));
+				wake.notify_one();
+				return;
+			}
+		}
+
+		// The reader threads are gone or shutting down, and won't see anything pushed now.
+		reject(read);
+	}
+	void KVAsyncStore::Data::reject(Read& read) {
+		if (read.kind == ReadKind::Get) {
+			deliver(read.get, std::optional<std::string>());
+		}
+		else {
+			KVScanPage page;
+			page.done = true;
+			deliver(read.scan, std::move(page));
+		}
+	}
+
+	void KVAsyncStore::Data::run(KVStore& store) {
+		// Kept for the life of the thread, so scans never prepare their statement twice.
+		KVCursor cursor;
+		std::vector<Read> window;
+		window.reserve(options.maxPipeline);
+
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;) {
+			wake.wait(lock, [&] { return stopping || !queue.empty(); });
+			if (queue.empty()) {
+				// Only reachable when stopping with nothing left to do.
+				break;
+			}
+
+			std::size_t count = std::min(queue.size(), options.maxPipeline);
+			for (std::size_t i = 0; i < count; ++i) {
+				window.push_back(std::move(queue.front()));
+				queue.pop_front();
+			}
+
+			lock.unlock();
+			process(store, cursor, window);
+			window.clear();
+			lock.lock();
+		}
+	}
+
+	void KVAsyncStore::Data::process(KVStore& store, KVCursor& cursor, std::vector<Read>& window) {
+		// Every get in the window is answered by one batched lookup.
+		std::vector<std::string_view> names;
+		for (const Read& read : window) {
+			if (read.kind == ReadKind::Get) {
+				names.push_back(read.key);
+			}
+		}
+
+		KVBatchResult batch;
+		if (!names.empty()) {
+			try {
+				store.getMany(names, batch);
+			}
+			catch (std::exception& e) {
+				std::cerr << "ez::KVAsyncStore failed to read with error:\n";
+				std::cerr << e.what() << '\n';
+				batch.reset(names.size());
+			}
+		}
+
+		std::size_t next = 0;
+		for (Read& read : window) {
+			if (read.kind == ReadKind::Get) {
+				std::size_t i = next++;
+				std::optional<std::string> value;
+				if (batch.found(i)) {
+					value.emplace(batch.value(i));
+				}
+				deliver(read.get, std::move(value));
+				continue;
+			}
+
+			KVScanPage page;
+			try {
+				bool opened = read.key.empty() ? store.openCursor(cursor) : store.openCursor(cursor, read.key);
+				if (opened) {
+					std::vector<KVEntryView> entries;
+					cursor.next(entries, read.count);
+					page.entries.reserve(entries.size());
+					for (const KVEntryView& entry : entries) {
+						page.entries.push_back(KVEntry{ std::string(entry.key), std::string(entry.value) });
+					}
+					page.token = cursor.token();
+					page.done = cursor.atEnd();
+					cursor.pause();
+				}
+				else {
+					page.done = true;
+				}
+			}
+			catch (std::exception& e) {
+				std::cerr << "ez::KVAsyncStore failed to scan with error:\n";
+				std::cerr << e.what() << '\n';
+				page = KVScanPage{};
+				page.done = true;
+			}
+			deliver(read.scan, std::move(page));
+		}
+
+		// The next window has to see the writes committed in the meantime.
+		store.finishReads();
+	}
+
+
+	KVAsyncStore::KVAsyncStore()
+		: data(new Data())
+	{}
+	KVAsyncStore::~KVAsyncStore() {
+		if (data) {
+			close();
+		}
+	}
+	KVAsyncStore::KVAsyncStore(KVAsyncStore&&) noexcept = default;
+	KVAsyncStore& KVAsyncStore::operator=(KVAsyncStore&& other) noexcept {
+		if (this != &other) {
+			// The threads have to be stopped before the data they use goes away.
+			if (data) {
+				close();
+			}
+			data = std::move(other.data);
+		}
+		return *this;
+	}
+
+	bool KVAsyncStore::open(const std::filesystem::path& path, const KVAsyncStoreOptions& options) {
+		if (!data || isOpen()) {
+			return false;
+		}
+
+		data->options = options;
+		data->options.readers = std::max<std::size_t>(options.readers, 1);
+		data->options.maxPipeline = std::max<std::size_t>(options.maxPipeline, 1);
+
+		// The writer has to switch the file to WAL before any of the readers open it.
+		KVAsyncOptions writeOptions = options.writer;
+		writeOptions.store.journal = KVOpenOptions::Journal::WAL;
+		if (!data->writer.open(path, writeOptions)) {
+			return false;
+		}
+
+		for (std::size_t i = 0; i < data->options.readers; ++i) {
+			std::unique_ptr<KVStore> store{ new KVStore() };
+			if (!store->open(path, true, options.writer.store)) {
+				data->readers.clear();
+				data->writer.close();
+				return false;
+			}
+			data->readers.push_back(std::move(store));
+		}
+
+		Data* self = data.get();
+		std::lock_guard<std::mutex> lock(data->mutex);
+		data->stopping = false;
+		data->running = true;
+		for (std::unique_ptr<KVStore>& store : data->readers) {
+			KVStore* reader = store.get();
+			data->threads.emplace_back([self, reader] { self->run(*reader); });
+		}
+
+		return true;
+	}
+	void KVAsyncStore::close() {
+		if (!data) {
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(data->mutex);
+			// Only the first of several concurrent calls stops the threads.
+			if (!data->running || data->stopping) {
+				return;
+			}
+			data->stopping = true;
+		}
+		data->wake.notify_all();
+		for (std::thread& thread : data->threads) {
+			thread.join();
+		}
+		data->threads.clear();
+		data->readers.clear();
+
+		data->writer.close();
+
+		std::lock_guard<std::mutex> lock(data->mutex);
+		data->running = false;
+	}
+	bool KVAsyncStore::isOpen() const noexcept {
+		if (!data) {
+			return false;
+		}
+		std::lock_guard<std::mutex> lock(data->mutex);
+		return data->running;
+	}
+
+	KVAsync<std::optional<std::string>> KVAsyncStore::getAsync(std::string_view name) {
+		auto [result, complete] = KVAsync<std::optional<std::string>>::make();
+		getAsync(name, std::move(complete));
+		return std::move(result);
+	}
+	void KVAsyncStore::getAsync(std::string_view name, GetCallback callback) {
+		if (!data) {
+			if (callback) {
+				callback(std::nullopt);
+			}
+			return;
+		}
+		data->push(Read{ ReadKind::Get, std::string(name), 1, std::move(callback), nullptr });
+	}
+
+	KVAsync<bool> KVAsyncStore::setAsync(std::string_view name, std::string_view value) {
+		auto [result, complete] = KVAsync<bool>::make();
+		setAsync(name, value, std::move(complete));
+		return std::move(result);
+	}
+	void KVAsyncStore::setAsync(std::string_view name, std::string_view value, WriteCallback callback) {
+		if (!data) {
+			if (callback) {
+				callback(false);
+			}
+			return;
+		}
+		Data* self = data.get();
+		data->writer.set(name, value, [self, callback = std::move(callback)](bool result) mutable {
+			self->deliver(callback, result);
+		});
+	}
+
+	KVAsync<bool> KVAsyncStore::eraseAsync(std::string_view name) {
+		auto [result, complete] = KVAsync<bool>::make();
+		eraseAsync(name, std::move(complete));
+		return std::move(result);
+	}
+	void KVAsyncStore::eraseAsync(std::string_view name, WriteCallback callback) {
+		if (!data) {
+			if (callback) {
+				callback(false);
+			}
+			return;
+		}
+		Data* self = data.get();
+		data->writer.erase(name, [self, callback = std::move(callback)](bool result) mutable {
+			self->deliver(callback, result);
+		});
+	}
+
+	KVAsync<KVScanPage> KVAsyncStore::scanAsync(std::string_view token, std::size_t count) {
+		auto [result, complete] = KVAsync<KVScanPage>::make();
+		scanAsync(token, count, std::move(complete));
+		return std::move(result);
+	}
+	void KVAsyncStore::scanAsync(std::string_view token, std::size_t count, ScanCallback callback) {
+		if (!data) {
+			if (callback) {
+				KVScanPage page;
+				page.done = true;
+				callback(std::move(page));
+			}
+			return;
+		}
+		data->push(Read{ ReadKind::Scan, std::string(token), count, nullptr, std::move(callback) });
+	}
+
+	KVAsync<bool> KVAsyncStore::flushAsync() {
+		auto [result, complete] = KVAsync<bool>::make();
+		if (!data) {
+			complete(false);
+			return std::move(result);
+		}
+		Data* self = data.get();
+		data->writer.flush([self, complete = std::move(complete)](bool result) mutable {
+			self->deliver(complete, result);
+		});
+		return std::move(result);
+	}
+
+	std::size_t KVAsyncStore::pendingReads() const {
+		if (!data) {
+			return 0;
+		}
+		std::lock_guard<std::mutex> lock(data->mutex);
+		return data->queue.size();
+	}
+}
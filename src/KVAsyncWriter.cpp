@@ -0,0 +1,295 @@
+#include <ez/KVAsyncWriter.hpp>
+#include <ez/KVStore.hpp>
+
+#include <cassert>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ez {
+	namespace {
+		enum class OpKind {
+			Set,
+			Erase,
+			Flush
+		};
+
+		struct Op {
+			OpKind kind;
+			std::string key, value;
+			KVAsyncWriter::Callback done;
+		};
+
+		// Wrap a promise in a callback, so both flavors of the api go through the same queue.
+		KVAsyncWriter::Callback makePromise(std::future<bool>& future) {
+			auto promise = std::make_shared<std::promise<bool>>();
+			future = promise->get_future();
+			return [promise](bool result) {
+				promise->set_value(result);
+			};
+		}
+	}
+
+	struct KVAsyncWriter::Data {
+		KVStore store;
+		KVAsyncOptions options;
+
+		mutable std::mutex mutex;
+		std::condition_variable wake;
+		std::deque<Op> queue;
+		// Both only change under the mutex, running is set while the thread is accepting writes.
+		bool running = false;
+		bool stopping = false;
+		std::size_t commits = 0;
+
+		std::thread thread;
+
+		void run();
+		void push(Op&& op);
+		void apply(std::vector<Op>& window);
+	};
+
+	void KVAsyncWriter::Data::push(Op&& op) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (running && !stopping) {
+				queue.push_back(std::move(op));
+				op.done = nullptr;
+			}
+		}
+
+		// The writer thread is shutting down, and won't see anything pushed now.
+		if (op.done) {
+			op.done(false);
+			return;
+		}
+		wake.notify_one();
+	}
+
+	void KVAsyncWriter::Data::run() {
+		using clock_t = std::chrono::steady_clock;
+
+		std::vector<Op> window;
+		window.reserve(options.maxBatch);
+
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;) {
+			wake.wait(lock, [&] { return stopping || !queue.empty(); });
+			if (queue.empty()) {
+				// Only reachable when stopping with nothing left to do.
+				break;
+			}
+
+			// Hold the window open until it fills up, or the first write has waited long enough.
+			clock_t::time_point deadline = clock_t::now() + options.maxDelay;
+			wake.wait_until(lock, deadline, [&] {
+				return stopping || queue.size() >= options.maxBatch || queue.back().kind == OpKind::Flush;
+			});
+
+			std::size_t count = std::min(queue.size(), options.maxBatch);
+			for (std::size_t i = 0; i < count; ++i) {
+				window.push_back(std::move(queue.front()));
+				queue.pop_front();
+			}
+
+			lock.unlock();
+			apply(window);
+			window.clear();
+			lock.lock();
+		}
+	}
+
+	void KVAsyncWriter::Data::apply(std::vector<Op>& window) {
+		std::vector<bool> results(window.size(), false);
+
+		bool committed = false;
+		try {
+			store.beginBatch();
+			for (std::size_t i = 0; i < window.size(); ++i) {
+				Op& op = window[i];
+				try {
+					switch (op.kind) {
+					case OpKind::Set:
+						results[i] = store.set(op.key, op.value);
+						break;
+					case OpKind::Erase:
+						results[i] = store.erase(op.key);
+						break;
+					case OpKind::Flush:
+						results[i] = true;
+						break;
+					}
+				}
+				catch (std::exception& e) {
+					std::cerr << "ez::KVAsyncWriter failed to apply a write with error:\n";
+					std::cerr << e.what() << '\n';
+				}
+			}
+			store.commitBatch();
+			committed = true;
+		}
+		catch (std::exception& e) {
+			std::cerr << "ez::KVAsyncWriter failed to commit with error:\n";
+			std::cerr << e.what() << '\n';
+			store.cancelBatch();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (committed) {
+				++commits;
+			}
+		}
+
+		// Nothing is reported until the whole window is durable, or known to have failed.
+		for (std::size_t i = 0; i < window.size(); ++i) {
+			if (!window[i].done) {
+				continue;
+			}
+			// Escaping the thread would terminate the process.
+			try {
+				window[i].done(committed && results[i]);
+			}
+			catch (std::exception& e) {
+				std::cerr << "ez::KVAsyncWriter completion callback failed with error:\n";
+				std::cerr << e.what() << '\n';
+			}
+			catch (...) {
+				std::cerr << "ez::KVAsyncWriter completion callback failed with an unknown error\n";
+			}
+		}
+	}
+
+
+	KVAsyncWriter::KVAsyncWriter()
+		: data(new Data())
+	{}
+	KVAsyncWriter::~KVAsyncWriter() {
+		if (data) {
+			close();
+		}
+	}
+	KVAsyncWriter::KVAsyncWriter(KVAsyncWriter&&) noexcept = default;
+	KVAsyncWriter& KVAsyncWriter::operator=(KVAsyncWriter&& other) noexcept {
+		if (this != &other) {
+			// Destroying a joinable thread terminates, so the old one has to be stopped first.
+			if (data) {
+				close();
+			}
+			data = std::move(other.data);
+		}
+		return *this;
+	}
+
+	bool KVAsyncWriter::open(const std::filesystem::path& path, const KVAsyncOptions& options) {
+		if (isOpen()) {
+			return false;
+		}
+		if (!data->store.open(path, false, options.store)) {
+			return false;
+		}
+
+		data->options = options;
+		if (data->options.maxBatch == 0) {
+			data->options.maxBatch = 1;
+		}
+		Data* self = data.get();
+		std::lock_guard<std::mutex> lock(data->mutex);
+		data->stopping = false;
+		data->running = true;
+		data->thread = std::thread([self] { self->run(); });
+
+		return true;
+	}
+	void KVAsyncWriter::close() {
+		if (!data) {
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(data->mutex);
+			// Only the first of several concurrent calls stops the thread.
+			if (!data->running || data->stopping) {
+				return;
+			}
+			data->stopping = true;
+		}
+		data->wake.notify_one();
+		data->thread.join();
+
+		data->store.close();
+
+		std::lock_guard<std::mutex> lock(data->mutex);
+		data->running = false;
+	}
+	bool KVAsyncWriter::isOpen() const noexcept {
+		if (!data) {
+			return false;
+		}
+		std::lock_guard<std::mutex> lock(data->mutex);
+		return data->running;
+	}
+
+	std::future<bool> KVAsyncWriter::set(std::string_view name, std::string_view value) {
+		std::future<bool> future;
+		set(name, value, makePromise(future));
+		return future;
+	}
+	void KVAsyncWriter::set(std::string_view name, std::string_view value, Callback callback) {
+		if (!isOpen()) {
+			if (callback) {
+				callback(false);
+			}
+			return;
+		}
+		data->push(Op{ OpKind::Set, std::string(name), std::string(value), std::move(callback) });
+	}
+
+	std::future<bool> KVAsyncWriter::erase(std::string_view name) {
+		std::future<bool> future;
+		erase(name, makePromise(future));
+		return future;
+	}
+	void KVAsyncWriter::erase(std::string_view name, Callback callback) {
+		if (!isOpen()) {
+			if (callback) {
+				callback(false);
+			}
+			return;
+		}
+		data->push(Op{ OpKind::Erase, std::string(name), std::string(), std::move(callback) });
+	}
+
+	std::future<bool> KVAsyncWriter::flush() {
+		std::future<bool> future;
+		flush(makePromise(future));
+		return future;
+	}
+	void KVAsyncWriter::flush(Callback callback) {
+		if (!isOpen()) {
+			if (callback) {
+				callback(false);
+			}
+			return;
+		}
+		data->push(Op{ OpKind::Flush, std::string(), std::string(), std::move(callback) });
+	}
+
+	std::size_t KVAsyncWriter::pending() const {
+		if (!data) {
+			return 0;
+		}
+		std::lock_guard<std::mutex> lock(data->mutex);
+		return data->queue.size();
+	}
+	std::size_t KVAsyncWriter::numCommits() const {
+		if (!data) {
+			return 0;
+		}
+		std::lock_guard<std::mutex> lock(data->mutex);
+		return data->commits;
+	}
+}
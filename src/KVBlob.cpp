@@ -0,0 +1,148 @@
+#include <ez/KVBlob.hpp>
+#include <ez/KVStore.hpp>
+
+#include <climits>
+#include <sqlite3.h>
+
+namespace ez {
+	KVBlob::KVBlob()
+		: handle(nullptr)
+		, offset(0)
+		, length(0)
+		, writable(false)
+	{}
+	KVBlob::~KVBlob() {
+		close();
+	}
+
+	KVBlob::KVBlob(KVBlob&& other) noexcept
+		: handle(other.handle)
+		, offset(other.offset)
+		, length(other.length)
+		, writable(other.writable)
+	{
+		other.handle = nullptr;
+		other.offset = 0;
+		other.length = 0;
+		other.writable = false;
+	}
+	KVBlob& KVBlob::operator=(KVBlob&& other) noexcept {
+		std::swap(handle, other.handle);
+		std::swap(offset, other.offset);
+		std::swap(length, other.length);
+		std::swap(writable, other.writable);
+		return *this;
+	}
+
+	bool KVBlob::isOpen() const noexcept {
+		return handle != nullptr;
+	}
+	bool KVBlob::isWritable() const noexcept {
+		return writable;
+	}
+	std::size_t KVBlob::size() const noexcept {
+		return length;
+	}
+
+	bool KVBlob::readAt(std::size_t offset, void* dest, std::size_t len) const {
+		if (!handle || offset > length || len > length - offset) {
+			return false;
+		}
+		return sqlite3_blob_read(handle, dest, static_cast<int>(len), static_cast<int>(this->offset + offset)) == SQLITE_OK;
+	}
+	bool KVBlob::writeAt(std::size_t offset, const void* src, std::size_t len) {
+		if (!handle || !writable || offset > length || len > length - offset) {
+			return false;
+		}
+		return sqlite3_blob_write(handle, src, static_cast<int>(len), static_cast<int>(this->offset + offset)) == SQLITE_OK;
+	}
+
+	void KVBlob::close() {
+		if (handle) {
+			sqlite3_blob_close(handle);
+			handle = nullptr;
+			offset = 0;
+			length = 0;
+			writable = false;
+		}
+	}
+
+
+	bool KVStore::openBlob(std::string_view name, KVBlob& blob, bool writable) {
+		blob.close();
+		if (!data->db) {
+			return false;
+		}
+
+		int64_t hv = hashKey(name);
+		if (writable && data->cache) {
+			data->cache->erase(hv);
+		}
+
+		// The slot is the rowid of the table, so the value can be opened directly.
+		int64_t slot;
+		if (!findSlot(data->main, name, hv, slot)) {
+			return false;
+		}
+		sqlite3_blob* handle = nullptr;
+		int res = sqlite3_blob_open(
+			data->db->getHandle(),
+			"main", "main", "value",
+			slot,
+			writable ? 1 : 0,
+			&handle
+		);
+		if (res != SQLITE_OK) {
+			// Even on failure, sqlite may allocate a handle.
+			sqlite3_blob_close(handle);
+			return false;
+		}
+
+		std::size_t bytes = static_cast<std::size_t>(sqlite3_blob_bytes(handle));
+		std::size_t header = 0;
+		if (data->codec) {
+			// Encoded values can't be accessed piecewise.
+			uint8_t id = KVValueCodec::raw_id + 1;
+			if (bytes == 0 || sqlite3_blob_read(handle, &id, 1, 0) != SQLITE_OK || id != KVValueCodec::raw_id) {
+				sqlite3_blob_close(handle);
+				return false;
+			}
+			header = 1;
+		}
+
+		blob.handle = handle;
+		blob.offset = header;
+		blob.length = bytes - header;
+		blob.writable = writable;
+		return true;
+	}
+
+	bool KVStore::reserve(std::string_view name, std::size_t len) {
+		std::size_t header = data->codec ? 1 : 0;
+		if (!data->db || len > static_cast<std::size_t>(INT_MAX) - header) {
+			return false;
+		}
+
+		// With codecs enabled the zeroed header byte marks the value as raw.
+		SQLite::Statement stmt(
+			data->db.value(),
+			"INSERT INTO \"main\" (\"hash\", \"key\", \"value\") "
+			"VALUES (?, ?, zeroblob(?)) ON CONFLICT(\"hash\") "
+			"DO UPDATE SET \"value\"=excluded.\"value\" WHERE \"key\"=excluded.\"key\";"
+		);
+
+		int64_t hv = hashKey(name);
+		stmt.bind(2, name.data(), name.length());
+		stmt.bind(3, static_cast<int64_t>(len + header));
+		bool inserted = storeSlot(data->main, stmt, name, hv);
+
+		if (data->cache) {
+			data->cache->erase(hv);
+		}
+		if (inserted) {
+			filterInsert(data->main, hv);
+		}
+
+		return true;
+	}
+}
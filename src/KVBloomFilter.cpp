@@ -0,0 +1,80 @@
+#include <ez/intern/KVBloomFilter.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace ez {
+	namespace {
+		// Final mix from splitmix64, the key hashes are already well distributed but the
+		// block selection and bit positions need to be independent of each other.
+		uint64_t remix(uint64_t x) noexcept {
+			x ^= x >> 30;
+			x *= 0xbf58476d1ce4e5b9ull;
+			x ^= x >> 27;
+			x *= 0x94d049bb133111ebull;
+			x ^= x >> 31;
+			return x;
+		}
+	}
+
+	KVBloomFilter::KVBloomFilter(std::size_t capacity, double rate)
+		: maxEntries(std::max(capacity, std::size_t(64)))
+		, numEntries(0)
+		, targetRate(std::clamp(rate, 1e-6, 0.5))
+	{
+		constexpr double ln2 = 0.69314718055994530942;
+
+		// Standard sizing, with a little extra to make up for the blocking.
+		double bits = -double(maxEntries) * std::log(targetRate) / (ln2 * ln2) * 1.1;
+		numBlocks = std::max(std::size_t(1), static_cast<std::size_t>(std::ceil(bits / 512.0)));
+		numHashes = std::clamp(static_cast<std::size_t>(std::round(-std::log2(targetRate))), std::size_t(1), std::size_t(16));
+
+		words.assign(numBlocks * block_words, 0);
+	}
+
+	void KVBloomFilter::insert(int64_t hash) noexcept {
+		uint64_t h = remix(static_cast<uint64_t>(hash));
+		uint64_t* block = words.data() + (h % numBlocks) * block_words;
+
+		// Double hashing within the block.
+		uint32_t a = static_cast<uint32_t>(h >> 32);
+		uint32_t b = static_cast<uint32_t>(h) | 1;
+		for (std::size_t i = 0; i < numHashes; ++i) {
+			uint32_t bit = (a + static_cast<uint32_t>(i) * b) & 511;
+			block[bit >> 6] |= uint64_t(1) << (bit & 63);
+		}
+
+		++numEntries;
+	}
+	bool KVBloomFilter::mayContain(int64_t hash) const noexcept {
+		uint64_t h = remix(static_cast<uint64_t>(hash));
+		const uint64_t* block = words.data() + (h % numBlocks) * block_words;
+
+		uint32_t a = static_cast<uint32_t>(h >> 32);
+		uint32_t b = static_cast<uint32_t>(h) | 1;
+		for (std::size_t i = 0; i < numHashes; ++i) {
+			uint32_t bit = (a + static_cast<uint32_t>(i) * b) & 511;
+			if ((block[bit >> 6] & (uint64_t(1) << (bit & 63))) == 0) {
+				return false;
+			}
+		}
+		return true;
+	}
+	void KVBloomFilter::clear() noexcept {
+		std::fill(words.begin(), words.end(), 0);
+		numEntries = 0;
+	}
+
+	std::size_t KVBloomFilter::capacity() const noexcept {
+		return maxEntries;
+	}
+	std::size_t KVBloomFilter::size() const noexcept {
+		return numEntries;
+	}
+	std::size_t KVBloomFilter::numBits() const noexcept {
+		return words.size() * 64;
+	}
+	double KVBloomFilter::rate() const noexcept {
+		return targetRate;
+	}
+}
@@ -0,0 +1,286 @@
+#include <ez/KVCodec.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+namespace ez {
+	/*
+	Block format:
+	varint decoded size, followed by a sequence of
+		token: high nibble literal count, low nibble match length - min_match (15 means more bytes follow)
+		extra literal count bytes, 255 means another byte follows
+		literals
+		2 byte little endian match offset, counted back from the current position (possibly into the dictionary)
+		extra match length bytes
+	The final sequence ends after its literals, with no match.
+	*/
+	namespace {
+		constexpr std::size_t min_match = 4;
+		// The last bytes are always emitted as literals, so the match finder never reads past the end.
+		constexpr std::size_t end_literals = 5;
+		constexpr std::size_t max_offset = 65535;
+		// A length byte of 255 is the most any single input byte can add to the output.
+		constexpr std::size_t max_expansion = 255;
+		constexpr int hash_bits = 12;
+		constexpr std::size_t hash_size = std::size_t(1) << hash_bits;
+
+		uint32_t read32(const char* p) noexcept {
+			uint32_t v;
+			std::memcpy(&v, p, sizeof(v));
+			return v;
+		}
+		std::size_t hash4(uint32_t v) noexcept {
+			return (v * 2654435761u) >> (32 - hash_bits);
+		}
+
+		void writeVarint(std::string& dst, std::size_t value) {
+			while (value >= 0x80) {
+				dst.push_back(char((value & 0x7F) | 0x80));
+				value >>= 7;
+			}
+			dst.push_back(char(value));
+		}
+		bool readVarint(const char*& ip, const char* end, std::size_t& value) {
+			value = 0;
+			for (int shift = 0; shift < 64 && ip < end; shift += 7) {
+				uint8_t byte = uint8_t(*ip++);
+				value |= std::size_t(byte & 0x7F) << shift;
+				if ((byte & 0x80) == 0) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		void writeLength(std::string& dst, std::size_t length) {
+			while (length >= 255) {
+				dst.push_back(char(255));
+				length -= 255;
+			}
+			dst.push_back(char(length));
+		}
+		bool readLength(const char*& ip, const char* end, std::size_t& length) {
+			for (;;) {
+				if (ip >= end) {
+					return false;
+				}
+				uint8_t byte = uint8_t(*ip++);
+				length += byte;
+				if (byte != 255) {
+					return true;
+				}
+			}
+		}
+
+		void emit(std::string& dst, const char* literals, std::size_t numLiterals, std::size_t offset, std::size_t matchLength) {
+			std::size_t extra = matchLength - min_match;
+			uint8_t token = uint8_t(std::min<std::size_t>(numLiterals, 15) << 4);
+			if (matchLength != 0) {
+				token |= uint8_t(std::min<std::size_t>(extra, 15));
+			}
+			dst.push_back(char(token));
+
+			if (numLiterals >= 15) {
+				writeLength(dst, numLiterals - 15);
+			}
+			dst.append(literals, numLiterals);
+
+			if (matchLength != 0) {
+				dst.push_back(char(offset & 0xFF));
+				dst.push_back(char(offset >> 8));
+				if (extra >= 15) {
+					writeLength(dst, extra - 15);
+				}
+			}
+		}
+	}
+
+	KVLZCodec::KVLZCodec()
+	{}
+	KVLZCodec::KVLZCodec(std::string_view dictionary)
+	{
+		if (dictionary.size() > max_dictionary) {
+			dictionary = dictionary.substr(dictionary.size() - max_dictionary);
+		}
+		dict.assign(dictionary.data(), dictionary.size());
+
+		primed.assign(hash_size, -1);
+		for (std::size_t i = 0; i + min_match <= dict.size(); ++i) {
+			primed[hash4(read32(dict.data() + i))] = int32_t(i);
+		}
+	}
+
+	uint8_t KVLZCodec::id() const noexcept {
+		return dict.empty() ? plain_id : dictionary_id;
+	}
+	const std::string& KVLZCodec::dictionary() const noexcept {
+		return dict;
+	}
+
+	bool KVLZCodec::encode(std::string_view src, std::string& dst) const {
+		const std::size_t start = dst.size();
+		const std::size_t n = src.size();
+		const std::size_t dictSize = dict.size();
+		const char* in = src.data();
+
+		// Positions are in the combined space of dictionary followed by input.
+		// Kept per thread, so encoding doesn't allocate a fresh table every time.
+		thread_local std::vector<int32_t> table;
+		if (primed.empty()) {
+			table.assign(hash_size, -1);
+		}
+		else {
+			table.assign(primed.begin(), primed.end());
+		}
+		auto at = [&](std::size_t pos) -> char {
+			return pos < dictSize ? dict[pos] : in[pos - dictSize];
+		};
+
+		writeVarint(dst, n);
+
+		std::size_t anchor = 0, i = 0;
+		while (n >= end_literals + min_match && i + min_match <= n - end_literals) {
+			uint32_t seq = read32(in + i);
+			std::size_t h = hash4(seq);
+			int32_t candidate = table[h];
+			std::size_t pos = dictSize + i;
+			table[h] = int32_t(pos);
+
+			if (candidate >= 0 && pos - std::size_t(candidate) <= max_offset) {
+				std::size_t cand = std::size_t(candidate);
+
+				std::size_t length = 0;
+				std::size_t limit = n - end_literals - i;
+				while (length < limit && at(cand + length) == in[i + length]) {
+					++length;
+				}
+
+				if (length >= min_match) {
+					emit(dst, in + anchor, i - anchor, pos - cand, length);
+					i += length;
+					anchor = i;
+
+					// Bail out early on incompressible data.
+					if (dst.size() - start >= n) {
+						dst.resize(start);
+						return false;
+					}
+					continue;
+				}
+			}
+			++i;
+		}
+
+		emit(dst, in + anchor, n - anchor, 0, 0);
+
+		if (dst.size() - start >= n) {
+			dst.resize(start);
+			return false;
+		}
+		return true;
+	}
+
+	bool KVLZCodec::decode(std::string_view src, std::string& dst) const {
+		const char* ip = src.data();
+		const char* end = ip + src.size();
+
+		std::size_t size;
+		if (!readVarint(ip, end, size)) {
+			return false;
+		}
+		// The size comes from the stored bytes, which may be corrupt.
+		if (size / max_expansion > std::size_t(end - ip)) {
+			return false;
+		}
+
+		const std::size_t start = dst.size();
+		const std::size_t dictSize = dict.size();
+		dst.resize(start + size);
+		char* out = dst.data() + start;
+		std::size_t op = 0;
+
+		while (ip < end) {
+			uint8_t token = uint8_t(*ip++);
+
+			std::size_t numLiterals = token >> 4;
+			if (numLiterals == 15 && !readLength(ip, end, numLiterals)) {
+				break;
+			}
+			if (numLiterals > std::size_t(end - ip) || numLiterals > size - op) {
+				break;
+			}
+			std::memcpy(out + op, ip, numLiterals);
+			ip += numLiterals;
+			op += numLiterals;
+
+			if (ip == end) {
+				// The last sequence has no match.
+				if (op == size) {
+					return true;
+				}
+				break;
+			}
+
+			if (end - ip < 2) {
+				break;
+			}
+			std::size_t offset = uint8_t(ip[0]) | (std::size_t(uint8_t(ip[1])) << 8);
+			ip += 2;
+
+			std::size_t length = token & 0x0F;
+			if (length == 15 && !readLength(ip, end, length)) {
+				break;
+			}
+			length += min_match;
+
+			if (offset == 0 || offset > op + dictSize || length > size - op) {
+				break;
+			}
+
+			// Byte by byte, since matches may overlap the bytes they produce, or start in the dictionary.
+			for (std::size_t k = 0; k < length; ++k, ++op) {
+				std::size_t back = offset;
+				out[op] = back > op ? dict[dictSize - (back - op)] : out[op - back];
+			}
+		}
+
+		dst.resize(start);
+		return false;
+	}
+
+	std::string KVLZCodec::train(const std::vector<std::string_view>& samples, std::size_t size) {
+		constexpr std::size_t segment = 16;
+		constexpr std::size_t stride = 4;
+
+		size = std::min(size, max_dictionary);
+
+		// Count how often each segment appears, at a coarse stride.
+		std::unordered_map<std::string_view, std::size_t> counts;
+		for (std::string_view sample : samples) {
+			for (std::size_t i = 0; i + segment <= sample.size(); i += stride) {
+				++counts[sample.substr(i, segment)];
+			}
+		}
+
+		std::vector<std::pair<std::string_view, std::size_t>> ranked;
+		for (const auto& entry : counts) {
+			if (entry.second > 1) {
+				ranked.push_back(entry);
+			}
+		}
+		std::sort(ranked.begin(), ranked.end(), [](const auto& lh, const auto& rh) {
+			return lh.second > rh.second || (lh.second == rh.second && lh.first < rh.first);
+		});
+
+		std::size_t count = std::min(ranked.size(), size / segment);
+
+		// The most common segments go last, closest to the data so their offsets stay small.
+		std::string result;
+		result.reserve(count * segment);
+		for (std::size_t i = count; i > 0; --i) {
+			result.append(ranked[i - 1].first.data(), ranked[i - 1].first.size());
+		}
+		return result;
+	}
+}
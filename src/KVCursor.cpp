@@ -0,0 +1,185 @@
+#include <ez/KVCursor.hpp>
+#include <ez/KVStore.hpp>
+
+#include <charconv>
+#include <limits>
+#include <stdexcept>
+#include <fmt/core.h>
+
+namespace ez {
+	static constexpr std::string_view token_prefix = "ezkv1:";
+	static constexpr std::string_view token_end = "end";
+
+	KVCursor::KVCursor()
+		: data(new Data())
+	{}
+
+	bool KVCursor::isOpen() const noexcept {
+		return data && data->stmt.has_value();
+	}
+	void KVCursor::close() {
+		data->stmt.reset();
+		data->handle = nullptr;
+		data->codec.reset();
+		data->active = false;
+		data->done = true;
+	}
+
+	void KVCursor::seek(int64_t hash) {
+		if (data->stmt && data->active) {
+			data->stmt->reset();
+		}
+		data->from = hash;
+		data->active = false;
+		data->done = !isOpen();
+	}
+	void KVCursor::rewind() {
+		seek(std::numeric_limits<int64_t>::min());
+	}
+
+	std::size_t KVCursor::next(KVEntryView* entries, std::size_t count) {
+		if (data->done || count == 0) {
+			return 0;
+		}
+
+		SQLite::Statement& stmt = data->stmt.value();
+		if (!data->active) {
+			stmt.reset();
+			stmt.bind(1, data->from);
+			data->active = true;
+		}
+
+		// Sqlite only keeps a row around until the next step, so the whole page is copied out first.
+		std::string& arena = data->arena;
+		std::vector<std::size_t>& lengths = data->lengths;
+		arena.clear();
+		lengths.clear();
+
+		std::size_t filled = 0;
+		while (filled < count) {
+			if (!stmt.executeStep()) {
+				stmt.reset();
+				data->active = false;
+				data->done = true;
+				break;
+			}
+
+			int64_t hash = stmt.getColumn(0).getInt64();
+			SQLite::Column key = stmt.getColumn(1);
+			SQLite::Column col = stmt.getColumn(2);
+			std::string_view value((const char*)col.getBlob(), col.getBytes());
+			if (data->codec && !data->codec->decode(value, value, data->buffer)) {
+				throw std::logic_error("ez::KVCursor failed to decode a value!");
+			}
+
+			arena.append((const char*)key.getBlob(), key.getBytes());
+			arena.append(value.data(), value.size());
+			lengths.push_back(static_cast<std::size_t>(key.getBytes()));
+			lengths.push_back(value.size());
+			++filled;
+
+			if (hash == std::numeric_limits<int64_t>::max()) {
+				stmt.reset();
+				data->active = false;
+				data->done = true;
+				break;
+			}
+			data->from = hash + 1;
+		}
+
+		const char* ptr = arena.data();
+		for (std::size_t i = 0; i < filled; ++i) {
+			entries[i].key = std::string_view(ptr, lengths[i * 2]);
+			ptr += lengths[i * 2];
+			entries[i].value = std::string_view(ptr, lengths[i * 2 + 1]);
+			ptr += lengths[i * 2 + 1];
+		}
+		return filled;
+	}
+	std::size_t KVCursor::next(std::vector<KVEntryView>& entries, std::size_t count) {
+		entries.resize(count);
+		entries.resize(next(entries.data(), count));
+		return entries.size();
+	}
+	bool KVCursor::next(KVEntryView& entry) {
+		return next(&entry, 1) == 1;
+	}
+
+	bool KVCursor::atEnd() const noexcept {
+		return data->done;
+	}
+	int64_t KVCursor::position() const noexcept {
+		return data->from;
+	}
+
+	void KVCursor::pause() {
+		if (data->stmt && data->active) {
+			data->stmt->reset();
+			data->active = false;
+		}
+	}
+
+	std::string KVCursor::token() const {
+		std::string result(token_prefix);
+		if (data->done) {
+			result += token_end;
+		}
+		else {
+			result += fmt::format("{:016x}", static_cast<uint64_t>(data->from));
+		}
+		return result;
+	}
+	bool KVCursor::resume(std::string_view token) {
+		if (token.substr(0, token_prefix.size()) != token_prefix) {
+			return false;
+		}
+		token.remove_prefix(token_prefix.size());
+
+		if (token == token_end) {
+			pause();
+			data->done = true;
+			return true;
+		}
+
+		uint64_t hash = 0;
+		const char* last = token.data() + token.size();
+		std::from_chars_result res = std::from_chars(token.data(), last, hash, 16);
+		if (token.size() != 16 || res.ec != std::errc() || res.ptr != last) {
+			return false;
+		}
+		seek(static_cast<int64_t>(hash));
+		return true;
+	}
+
+
+	bool KVStore::openCursor(KVCursor& cursor) const {
+		if (!isOpen()) {
+			return false;
+		}
+
+		KVCursor::Data& state = *cursor.data;
+		// A cursor that was already opened on this connection keeps its prepared statement.
+		if (!state.stmt || state.handle != data->db->getHandle()) {
+			state.stmt.reset();
+			state.stmt.emplace(
+				data->db.value(),
+				"SELECT \"hash\", \"key\", \"value\" FROM \"main\" WHERE \"hash\" >= ? ORDER BY \"hash\";"
+			);
+			state.handle = data->db->getHandle();
+		}
+		state.codec = data->codec;
+
+		cursor.rewind();
+		return true;
+	}
+	bool KVStore::openCursor(KVCursor& cursor, std::string_view token) const {
+		if (!openCursor(cursor)) {
+			return false;
+		}
+		if (!cursor.resume(token)) {
+			cursor.close();
+			return false;
+		}
+		return true;
+	}
+}
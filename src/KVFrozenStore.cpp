@@ -0,0 +1,508 @@
+#include <ez/KVFrozenStore.hpp>
+#include <ez/KVStore.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "hashing.hpp"
+#include "frozen.hpp"
+
+namespace ez {
+	KVFrozenGenerator::KVFrozenGenerator(const KVFrozenStore& _store)
+		: store(&_store)
+		, next(((const frozen::Header*)_store.mapping)->dataOffset)
+		, remaining(_store.size())
+	{}
+	bool KVFrozenGenerator::advance(KVEntryView& value) {
+		// The records are walked in file order, so the mapping is read sequentially.
+		uint64_t hash;
+		if (remaining == 0 || !store->record(next, hash, value, next)) {
+			return false;
+		}
+		--remaining;
+		return true;
+	}
+
+
+	KVFrozenStore::KVFrozenStore()
+		: mapping(nullptr)
+		, length(0)
+		, handle(nullptr)
+	{}
+	KVFrozenStore::~KVFrozenStore() {
+		close();
+	}
+
+	KVFrozenStore::KVFrozenStore(KVFrozenStore&& other) noexcept
+		: KVFrozenStore()
+	{
+		swap(other);
+	}
+	KVFrozenStore& KVFrozenStore::operator=(KVFrozenStore&& other) noexcept {
+		swap(other);
+		return *this;
+	}
+	void KVFrozenStore::swap(KVFrozenStore& other) noexcept {
+		std::swap(mapping, other.mapping);
+		std::swap(length, other.length);
+		std::swap(handle, other.handle);
+	}
+
+	bool KVFrozenStore::open(const std::filesystem::path& path) {
+		if (isOpen()) {
+			return false;
+		}
+
+#ifdef _WIN32
+		HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size) || size.QuadPart < LONGLONG(sizeof(frozen::Header))) {
+			CloseHandle(file);
+			return false;
+		}
+		HANDLE map = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		CloseHandle(file);
+		if (!map) {
+			return false;
+		}
+		const void* view = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+		if (!view) {
+			CloseHandle(map);
+			return false;
+		}
+		mapping = (const char*)view;
+		length = static_cast<std::size_t>(size.QuadPart);
+		handle = map;
+#else
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size < off_t(sizeof(frozen::Header))) {
+			::close(fd);
+			return false;
+		}
+		void* view = mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (view == MAP_FAILED) {
+			return false;
+		}
+		mapping = (const char*)view;
+		length = static_cast<std::size_t>(info.st_size);
+#endif
+
+		// Only the header is checked, the records are bounds checked as they are read.
+		frozen::Header header;
+		std::memcpy(&header, mapping, sizeof(header));
+
+		// Every count is compared against the room left in its section, multiplying could wrap around on a crafted header.
+		auto fits = [](uint64_t offset, uint64_t count, uint64_t size, uint64_t end) {
+			return offset <= end && count <= (end - offset) / size;
+		};
+		bool valid =
+			std::memcmp(header.magic, frozen::magic, sizeof(frozen::magic)) == 0 &&
+			header.version == frozen::version &&
+			header.byteOrder == frozen::byte_order &&
+			header.fileSize == length &&
+			header.tableSize >= header.count &&
+			(header.count == 0 || header.numBuckets > 0) &&
+			header.pilotsOffset >= sizeof(frozen::Header) &&
+			header.dataOffset <= length &&
+			fits(header.offsetsOffset, header.count, sizeof(uint64_t), header.dataOffset) &&
+			fits(header.remapOffset, header.tableSize - header.count, sizeof(uint32_t), header.offsetsOffset) &&
+			fits(header.pilotsOffset, header.numBuckets, sizeof(uint32_t), header.remapOffset) &&
+			header.offsetsOffset % frozen::alignment == 0;
+		if (!valid) {
+			close();
+			return false;
+		}
+
+		return true;
+	}
+	void KVFrozenStore::close() {
+		if (!mapping) {
+			return;
+		}
+
+#ifdef _WIN32
+		UnmapViewOfFile(mapping);
+		CloseHandle((HANDLE)handle);
+#else
+		munmap((void*)mapping, length);
+#endif
+		mapping = nullptr;
+		length = 0;
+		handle = nullptr;
+	}
+	bool KVFrozenStore::isOpen() const noexcept {
+		return mapping != nullptr;
+	}
+
+	std::size_t KVFrozenStore::size() const noexcept {
+		if (!mapping) {
+			return 0;
+		}
+		return static_cast<std::size_t>(((const frozen::Header*)mapping)->count);
+	}
+	bool KVFrozenStore::empty() const noexcept {
+		return size() == 0;
+	}
+
+	bool KVFrozenStore::record(uint64_t offset, uint64_t& hash, KVEntryView& entry, uint64_t& next) const {
+		const frozen::Header& header = *(const frozen::Header*)mapping;
+		if (offset < header.dataOffset || offset > length - sizeof(frozen::Record)) {
+			return false;
+		}
+		frozen::Record rec;
+		std::memcpy(&rec, mapping + offset, sizeof(rec));
+
+		uint64_t value = offset + frozen::valueOffset(rec.keyLength);
+		if (value > length || rec.valueLength > length - value) {
+			return false;
+		}
+
+		hash = rec.hash;
+		entry.key = std::string_view(mapping + offset + sizeof(frozen::Record), rec.keyLength);
+		entry.value = std::string_view(mapping + value, static_cast<std::size_t>(rec.valueLength));
+		next = value + frozen::align(static_cast<std::size_t>(rec.valueLength));
+		return true;
+	}
+
+	bool KVFrozenStore::getView(std::string_view name, std::string_view& data) const {
+		if (!mapping) {
+			return false;
+		}
+		const frozen::Header& header = *(const frozen::Header*)mapping;
+		if (header.count == 0) {
+			return false;
+		}
+
+		uint64_t hash = static_cast<uint64_t>(kvhash(name));
+		uint64_t bucket = frozen::bucket(hash, header.seed, header.numBuckets);
+		uint32_t pilot;
+		std::memcpy(&pilot, mapping + header.pilotsOffset + bucket * sizeof(uint32_t), sizeof(pilot));
+
+		uint64_t slot = frozen::position(hash, header.seed, pilot, header.tableSize);
+		if (slot >= header.count) {
+			std::memcpy(&pilot, mapping + header.remapOffset + (slot - header.count) * sizeof(uint32_t), sizeof(pilot));
+			slot = pilot;
+			// The remap table comes from the file, so it is checked like the rest of it.
+			if (slot >= header.count) {
+				return false;
+			}
+		}
+
+		// Every key maps to some slot, the stored key decides whether it is really there.
+		uint64_t offset;
+		std::memcpy(&offset, mapping + header.offsetsOffset + slot * sizeof(uint64_t), sizeof(offset));
+
+		uint64_t stored, next;
+		KVEntryView entry;
+		if (!record(offset, stored, entry, next) || stored != hash || entry.key != name) {
+			return false;
+		}
+		data = entry.value;
+		return true;
+	}
+	bool KVFrozenStore::contains(std::string_view name) const {
+		std::string_view data;
+		return getView(name, data);
+	}
+	bool KVFrozenStore::get(std::string_view name, std::string& data) const {
+		std::string_view view;
+		if (getView(name, view)) {
+			data.assign(view.data(), view.size());
+			return true;
+		}
+		return false;
+	}
+	bool KVFrozenStore::getRaw(std::string_view name, const void*& data, std::size_t& len) const {
+		std::string_view view;
+		if (getView(name, view)) {
+			data = view.data();
+			len = view.size();
+			return true;
+		}
+		return false;
+	}
+	bool KVFrozenStore::getStream(std::string_view name, ez::imemstream& stream) const {
+		std::string_view view;
+		if (getView(name, view)) {
+			stream.reset(view.data(), view.size());
+			return true;
+		}
+		return false;
+	}
+
+	KVFrozenStore::const_iterator KVFrozenStore::begin() const {
+		if (!mapping) {
+			return const_iterator();
+		}
+		return const_iterator(KVFrozenGenerator(*this));
+	}
+	KVFrozenStore::const_iterator KVFrozenStore::end() const {
+		return const_iterator();
+	}
+
+	std::vector<KVEntry> KVFrozenStore::getEntries() const {
+		std::vector<KVEntry> result;
+		result.reserve(size());
+		for (const KVEntryView& entry : *this) {
+			result.push_back(KVEntry{ std::string(entry.key), std::string(entry.value) });
+		}
+		return result;
+	}
+	std::unordered_map<std::string, std::string> KVFrozenStore::getMap() const {
+		std::unordered_map<std::string, std::string> result;
+		result.reserve(size());
+		for (const KVEntryView& entry : *this) {
+			result.insert(std::make_pair(std::string(entry.key), std::string(entry.value)));
+		}
+		return result;
+	}
+
+
+	namespace {
+		// Average number of keys per bucket, and the fraction of the table in use.
+		constexpr double bucket_load = 4.0;
+		constexpr double table_load = 0.99;
+		// Pilots tried per bucket before starting over with a different seed.
+		constexpr uint32_t max_pilot = uint32_t(1) << 24;
+
+		// Assign every hash a slot in [0, count), returns false if the seed didn't work out.
+		bool buildHash(const std::vector<uint64_t>& hashes, frozen::Header& header, std::vector<uint32_t>& pilots, std::vector<uint32_t>& remap, std::vector<uint64_t>& slots) {
+			const std::size_t count = hashes.size();
+			const uint64_t tableSize = header.tableSize;
+			const uint64_t numBuckets = header.numBuckets;
+
+			// Counting sort of the keys into their buckets.
+			std::vector<uint64_t> bucketOf(count);
+			std::vector<std::size_t> starts(numBuckets + 1, 0);
+			for (std::size_t i = 0; i < count; ++i) {
+				bucketOf[i] = frozen::bucket(hashes[i], header.seed, numBuckets);
+				++starts[bucketOf[i] + 1];
+			}
+			for (std::size_t b = 0; b < numBuckets; ++b) {
+				starts[b + 1] += starts[b];
+			}
+			std::vector<std::size_t> members(count);
+			{
+				std::vector<std::size_t> fill(starts.begin(), starts.end() - 1);
+				for (std::size_t i = 0; i < count; ++i) {
+					members[fill[bucketOf[i]]++] = i;
+				}
+			}
+
+			// Largest buckets first, while the table is still mostly empty.
+			std::vector<uint64_t> order(numBuckets);
+			for (uint64_t b = 0; b < numBuckets; ++b) {
+				order[b] = b;
+			}
+			std::stable_sort(order.begin(), order.end(), [&](uint64_t lh, uint64_t rh) {
+				return starts[lh + 1] - starts[lh] > starts[rh + 1] - starts[rh];
+			});
+
+			std::vector<bool> taken(tableSize, false);
+			std::vector<uint64_t> positions;
+			pilots.assign(numBuckets, 0);
+			slots.assign(count, 0);
+
+			for (uint64_t b : order) {
+				std::size_t first = starts[b], last = starts[b + 1];
+				if (first == last) {
+					break;
+				}
+
+				bool placed = false;
+				for (uint32_t pilot = 0; pilot < max_pilot && !placed; ++pilot) {
+					positions.clear();
+					placed = true;
+					for (std::size_t k = first; k < last; ++k) {
+						uint64_t pos = frozen::position(hashes[members[k]], header.seed, pilot, tableSize);
+						if (taken[pos] || std::find(positions.begin(), positions.end(), pos) != positions.end()) {
+							placed = false;
+							break;
+						}
+						positions.push_back(pos);
+					}
+					if (placed) {
+						pilots[b] = pilot;
+						for (std::size_t k = first; k < last; ++k) {
+							taken[positions[k - first]] = true;
+							slots[members[k]] = positions[k - first];
+						}
+					}
+				}
+				if (!placed) {
+					return false;
+				}
+			}
+
+			// Slots past the end are moved into the holes left below it, so the hash is minimal.
+			remap.assign(static_cast<std::size_t>(tableSize - count), 0);
+			uint64_t hole = 0;
+			for (uint64_t pos = count; pos < tableSize; ++pos) {
+				if (!taken[pos]) {
+					continue;
+				}
+				while (taken[hole]) {
+					++hole;
+				}
+				taken[hole] = true;
+				remap[pos - count] = static_cast<uint32_t>(hole);
+			}
+			for (uint64_t& slot : slots) {
+				if (slot >= count) {
+					slot = remap[slot - count];
+				}
+			}
+			return true;
+		}
+
+		void writePadding(std::ofstream& out, std::size_t from) {
+			static const char zeros[frozen::alignment] = {};
+			out.write(zeros, frozen::align(from) - from);
+		}
+	}
+
+	bool KVStore::exportFrozen(const std::filesystem::path& path) const {
+		if (!isOpen()) {
+			return false;
+		}
+
+		SQLite::Database& db = data->db.value();
+
+		// Both passes have to see the same rows.
+		std::optional<SQLite::Transaction> transaction;
+		if (!inBatch()) {
+			transaction.emplace(db);
+		}
+
+		// First pass, hash every key in row order.
+		std::vector<uint64_t> hashes;
+		hashes.reserve(numValues());
+		{
+			SQLite::Statement stmt(db, "SELECT \"key\" FROM \"main\" ORDER BY \"hash\";");
+			while (stmt.executeStep()) {
+				SQLite::Column key = stmt.getColumn(0);
+				hashes.push_back(static_cast<uint64_t>(kvhash((const char*)key.getBlob(), static_cast<std::size_t>(key.getBytes()))));
+			}
+		}
+		const std::size_t count = hashes.size();
+		if (count >= std::size_t(UINT32_MAX)) {
+			std::cerr << "ez::KVStore has too many entries to freeze!\n";
+			return false;
+		}
+		{
+			// Keys with the exact same 64 bit hash can't be told apart by the perfect hash.
+			std::vector<uint64_t> sorted = hashes;
+			std::sort(sorted.begin(), sorted.end());
+			if (std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end()) {
+				std::cerr << "ez::KVStore can't be frozen, two of its keys have the same hash!\n";
+				return false;
+			}
+		}
+
+		frozen::Header header{};
+		std::memcpy(header.magic, frozen::magic, sizeof(frozen::magic));
+		header.version = frozen::version;
+		header.byteOrder = frozen::byte_order;
+		header.count = count;
+		header.tableSize = count == 0 ? 0 : std::max<uint64_t>(count, uint64_t(double(count) / table_load) + 1);
+		header.numBuckets = count == 0 ? 0 : uint64_t(double(count) / bucket_load) + 1;
+
+		std::vector<uint32_t> pilots, remap;
+		std::vector<uint64_t> slots;
+		if (count != 0) {
+			bool built = false;
+			for (uint64_t attempt = 0; attempt < 16 && !built; ++attempt) {
+				header.seed = frozen::mix(0x9E3779B97F4A7C15ull + attempt);
+				built = buildHash(hashes, header, pilots, remap, slots);
+			}
+			if (!built) {
+				std::cerr << "ez::KVStore failed to build a perfect hash!\n";
+				return false;
+			}
+		}
+
+		header.pilotsOffset = frozen::align(sizeof(frozen::Header));
+		header.remapOffset = frozen::align(header.pilotsOffset + pilots.size() * sizeof(uint32_t));
+		header.offsetsOffset = frozen::align(header.remapOffset + remap.size() * sizeof(uint32_t));
+		header.dataOffset = frozen::align(header.offsetsOffset + count * sizeof(uint64_t));
+
+		// Written to the side and moved into place, so readers never see a partial file.
+		std::filesystem::path temp = path;
+		temp += ".tmp";
+		std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+		if (!out) {
+			return false;
+		}
+
+		// Second pass, the records are written in row order and the offsets table is filled in as they go.
+		std::vector<uint64_t> offsets(count, 0);
+		out.seekp(static_cast<std::streamoff>(header.dataOffset));
+		uint64_t offset = header.dataOffset;
+		{
+			SQLite::Statement stmt(db, "SELECT \"key\", \"value\" FROM \"main\" ORDER BY \"hash\";");
+			std::size_t i = 0;
+			while (stmt.executeStep() && i < count) {
+				SQLite::Column key = stmt.getColumn(0);
+				SQLite::Column col = stmt.getColumn(1);
+				std::string_view value = decodeValue(std::string_view((const char*)col.getBlob(), col.getBytes()));
+
+				frozen::Record rec{};
+				rec.hash = hashes[i];
+				rec.keyLength = static_cast<uint32_t>(key.getBytes());
+				rec.valueLength = value.size();
+
+				out.write((const char*)&rec, sizeof(rec));
+				out.write((const char*)key.getBlob(), key.getBytes());
+				writePadding(out, sizeof(rec) + rec.keyLength);
+				out.write(value.data(), value.size());
+				writePadding(out, value.size());
+
+				offsets[slots[i]] = offset;
+				offset += frozen::valueOffset(rec.keyLength) + frozen::align(value.size());
+				++i;
+			}
+		}
+		header.fileSize = offset;
+
+		out.seekp(0);
+		out.write((const char*)&header, sizeof(header));
+		out.seekp(static_cast<std::streamoff>(header.pilotsOffset));
+		out.write((const char*)pilots.data(), pilots.size() * sizeof(uint32_t));
+		out.seekp(static_cast<std::streamoff>(header.remapOffset));
+		out.write((const char*)remap.data(), remap.size() * sizeof(uint32_t));
+		out.seekp(static_cast<std::streamoff>(header.offsetsOffset));
+		out.write((const char*)offsets.data(), offsets.size() * sizeof(uint64_t));
+		out.close();
+
+		if (!out) {
+			std::error_code ec;
+			std::filesystem::remove(temp, ec);
+			return false;
+		}
+
+		std::error_code ec;
+		std::filesystem::rename(temp, path, ec);
+		return !ec;
+	}
+}
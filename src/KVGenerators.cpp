@@ -1,9 +1,22 @@
 #include <ez/intern/KVGenerators.hpp>
 
+#include <stdexcept>
 #include <fmt/format.h>
 
 namespace ez {
-	KVEntryGenerator::KVEntryGenerator(SQLite::Database& db, std::string_view table)
+	static std::string_view decodeValue(const KVValueCodec* codec, std::string_view stored, std::string& buffer) {
+		if (!codec) {
+			return stored;
+		}
+
+		std::string_view value;
+		if (!codec->decode(stored, value, buffer)) {
+			throw std::logic_error("ez::KVStore failed to decode a value while iterating!");
+		}
+		return value;
+	}
+
+	KVEntryGenerator::KVEntryGenerator(SQLite::Database& db, std::string_view table, std::shared_ptr<const KVValueCodec> _codec)
 		: stmt(
 			db,
 			fmt::format(
@@ -11,6 +24,7 @@ namespace ez {
 				table
 			)
 		)
+		, codec(std::move(_codec))
 	{}
 	bool KVEntryGenerator::advance(KVEntry& value) {
 		if (stmt.executeStep()) {
@@ -20,7 +34,8 @@ namespace ez {
 			}
 			{
 				SQLite::Column col = stmt.getColumn(1);
-				value.value.assign((const char*)col.getBlob(), col.getBytes());
+				std::string_view stored((const char*)col.getBlob(), col.getBytes());
+				value.value.assign(decodeValue(codec.get(), stored, buffer));
 			}
 			return true;
 		}
@@ -30,7 +45,7 @@ namespace ez {
 	}
 
 
-	KVEntryViewGenerator::KVEntryViewGenerator(SQLite::Database& db, std::string_view table)
+	KVEntryViewGenerator::KVEntryViewGenerator(SQLite::Database& db, std::string_view table, std::shared_ptr<const KVValueCodec> _codec)
 		: stmt(
 			db,
 			fmt::format(
@@ -38,6 +53,7 @@ namespace ez {
 				table
 			)
 		)
+		, codec(std::move(_codec))
 	{}
 	bool KVEntryViewGenerator::advance(KVEntryView& value) {
 		if (stmt.executeStep()) {
@@ -47,7 +63,43 @@ namespace ez {
 			}
 			{
 				SQLite::Column col = stmt.getColumn(1);
-				value.value = std::string_view((const char*)col.getBlob(), col.getBytes());
+				std::string_view stored((const char*)col.getBlob(), col.getBytes());
+				value.value = decodeValue(codec.get(), stored, buffer);
+			}
+			return true;
+		}
+		else {
+			return false;
+		}
+	}
+
+
+	KVOrderedGenerator::KVOrderedGenerator(SQLite::Database& db, std::string_view table, std::string_view first, std::optional<std::string_view> last, std::shared_ptr<const KVValueCodec> _codec)
+		: stmt(
+			db,
+			fmt::format(
+				"SELECT \"key\", \"value\" FROM \"{}\" WHERE \"key\" >= ?{} ORDER BY \"key\";",
+				table,
+				last ? " AND \"key\" < ?" : ""
+			)
+		)
+		, codec(std::move(_codec))
+	{
+		stmt.bind(1, (const void*)first.data(), static_cast<int>(first.length()));
+		if (last) {
+			stmt.bind(2, (const void*)last->data(), static_cast<int>(last->length()));
+		}
+	}
+	bool KVOrderedGenerator::advance(KVEntryView& value) {
+		if (stmt.executeStep()) {
+			{
+				SQLite::Column col = stmt.getColumn(0);
+				value.key = std::string_view((const char*)col.getBlob(), col.getBytes());
+			}
+			{
+				SQLite::Column col = stmt.getColumn(1);
+				std::string_view stored((const char*)col.getBlob(), col.getBytes());
+				value.value = decodeValue(codec.get(), stored, buffer);
 			}
 			return true;
 		}
@@ -55,4 +107,4 @@ namespace ez {
 			return false;
 		}
 	}
-}
\ No newline at end of file
+}
@@ -0,0 +1,232 @@
+#include <ez/KVMaintenance.hpp>
+#include <ez/KVStore.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <fmt/core.h>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+namespace ez {
+	KVSpaceStats KVStore::getSpaceStats() const {
+		KVSpaceStats stats;
+		if (!isOpen()) {
+			return stats;
+		}
+
+		SQLite::Database& db = data->db.value();
+		stats.pageSize = db.execAndGet("PRAGMA main.page_size;").getInt64();
+		stats.pageCount = db.execAndGet("PRAGMA main.page_count;").getInt64();
+		stats.freePages = db.execAndGet("PRAGMA main.freelist_count;").getInt64();
+		stats.incremental = db.execAndGet("PRAGMA main.auto_vacuum;").getInt() == static_cast<int>(KVOpenOptions::AutoVacuum::Incremental);
+		return stats;
+	}
+
+	std::size_t KVStore::compact(std::size_t pages) {
+		if (!isOpen()) {
+			return 0;
+		}
+
+		KVSpaceStats before = getSpaceStats();
+		if (!before.incremental || before.freePages == 0) {
+			return 0;
+		}
+
+		// Every page has to be stepped through before the pragma gives up its write lock.
+		data->db->exec(fmt::format("PRAGMA main.incremental_vacuum({});", pages));
+
+		int64_t after = data->db->execAndGet("PRAGMA main.freelist_count;").getInt64();
+		return static_cast<std::size_t>(std::max<int64_t>(before.freePages - after, 0));
+	}
+
+	bool KVStore::vacuum() {
+		if (!isOpen() || inBatch()) {
+			return false;
+		}
+
+		finishReads();
+		data->db->exec("VACUUM;");
+		return true;
+	}
+	bool KVStore::vacuum(KVOpenOptions::AutoVacuum mode) {
+		if (!isOpen() || inBatch()) {
+			return false;
+		}
+
+		// The mode only takes effect on a file that has tables once the file is rebuilt.
+		data->db->exec(fmt::format("PRAGMA main.auto_vacuum = {};", static_cast<int>(mode)));
+		return vacuum();
+	}
+
+
+	struct KVMaintenance::Data {
+		KVStore store;
+		KVMaintenanceOptions options;
+
+		mutable std::mutex mutex;
+		std::condition_variable wake;
+		// Both only change under the mutex, running is set while the thread is up.
+		bool running = false;
+		bool stopping = false;
+		bool woken = false;
+
+		KVSpaceStats stats;
+		std::size_t passes = 0;
+		std::size_t freed = 0;
+
+		std::thread thread;
+
+		void run();
+		void pass();
+	};
+
+	void KVMaintenance::Data::run() {
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;) {
+			wake.wait_for(lock, options.interval, [&] { return stopping || woken; });
+			if (stopping) {
+				break;
+			}
+			woken = false;
+
+			lock.unlock();
+			pass();
+			lock.lock();
+		}
+	}
+
+	void KVMaintenance::Data::pass() {
+		KVSpaceStats current;
+		std::size_t count = 0;
+		try {
+			current = store.getSpaceStats();
+			if (current.incremental &&
+				current.freePages > 0 &&
+				static_cast<std::size_t>(current.freePages) >= options.minFreePages &&
+				current.fragmentation() >= options.minFragmentation)
+			{
+				// A step of zero would free everything at once, which is exactly what a step is meant to avoid.
+				count = store.compact(std::max<std::size_t>(options.stepPages, 1));
+				current = store.getSpaceStats();
+			}
+		}
+		catch (std::exception& e) {
+			std::cerr << "ez::KVMaintenance failed to compact with error:\n";
+			std::cerr << e.what() << '\n';
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		stats = current;
+		freed += count;
+		++passes;
+	}
+
+
+	KVMaintenance::KVMaintenance()
+		: data(new Data())
+	{}
+	KVMaintenance::~KVMaintenance() {
+		if (data) {
+			close();
+		}
+	}
+	KVMaintenance::KVMaintenance(KVMaintenance&&) noexcept = default;
+	KVMaintenance& KVMaintenance::operator=(KVMaintenance&& other) noexcept {
+		if (this != &other) {
+			// The thread has to be stopped before the data it uses goes away.
+			if (data) {
+				close();
+			}
+			data = std::move(other.data);
+		}
+		return *this;
+	}
+
+	bool KVMaintenance::open(const std::filesystem::path& path, const KVMaintenanceOptions& options) {
+		if (!data || isOpen()) {
+			return false;
+		}
+
+		if (!data->store.open(path, false, options.store)) {
+			return false;
+		}
+
+		Data* self = data.get();
+		std::lock_guard<std::mutex> lock(data->mutex);
+		data->options = options;
+		data->running = true;
+		data->stopping = false;
+		data->woken = false;
+		data->stats = data->store.getSpaceStats();
+		data->passes = 0;
+		data->freed = 0;
+		data->thread = std::thread([self] { self->run(); });
+		return true;
+	}
+	void KVMaintenance::close() {
+		if (!data) {
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(data->mutex);
+			// Only the first of several concurrent calls stops the thread.
+			if (!data->running || data->stopping) {
+				return;
+			}
+			data->stopping = true;
+		}
+		data->wake.notify_all();
+		data->thread.join();
+
+		data->store.close();
+
+		std::lock_guard<std::mutex> lock(data->mutex);
+		data->running = false;
+	}
+	bool KVMaintenance::isOpen() const noexcept {
+		if (!data) {
+			return false;
+		}
+		std::lock_guard<std::mutex> lock(data->mutex);
+		return data->running;
+	}
+
+	void KVMaintenance::wake() {
+		if (!data) {
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(data->mutex);
+			if (!data->running) {
+				return;
+			}
+			data->woken = true;
+		}
+		data->wake.notify_one();
+	}
+
+	KVSpaceStats KVMaintenance::getSpaceStats() const {
+		if (!data) {
+			return KVSpaceStats();
+		}
+		std::lock_guard<std::mutex> lock(data->mutex);
+		return data->stats;
+	}
+	std::size_t KVMaintenance::numPasses() const {
+		if (!data) {
+			return 0;
+		}
+		std::lock_guard<std::mutex> lock(data->mutex);
+		return data->passes;
+	}
+	std::size_t KVMaintenance::pagesFreed() const {
+		if (!data) {
+			return 0;
+		}
+		std::lock_guard<std::mutex> lock(data->mutex);
+		return data->freed;
+	}
+}
@@ -0,0 +1,133 @@
+#include <ez/KVReadSnapshot.hpp>
+
+#include <iostream>
+
+namespace ez {
+	KVReadSnapshot::~KVReadSnapshot() {
+		close();
+	}
+
+	bool KVReadSnapshot::isOpen() const noexcept {
+		return store.data && store.isOpen();
+	}
+	void KVReadSnapshot::close() {
+		if (!isOpen()) {
+			return;
+		}
+
+		store.finishReads();
+		try {
+			store.data->db->exec("COMMIT;");
+		}
+		catch (std::exception&) {
+			// Closing the connection ends the transaction regardless.
+		}
+		store.close();
+	}
+
+	std::size_t KVReadSnapshot::numValues() const {
+		return store.numValues();
+	}
+	std::size_t KVReadSnapshot::size() const {
+		return store.size();
+	}
+	bool KVReadSnapshot::empty() const {
+		return store.empty();
+	}
+	std::string KVReadSnapshot::getKind() const {
+		return store.getKind();
+	}
+
+	bool KVReadSnapshot::contains(std::string_view name) const {
+		return store.contains(name);
+	}
+	bool KVReadSnapshot::get(std::string_view name, std::string& data) const {
+		return store.get(name, data);
+	}
+	bool KVReadSnapshot::getView(std::string_view name, std::string_view& data) const {
+		return store.getView(name, data);
+	}
+	bool KVReadSnapshot::getStream(std::string_view name, ez::imemstream& stream) const {
+		return store.getStream(name, stream);
+	}
+
+	std::size_t KVReadSnapshot::containsMany(const std::vector<std::string_view>& names, std::vector<bool>& found) const {
+		return store.containsMany(names, found);
+	}
+	std::size_t KVReadSnapshot::getMany(const std::vector<std::string_view>& names, KVBatchResult& result) const {
+		return store.getMany(names, result);
+	}
+
+	KVReadSnapshot::const_iterator KVReadSnapshot::begin() const {
+		return store.begin();
+	}
+	KVReadSnapshot::const_iterator KVReadSnapshot::end() const {
+		return store.end();
+	}
+
+	KVReadSnapshot::ordered_range KVReadSnapshot::lowerBound(std::string_view key) const {
+		return store.lowerBound(key);
+	}
+	KVReadSnapshot::ordered_range KVReadSnapshot::range(std::string_view first, std::string_view last) const {
+		return store.range(first, last);
+	}
+	KVReadSnapshot::ordered_range KVReadSnapshot::prefix(std::string_view prefix) const {
+		return store.prefix(prefix);
+	}
+
+	bool KVReadSnapshot::openCursor(KVCursor& cursor) const {
+		return store.openCursor(cursor);
+	}
+	bool KVReadSnapshot::openCursor(KVCursor& cursor, std::string_view token) const {
+		return store.openCursor(cursor, token);
+	}
+
+	std::vector<KVEntry> KVReadSnapshot::getEntries() const {
+		return store.getEntries();
+	}
+	std::unordered_map<std::string, std::string> KVReadSnapshot::getMap() const {
+		return store.getMap();
+	}
+
+
+	KVReadSnapshot KVStore::snapshot() const {
+		KVReadSnapshot snapshot;
+		if (!isOpen()) {
+			return snapshot;
+		}
+
+		// In memory databases can't be opened a second time.
+		SQLite::Database& db = data->db.value();
+		const std::string& filename = db.getFilename();
+		if (filename.empty() || filename == ":memory:") {
+			return snapshot;
+		}
+
+		try {
+			// Without WAL the read transaction would hold a lock that keeps every writer from committing.
+			if (db.execAndGet("PRAGMA main.journal_mode;").getString() != "wal") {
+				if (inBatch() || db.execAndGet("PRAGMA main.journal_mode = WAL;").getString() != "wal") {
+					return snapshot;
+				}
+			}
+
+			KVOpenOptions options;
+			options.busyTimeout = db.execAndGet("PRAGMA busy_timeout;").getInt();
+			if (!snapshot.store.open(filename, true, options)) {
+				return snapshot;
+			}
+
+			// The snapshot is only fixed by the first read inside of the transaction.
+			SQLite::Database& pinned = snapshot.store.data->db.value();
+			pinned.exec("BEGIN;");
+			pinned.execAndGet("SELECT COUNT(*) FROM ez_kvstore_meta;");
+		}
+		catch (std::exception& e) {
+			std::cerr << "ez::KVStore failed to take a snapshot with error:\n";
+			std::cerr << e.what() << '\n';
+			snapshot.store.close();
+		}
+
+		return snapshot;
+	}
+}
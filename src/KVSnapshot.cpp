@@ -0,0 +1,159 @@
+#include <ez/KVSnapshot.hpp>
+#include <ez/KVStore.hpp>
+
+#include <limits>
+#include <stdexcept>
+
+#include "hashing.hpp"
+#include "status.hpp"
+
+namespace ez {
+	KVSnapshot::KVSnapshot()
+		: legacyHash(false)
+	{}
+
+	bool KVSnapshot::empty() const noexcept {
+		return entries.empty();
+	}
+	std::size_t KVSnapshot::size() const noexcept {
+		return entries.size();
+	}
+	std::size_t KVSnapshot::bytes() const noexcept {
+		return arena.size();
+	}
+
+	KVSnapshot::const_iterator KVSnapshot::begin() const noexcept {
+		return entries.begin();
+	}
+	KVSnapshot::const_iterator KVSnapshot::end() const noexcept {
+		return entries.end();
+	}
+	const KVEntryView& KVSnapshot::operator[](std::size_t i) const noexcept {
+		return entries[i];
+	}
+
+	int64_t KVSnapshot::hashKey(std::string_view key) const {
+		return legacyHash ? kvhash_legacy(key) : kvhash(key);
+	}
+
+	void KVSnapshot::buildIndex() {
+		// At most half full, so probe sequences stay short.
+		std::size_t capacity = 16;
+		while (capacity < entries.size() * 2) {
+			capacity *= 2;
+		}
+		index.assign(capacity, 0);
+
+		const std::size_t mask = capacity - 1;
+		for (std::size_t i = 0; i < entries.size(); ++i) {
+			std::size_t pos = static_cast<std::size_t>(hashes[i]) & mask;
+			while (index[pos] != 0) {
+				pos = (pos + 1) & mask;
+			}
+			index[pos] = static_cast<uint32_t>(i + 1);
+		}
+	}
+
+	const KVEntryView* KVSnapshot::find(std::string_view key) const {
+		if (entries.empty()) {
+			return nullptr;
+		}
+
+		const std::size_t mask = index.size() - 1;
+
+		// Follow the same probe sequence as the file, in case the key was displaced by a collision.
+		for (int64_t slot = hashKey(key); ; slot = kvprobe(slot)) {
+			const KVEntryView* holder = nullptr;
+			for (std::size_t pos = static_cast<std::size_t>(slot) & mask; index[pos] != 0; pos = (pos + 1) & mask) {
+				std::size_t i = index[pos] - 1;
+				if (hashes[i] == slot) {
+					holder = &entries[i];
+					break;
+				}
+			}
+
+			if (!holder) {
+				return nullptr;
+			}
+			if (holder->key == key) {
+				return holder;
+			}
+		}
+	}
+	bool KVSnapshot::contains(std::string_view key) const {
+		return find(key) != nullptr;
+	}
+	bool KVSnapshot::get(std::string_view key, std::string_view& value) const {
+		if (const KVEntryView* entry = find(key)) {
+			value = entry->value;
+			return true;
+		}
+		return false;
+	}
+
+
+	KVSnapshot KVStore::getSnapshot() const {
+		KVSnapshot snapshot;
+		if (!isOpen()) {
+			return snapshot;
+		}
+		snapshot.legacyHash = data->legacyHash;
+		KVOpTimer timer(data->status, KVOp::Scan);
+
+		SQLite::Database& db = data->db.value();
+
+		// Size everything up front, so the arena is a single allocation unless values have to be decoded.
+		std::size_t count = 0, bytes = 0;
+		{
+			SQLite::Statement stmt(
+				db,
+				"SELECT COUNT(*), COALESCE(SUM(length(\"key\")) + SUM(length(\"value\")), 0) FROM \"main\";"
+			);
+			stmt.executeStep();
+			count = static_cast<std::size_t>(stmt.getColumn(0).getInt64());
+			bytes = static_cast<std::size_t>(stmt.getColumn(1).getInt64());
+		}
+		if (count >= std::numeric_limits<uint32_t>::max()) {
+			throw std::logic_error("ez::KVStore is too large to snapshot!");
+		}
+
+		snapshot.arena.reserve(bytes);
+		snapshot.hashes.reserve(count);
+		// Offsets until the arena stops growing.
+		std::vector<std::size_t> lengths;
+		lengths.reserve(count * 2);
+
+		SQLite::Statement stmt(
+			db,
+			"SELECT \"hash\", \"key\", \"value\" FROM \"main\";"
+		);
+		while (stmt.executeStep()) {
+			SQLite::Column key = stmt.getColumn(1);
+			SQLite::Column col = stmt.getColumn(2);
+			std::string_view value = decodeValue(std::string_view((const char*)col.getBlob(), col.getBytes()));
+
+			const char* keyData = (const char*)key.getBlob();
+			snapshot.arena.insert(snapshot.arena.end(), keyData, keyData + key.getBytes());
+			snapshot.arena.insert(snapshot.arena.end(), value.begin(), value.end());
+			lengths.push_back(static_cast<std::size_t>(key.getBytes()));
+			lengths.push_back(value.size());
+			snapshot.hashes.push_back(stmt.getColumn(0).getInt64());
+		}
+		if (snapshot.hashes.size() >= std::numeric_limits<uint32_t>::max()) {
+			throw std::logic_error("ez::KVStore is too large to snapshot!");
+		}
+
+		snapshot.entries.resize(snapshot.hashes.size());
+		const char* ptr = snapshot.arena.data();
+		for (std::size_t i = 0; i < snapshot.entries.size(); ++i) {
+			snapshot.entries[i].key = std::string_view(ptr, lengths[i * 2]);
+			ptr += lengths[i * 2];
+			snapshot.entries[i].value = std::string_view(ptr, lengths[i * 2 + 1]);
+			ptr += lengths[i * 2 + 1];
+		}
+
+		snapshot.buildIndex();
+		timer.bytesRead = snapshot.arena.size();
+		return snapshot;
+	}
+}
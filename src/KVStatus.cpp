@@ -0,0 +1,193 @@
+#include <ez/KVStore.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <sqlite3.h>
+
+namespace ez {
+	const char* kvOpName(KVOp op) noexcept {
+		switch (op) {
+		case KVOp::Get:
+			return "get";
+		case KVOp::Set:
+			return "set";
+		case KVOp::Erase:
+			return "erase";
+		case KVOp::Rename:
+			return "rename";
+		case KVOp::Contains:
+			return "contains";
+		case KVOp::Scan:
+			return "scan";
+		case KVOp::Commit:
+			return "commit";
+		}
+		return "unknown";
+	}
+
+	std::size_t KVHistogram::bucketOf(uint64_t nanos) noexcept {
+		std::size_t bucket = 0;
+		while (nanos != 0 && bucket + 1 < numBuckets) {
+			nanos >>= 1;
+			++bucket;
+		}
+		return bucket;
+	}
+	std::chrono::nanoseconds KVHistogram::mean() const noexcept {
+		return std::chrono::nanoseconds(samples == 0 ? 0 : totalNanos / samples);
+	}
+	std::chrono::nanoseconds KVHistogram::max() const noexcept {
+		return std::chrono::nanoseconds(maxNanos);
+	}
+	std::chrono::nanoseconds KVHistogram::percentile(double q) const noexcept {
+		if (samples == 0) {
+			return std::chrono::nanoseconds(0);
+		}
+
+		uint64_t rank = static_cast<uint64_t>(std::ceil(std::clamp(q, 0.0, 1.0) * double(samples)));
+		rank = std::max<uint64_t>(rank, 1);
+
+		uint64_t seen = 0;
+		for (std::size_t i = 0; i < numBuckets; ++i) {
+			seen += buckets[i];
+			if (seen >= rank) {
+				uint64_t upper = i == 0 ? 0 : (uint64_t(1) << i) - 1;
+				return std::chrono::nanoseconds(std::min(upper, maxNanos));
+			}
+		}
+		return std::chrono::nanoseconds(maxNanos);
+	}
+
+	uint64_t KVStatus::bytesRead() const noexcept {
+		uint64_t total = 0;
+		for (const KVOpStats& op : ops) {
+			total += op.bytesRead;
+		}
+		return total;
+	}
+	uint64_t KVStatus::bytesWritten() const noexcept {
+		uint64_t total = 0;
+		for (const KVOpStats& op : ops) {
+			total += op.bytesWritten;
+		}
+		return total;
+	}
+
+	void KVStatusRecorder::record(KVOp op, std::chrono::nanoseconds time, uint64_t count, uint64_t bytesRead, uint64_t bytesWritten, std::string_view key) {
+		constexpr std::memory_order relaxed = std::memory_order_relaxed;
+
+		uint64_t nanos = static_cast<uint64_t>(std::max<int64_t>(time.count(), 0));
+		Counters& counter = counters[static_cast<std::size_t>(op)];
+		counter.count.fetch_add(count, relaxed);
+		if (bytesRead != 0) {
+			counter.bytesRead.fetch_add(bytesRead, relaxed);
+		}
+		if (bytesWritten != 0) {
+			counter.bytesWritten.fetch_add(bytesWritten, relaxed);
+		}
+		counter.samples.fetch_add(1, relaxed);
+		counter.totalNanos.fetch_add(nanos, relaxed);
+		counter.buckets[KVHistogram::bucketOf(nanos)].fetch_add(1, relaxed);
+
+		uint64_t slowest = counter.maxNanos.load(relaxed);
+		while (nanos > slowest && !counter.maxNanos.compare_exchange_weak(slowest, nanos, relaxed)) {}
+
+		if (slowCallback && time >= slowThreshold) {
+			slowOps.fetch_add(1, relaxed);
+			slowCallback(op, key, time);
+		}
+	}
+	void KVStatusRecorder::setSlowCallback(std::chrono::nanoseconds threshold, KVSlowOpCallback callback) {
+		slowThreshold = threshold;
+		slowCallback = std::move(callback);
+	}
+	void KVStatusRecorder::collect(KVStatus& status) const {
+		constexpr std::memory_order relaxed = std::memory_order_relaxed;
+
+		for (std::size_t i = 0; i < kvNumOps; ++i) {
+			const Counters& counter = counters[i];
+			KVOpStats& stats = status.ops[i];
+			stats.count = counter.count.load(relaxed);
+			stats.bytesRead = counter.bytesRead.load(relaxed);
+			stats.bytesWritten = counter.bytesWritten.load(relaxed);
+			stats.latency.samples = counter.samples.load(relaxed);
+			stats.latency.totalNanos = counter.totalNanos.load(relaxed);
+			stats.latency.maxNanos = counter.maxNanos.load(relaxed);
+			for (std::size_t b = 0; b < KVHistogram::numBuckets; ++b) {
+				stats.latency.buckets[b] = counter.buckets[b].load(relaxed);
+			}
+		}
+		status.slowOps = slowOps.load(relaxed);
+	}
+	void KVStatusRecorder::reset() {
+		constexpr std::memory_order relaxed = std::memory_order_relaxed;
+
+		for (Counters& counter : counters) {
+			for (std::atomic<uint64_t>* value : { &counter.count, &counter.bytesRead, &counter.bytesWritten, &counter.samples, &counter.totalNanos, &counter.maxNanos }) {
+				value->store(0, relaxed);
+			}
+			for (std::atomic<uint64_t>& bucket : counter.buckets) {
+				bucket.store(0, relaxed);
+			}
+		}
+		slowOps.store(0, relaxed);
+	}
+
+
+	KVStatus KVStore::getStatus() const {
+		KVStatus status;
+		data->status.collect(status);
+		status.cache = getCacheStats();
+		status.filter = getFilterStats();
+
+		sqlite3_int64 memory = 0, memoryHighwater = 0;
+		sqlite3_status64(SQLITE_STATUS_MEMORY_USED, &memory, &memoryHighwater, 0);
+		status.sqlite.memoryUsed = memory;
+		status.sqlite.memoryHighwater = memoryHighwater;
+
+		if (!isOpen()) {
+			return status;
+		}
+
+		SQLite::Database& db = data->db.value();
+		auto dbStatus = [&](int op) -> int64_t {
+			int current = 0, highwater = 0;
+			sqlite3_db_status(db.getHandle(), op, &current, &highwater, 0);
+			return current;
+		};
+		status.sqlite.cacheHits = dbStatus(SQLITE_DBSTATUS_CACHE_HIT);
+		status.sqlite.cacheMisses = dbStatus(SQLITE_DBSTATUS_CACHE_MISS);
+		status.sqlite.cacheWrites = dbStatus(SQLITE_DBSTATUS_CACHE_WRITE);
+		status.sqlite.cacheSpills = dbStatus(SQLITE_DBSTATUS_CACHE_SPILL);
+		status.sqlite.cacheUsed = dbStatus(SQLITE_DBSTATUS_CACHE_USED);
+		status.sqlite.schemaUsed = dbStatus(SQLITE_DBSTATUS_SCHEMA_USED);
+		status.sqlite.statementsUsed = dbStatus(SQLITE_DBSTATUS_STMT_USED);
+
+		status.sqlite.pageSize = db.execAndGet("PRAGMA page_size;").getInt64();
+		status.sqlite.pageCount = db.execAndGet("PRAGMA page_count;").getInt64();
+		status.sqlite.freePages = db.execAndGet("PRAGMA freelist_count;").getInt64();
+
+		const std::string& filename = db.getFilename();
+		if (!filename.empty() && filename != ":memory:") {
+			std::error_code ec;
+			std::uintmax_t walBytes = std::filesystem::file_size(filename + "-wal", ec);
+			status.sqlite.walBytes = ec ? 0 : static_cast<int64_t>(walBytes);
+		}
+
+		return status;
+	}
+	void KVStore::resetStatus() {
+		data->status.reset();
+		data->filterStats = KVFilterStats{};
+
+		if (isOpen()) {
+			int current = 0, highwater = 0;
+			for (int op : { SQLITE_DBSTATUS_CACHE_HIT, SQLITE_DBSTATUS_CACHE_MISS, SQLITE_DBSTATUS_CACHE_WRITE, SQLITE_DBSTATUS_CACHE_SPILL }) {
+				sqlite3_db_status(data->db->getHandle(), op, &current, &highwater, 1);
+			}
+		}
+	}
+	void KVStore::setSlowOperationCallback(std::chrono::nanoseconds threshold, KVSlowOpCallback callback) {
+		data->status.setSlowCallback(threshold, std::move(callback));
+	}
+}
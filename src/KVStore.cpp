@@ -4,12 +4,18 @@
 #include <algorithm>
 #include <fmt/core.h>
 #include <fmt/format.h>
+#include <sqlite3.h>
 
 #include "hashing.hpp"
+#include "schema.hpp"
+#include "status.hpp"
 
 namespace ez {
-	// The id is the first 8 hex values of the sha256 hash of "ez-kvstore", 0xCB4D74FF
-	static constexpr int32_t application_id = 0xCB4D74FF;
+	// The id is the first 8 hex values of the sha256 hash of "ez-kvstore 3", 0x0911B2EA
+	// Changed along with the hash function in version 3 of the layout, so that older builds refuse the file instead of misreading it.
+	static constexpr int32_t application_id = 0x0911B2EA;
+	// The id of files written before version 3, the first 8 hex values of the sha256 hash of "ez-kvstore", 0xCB4D74FF
+	static constexpr int32_t legacy_application_id = 0xCB4D74FF;
 
 	KVStore::KVStore()
 		: data(new Data())
@@ -23,7 +29,7 @@ namespace ez {
 		return data->db.has_value();
 	}
 
-	bool KVStore::create(const std::filesystem::path& path, bool overwrite) {
+	bool KVStore::create(const std::filesystem::path& path, bool overwrite, const KVOpenOptions& options) {
 		if (isOpen()) {
 			return false;
 		}
@@ -38,6 +44,14 @@ namespace ez {
 				if (!fs::remove(path)) {
 					return false;
 				}
+
+				// Stale journal files must not be applied to the new database.
+				std::error_code ec;
+				for (const char* suffix : { "-wal", "-shm", "-journal" }) {
+					fs::path sibling = path;
+					sibling += suffix;
+					fs::remove(sibling, ec);
+				}
 			}
 			else {
 				return false;
@@ -54,6 +68,12 @@ namespace ez {
 			return false;
 		}
 
+		installFunctions();
+		// The page size has to be set before anything is written to the file.
+		if (!applyOptions(options, true, false)) {
+			return false;
+		}
+
 		// Set the application_id pragma, so we can identify the database correctly when opening.
 		{
 			// For some reason this works, while the binding does not...
@@ -83,28 +103,18 @@ namespace ez {
 		// Set the kind value to a default
 		setKind("ez_kvstore");
 		createTable();
+		upgradeCounter(schema::version);
 
 		// Indexing is not required!
 		// The primary key is an integer
 
-		// Modify pragmas
-		try {
-			SQLite::Statement stmt{
-				data->db.value(),
-				"PRAGMA main.synchronous = 1;"
-			};
-
-			stmt.executeStep();
-		}
-		catch (std::exception& e) {
-			std::string err = fmt::format(
-				"ez::KVStore failed to set main.synchronous with error:\n{}\n", e.what());
-			throw std::logic_error(err);
+		if (hasFilter()) {
+			rebuildFilter();
 		}
 
 		return true;
 	}
-	bool KVStore::open(const std::filesystem::path& path, bool readonly) {
+	bool KVStore::open(const std::filesystem::path& path, bool readonly, const KVOpenOptions& options) {
 		if (isOpen()) {
 			return false;
 		}
@@ -132,16 +142,64 @@ namespace ez {
 			app_id = stmt.getColumn(0);
 		}
 
-		if (app_id != application_id) {
+		if (app_id != application_id && app_id != legacy_application_id) {
+			data->db.reset();
+			return false;
+		}
+
+		int64_t version = 1;
+		{
+			SQLite::Statement stmt{
+				data->db.value(),
+				"SELECT \"key\", \"value\" FROM ez_kvstore_meta WHERE \"key\" IN ('count', 'version');"
+			};
+			while (stmt.executeStep()) {
+				if (stmt.getColumn(0).getString() == "count") {
+					data->hasCounter = true;
+				}
+				else {
+					version = stmt.getColumn(1).getInt64();
+				}
+			}
+		}
+
+		// Files written by newer versions of the library can't be read safely, and the old id is only valid for files older than version 3.
+		if (version > schema::version || (app_id == legacy_application_id) != (version < 3)) {
+			data->hasCounter = false;
 			data->db.reset();
 			return false;
 		}
 
+		installFunctions();
+		if (!applyOptions(options, false, readonly)) {
+			return false;
+		}
+
+		// The count is cheap to add the first time the file is opened for writing, rehashing the keys waits for upgrade.
+		if (!readonly && !data->hasCounter) {
+			version = std::max<int64_t>(version, 2);
+			upgradeCounter(version);
+		}
+		data->legacyHash = version < 3;
+		loadCodec();
+
+		if (hasFilter()) {
+			rebuildFilter();
+		}
+
 		return true;
 	}
 	void KVStore::close() {
 		if (isOpen()) {
 			data->batch.reset();
+			if (data->cache) {
+				data->cache->clear();
+			}
+			data->filter.reset();
+			data->hasCounter = false;
+			data->legacyHash = false;
+			data->codec.reset();
+			data->tables.clear();
 
 			// Maybe run PRAGMA optimize?
 			/*
@@ -211,11 +269,102 @@ namespace ez {
 		if (!inBatch()) {
 			throw std::logic_error("Attempt to commit a batch when not in a batch!");
 		}
+		KVOpTimer timer(data->status, KVOp::Commit);
 		data->batch.value().commit();
 		data->batch.reset();
 	}
 	void KVStore::cancelBatch() {
 		data->batch.reset();
+
+		// Named tables created or dropped in the batch have been rolled back, they are looked up again when next used.
+		data->tables.clear();
+
+		// The cache may hold values that were just rolled back.
+		if (data->cache) {
+			data->cache->clear();
+		}
+	}
+
+	void KVStore::setCacheCapacity(std::size_t bytes) {
+		if (bytes == 0) {
+			data->cache.reset();
+		}
+		else if (data->cache) {
+			data->cache->setCapacity(bytes);
+		}
+		else {
+			data->cache.emplace(bytes);
+		}
+	}
+	std::size_t KVStore::getCacheCapacity() const {
+		return data->cache ? data->cache->capacity() : 0;
+	}
+	KVCacheStats KVStore::getCacheStats() const {
+		return data->cache ? data->cache->stats() : KVCacheStats{};
+	}
+
+	void KVStore::enableFilter(double falsePositiveRate) {
+		data->filterRate = falsePositiveRate;
+		if (isOpen()) {
+			rebuildFilter();
+		}
+	}
+	void KVStore::disableFilter() {
+		data->filterRate = 0.0;
+		data->filter.reset();
+	}
+	bool KVStore::hasFilter() const {
+		return data->filterRate > 0.0;
+	}
+	void KVStore::rebuildFilter() {
+		if (!isOpen() || !hasFilter()) {
+			return;
+		}
+
+		// Leave room to grow before the next rebuild.
+		data->filter.emplace(numValues() * 2, data->filterRate);
+
+		SQLite::Statement stmt(
+			data->db.value(),
+			"SELECT \"hash\" FROM \"main\";"
+		);
+		while (stmt.executeStep()) {
+			data->filter->insert(stmt.getColumn(0).getInt64());
+		}
+	}
+	KVFilterStats KVStore::getFilterStats() const {
+		KVFilterStats stats = data->filterStats;
+		if (data->filter) {
+			stats.entries = data->filter->size();
+			stats.bits = data->filter->numBits();
+			stats.targetRate = data->filter->rate();
+		}
+		return stats;
+	}
+	KVValueCache* KVStore::cacheOf(const Table& table) const {
+		return data->cache && table.id == 0 ? &data->cache.value() : nullptr;
+	}
+	bool KVStore::filterRejects(const Table& table, int64_t hash) const {
+		if (!data->filter || table.id != 0) {
+			return false;
+		}
+
+		++data->filterStats.queries;
+		if (data->filter->mayContain(hash)) {
+			return false;
+		}
+		++data->filterStats.definiteMisses;
+		return true;
+	}
+	void KVStore::filterInsert(const Table& table, int64_t hash) {
+		if (!data->filter || table.id != 0) {
+			return;
+		}
+
+		data->filter->insert(hash);
+		if (data->filter->size() > data->filter->capacity()) {
+			rebuildFilter();
+		}
 	}
 
 
@@ -238,6 +387,14 @@ namespace ez {
 		}
 		return false;
 	}
+	bool KVStore::getView(std::string_view name, std::string_view& data, bool& copied) const {
+		KVOpTimer timer(this->data->status, KVOp::Get, name);
+		if (lookup(this->data->main, name, data, copied)) {
+			timer.bytesRead = data.length();
+			return true;
+		}
+		return false;
+	}
 	bool KVStore::getStream(std::string_view name, ez::imemstream& stream) const {
 		const void* ptr;
 		std::size_t len;
@@ -254,39 +411,320 @@ namespace ez {
 
 	using const_iterator = KVStore::const_iterator;
 	const_iterator KVStore::begin() const {
-		return const_iterator(KVEntryViewGenerator(data->db.value(), "main"));
+		return const_iterator(KVEntryViewGenerator(data->db.value(), "main", data->codec));
 	}
 	const_iterator KVStore::end() const {
 		return const_iterator();
 	}
 
+	using ordered_iterator = KVStore::ordered_iterator;
+	using ordered_range = KVStore::ordered_range;
+	ordered_range KVStore::lowerBound(std::string_view key) const {
+		return ordered_range(ordered_iterator(KVOrderedGenerator(data->db.value(), "main", key, std::nullopt, data->codec)));
+	}
+	ordered_range KVStore::range(std::string_view first, std::string_view last) const {
+		return ordered_range(ordered_iterator(KVOrderedGenerator(data->db.value(), "main", first, last, data->codec)));
+	}
+	ordered_range KVStore::prefix(std::string_view prefix) const {
+		std::optional<std::string> last = prefixEnd(prefix);
+		if (!last) {
+			return lowerBound(prefix);
+		}
+		return range(prefix, *last);
+	}
+	std::optional<std::string> KVStore::prefixEnd(std::string_view prefix) {
+		// The smallest key greater than every key with the prefix, drop trailing 0xFF bytes and increment the last one.
+		std::string last(prefix);
+		while (!last.empty() && static_cast<unsigned char>(last.back()) == 0xFF) {
+			last.pop_back();
+		}
+		if (last.empty()) {
+			return std::nullopt;
+		}
+		last.back() = static_cast<char>(static_cast<unsigned char>(last.back()) + 1);
+		return last;
+	}
+
+	bool KVStore::enableKeyIndex() {
+		if (!isOpen()) {
+			return false;
+		}
+		data->db->exec("CREATE INDEX IF NOT EXISTS ez_kvstore_key_index ON \"main\"(\"key\");");
+		return true;
+	}
+	void KVStore::dropKeyIndex() {
+		if (isOpen()) {
+			data->db->exec("DROP INDEX IF EXISTS ez_kvstore_key_index;");
+		}
+	}
+	bool KVStore::hasKeyIndex() const {
+		if (!isOpen()) {
+			return false;
+		}
+		SQLite::Statement stmt(
+			data->db.value(),
+			"SELECT 1 FROM sqlite_master WHERE \"type\" = 'index' AND \"name\" = 'ez_kvstore_key_index';"
+		);
+		return stmt.executeStep();
+	}
+
 	std::vector<KVEntry> KVStore::getEntries() const {
+		KVOpTimer timer(data->status, KVOp::Scan);
 		std::vector<KVEntry> result;
 		result.reserve(size());
 
 		for (const KVEntryView& entry : *this) {
 			result.push_back(KVEntry{ std::string(entry.key), std::string(entry.value) });
+			timer.bytesRead += entry.key.length() + entry.value.length();
 		}
 
 		return result;
 	}
 	std::unordered_map<std::string, std::string> KVStore::getMap() const {
+		KVOpTimer timer(data->status, KVOp::Scan);
 		std::unordered_map<std::string, std::string> result;
 		result.reserve(size());
 
 		for (const KVEntryView& entry : *this) {
 			result.insert(std::make_pair(std::string(entry.key), std::string(entry.value)));
+			timer.bytesRead += entry.key.length() + entry.value.length();
 		}
 
 		return result;
 	}
 
+	void KVStore::finishReads() const {
+		auto finish = [](const Table& table) {
+			for (std::optional<SQLite::Statement>* stmt : {
+				&table.containsStmt,
+				&table.getStmt,
+				&table.containsManyStmt,
+				&table.getManyStmt,
+				&table.countStmt,
+			}) {
+				if (stmt->has_value()) {
+					stmt->value().reset();
+				}
+			}
+		};
+
+		finish(data->main);
+		for (const auto& [name, table] : data->tables) {
+			finish(*table);
+		}
+	}
+	bool KVStore::hasBusyStatements() const {
+		sqlite3* handle = data->db->getHandle();
+		for (sqlite3_stmt* stmt = sqlite3_next_stmt(handle, nullptr); stmt; stmt = sqlite3_next_stmt(handle, stmt)) {
+			if (sqlite3_stmt_busy(stmt)) {
+				return true;
+			}
+		}
+		return false;
+	}
 	void KVStore::resetStmts() {
-		data->containsStmt.reset();
-		data->getStmt.reset();
-		data->setStmt.reset();
-		data->eraseStmt.reset();
-		data->countStmt.reset();
+		Table& table = data->main;
+		table.containsStmt.reset();
+		table.getStmt.reset();
+		table.setStmt.reset();
+		table.eraseStmt.reset();
+		table.countStmt.reset();
+		table.containsManyStmt.reset();
+		table.getManyStmt.reset();
+		table.incrementStmt.reset();
+		table.appendStmt.reset();
+		table.compareStmt.reset();
+		table.insertStmt.reset();
+
+		// Named tables are simply forgotten, they prepare their statements again the next time they are opened.
+		data->tables.clear();
+	}
+	bool KVStore::applyOptions(const KVOpenOptions& options, bool creating, bool readonly) {
+		using Journal = KVOpenOptions::Journal;
+
+		SQLite::Database& db = data->db.value();
+		auto pragma = [&](std::string_view name, auto value) {
+			SQLite::Statement stmt{
+				db,
+				fmt::format("PRAGMA {} = {};", name, value)
+			};
+			stmt.executeStep();
+		};
+
+		try {
+			if (options.busyTimeout > 0) {
+				db.setBusyTimeout(options.busyTimeout);
+			}
+			if (creating && options.pageSize > 0) {
+				pragma("main.page_size", options.pageSize);
+			}
+			if (creating && options.autoVacuum != KVOpenOptions::AutoVacuum::None) {
+				pragma("main.auto_vacuum", static_cast<int>(options.autoVacuum));
+			}
+			if (!readonly && options.journal != Journal::Default) {
+				const char* mode = "DELETE";
+				switch (options.journal) {
+				case Journal::Truncate: mode = "TRUNCATE"; break;
+				case Journal::Persist: mode = "PERSIST"; break;
+				case Journal::Memory: mode = "MEMORY"; break;
+				case Journal::WAL: mode = "WAL"; break;
+				case Journal::Off: mode = "OFF"; break;
+				default: break;
+				}
+				pragma("main.journal_mode", mode);
+			}
+
+			pragma("main.synchronous", static_cast<int>(options.synchronous));
+
+			if (options.tempStore != KVOpenOptions::TempStore::Default) {
+				pragma("temp_store", static_cast<int>(options.tempStore));
+			}
+			if (options.mmapSize > 0) {
+				pragma("main.mmap_size", options.mmapSize);
+			}
+			if (options.cacheSize > 0) {
+				// Negative values are interpreted as a size in KiB, rather than a number of pages.
+				pragma("main.cache_size", -std::max(options.cacheSize / 1024, int64_t(1)));
+			}
+		}
+		catch (std::exception& e) {
+			std::cerr << "Failed to apply the open options with error:\n";
+			std::cerr << e.what() << '\n';
+
+			// Nothing is left half configured.
+			resetStmts();
+			data->hasCounter = false;
+			data->db.reset();
+			return false;
+		}
+		return true;
+	}
+	void KVStore::upgradeCounter(int64_t version) {
+		SQLite::Database& db = data->db.value();
+
+		SQLite::Transaction transaction(db);
+		installCounter();
+
+		SQLite::Statement stmt{
+			db,
+			"INSERT OR REPLACE INTO ez_kvstore_meta(\"key\", \"value\") VALUES ('version', ?);"
+		};
+		stmt.bind(1, version);
+		stmt.exec();
+
+		transaction.commit();
+
+		data->hasCounter = true;
+		data->main.countStmt.reset();
+	}
+	bool KVStore::needsUpgrade() const {
+		return isOpen() && data->legacyHash;
+	}
+	bool KVStore::upgrade(std::size_t chunk) {
+		if (!isOpen() || inBatch() || sqlite3_db_readonly(data->db->getHandle(), "main") == 1) {
+			return false;
+		}
+		if (!data->legacyHash) {
+			return true;
+		}
+
+		finishReads();
+		if (hasBusyStatements()) {
+			return false;
+		}
+		rehashKeys(std::max<std::size_t>(chunk, 1));
+
+		// Swapping in the new table is the only step that has to see the whole store at once.
+		SQLite::Database& db = data->db.value();
+		SQLite::Transaction transaction(db);
+		// Dropping the table drops its triggers and indices too, installCounter puts the triggers back.
+		bool keyIndex = hasKeyIndex();
+		db.exec("DROP TABLE \"main\";");
+		db.exec("ALTER TABLE ez_kvstore_rehash RENAME TO \"main\";");
+		if (keyIndex) {
+			enableKeyIndex();
+		}
+		installCounter();
+		db.exec(fmt::format("INSERT OR REPLACE INTO ez_kvstore_meta(\"key\", \"value\") VALUES ('version', {});", schema::version));
+		db.exec(fmt::format("PRAGMA main.application_id = {};", application_id));
+		transaction.commit();
+
+		resetStmts();
+		data->legacyHash = false;
+		data->hasCounter = true;
+		if (data->cache) {
+			data->cache->clear();
+		}
+		if (hasFilter()) {
+			rebuildFilter();
+		}
+		return true;
+	}
+	void KVStore::installCounter() {
+		SQLite::Database& db = data->db.value();
+
+		db.exec("INSERT OR REPLACE INTO ez_kvstore_meta(\"key\", \"value\") SELECT 'count', COUNT(*) FROM \"main\";");
+		db.exec(schema::count_insert_trigger);
+		db.exec(schema::count_delete_trigger);
+	}
+	void KVStore::rehashKeys(std::size_t chunk) {
+		SQLite::Database& db = data->db.value();
+		resetStmts();
+
+		// The rows are copied into a fresh table, as moving them in place could collide with rows not yet moved.
+		// Left over tables from an interrupted upgrade may have missed writes made since, so they are started over.
+		db.exec("DROP TABLE IF EXISTS ez_kvstore_rehash;");
+		db.exec(
+			"CREATE TABLE ez_kvstore_rehash("
+			"\"hash\" INTEGER UNIQUE, "
+			"\"key\" BLOB NOT NULL, "
+			"\"value\" BLOB NOT NULL, "
+			"PRIMARY KEY(\"hash\"));"
+		);
+
+		// Walks the old table in hash order, so each chunk picks up where the last one stopped.
+		SQLite::Statement first(db, "SELECT \"hash\", \"key\", \"value\" FROM \"main\" ORDER BY \"hash\" LIMIT ?;");
+		SQLite::Statement next(db, "SELECT \"hash\", \"key\", \"value\" FROM \"main\" WHERE \"hash\" > ? ORDER BY \"hash\" LIMIT ?;");
+		SQLite::Statement insert(
+			db,
+			"INSERT INTO ez_kvstore_rehash(\"hash\", \"key\", \"value\") VALUES (?, ?, ?) ON CONFLICT(\"hash\") DO NOTHING;"
+		);
+
+		first.bind(1, static_cast<int64_t>(chunk));
+		SQLite::Statement* select = &first;
+		for (;;) {
+			SQLite::Transaction transaction(db);
+			std::size_t count = 0;
+			int64_t last = 0;
+			while (select->executeStep()) {
+				SQLite::Column key = select->getColumn(1);
+				SQLite::Column value = select->getColumn(2);
+				last = select->getColumn(0).getInt64();
+				++count;
+
+				// Colliding keys go in the following free slot.
+				int64_t slot = kvhash((const char*)key.getBlob(), static_cast<std::size_t>(key.getBytes()));
+				for (;; slot = kvprobe(slot)) {
+					insert.reset();
+					insert.bind(1, slot);
+					insert.bind(2, key.getBlob(), key.getBytes());
+					insert.bind(3, value.getBlob(), value.getBytes());
+					if (insert.exec() == 1) {
+						break;
+					}
+				}
+			}
+			select->reset();
+			transaction.commit();
+
+			if (count < chunk) {
+				break;
+			}
+			next.reset();
+			next.bind(1, last);
+			next.bind(2, static_cast<int64_t>(chunk));
+			select = &next;
+		}
 	}
 	void KVStore::createTable() {
 		SQLite::Statement stmt(
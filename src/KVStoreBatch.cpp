@@ -0,0 +1,243 @@
+#include <ez/KVStore.hpp>
+
+#include <cassert>
+#include <algorithm>
+#include <chrono>
+#include <fmt/core.h>
+#include <fmt/format.h>
+#include "hashing.hpp"
+#include "status.hpp"
+
+namespace ez {
+	// Number of hashes bound per execution of the batched statements.
+	// Shorter requests are padded by repeating the last hash, so a single prepared statement covers every chunk.
+	static constexpr std::size_t batch_width = 64;
+
+	namespace {
+		struct Probe {
+			int64_t hash;
+			std::size_t index;
+
+			bool operator<(const Probe& other) const noexcept {
+				return hash < other.hash;
+			}
+		};
+
+		struct BulkEntry {
+			int64_t hash;
+			std::size_t offset, keyLength, valueLength;
+
+			bool operator<(const BulkEntry& other) const noexcept {
+				return hash < other.hash;
+			}
+		};
+
+		std::string makeBatchQuery(std::string_view table, std::string_view columns) {
+			std::string query = fmt::format("SELECT {} FROM \"{}\" WHERE \"hash\" IN (?", columns, table);
+			for (std::size_t i = 1; i < batch_width; ++i) {
+				query += ",?";
+			}
+			query += ");";
+			return query;
+		}
+	}
+
+	std::size_t KVStore::lookupMany(const Table& table, const std::string_view* names, std::size_t count, bool values, const LookupCallback& callback) const {
+		if (!data->db || count == 0) {
+			return 0;
+		}
+
+		std::optional<SQLite::Statement>& cached = values ? table.getManyStmt : table.containsManyStmt;
+		if (!cached) {
+			cached.emplace(
+				data->db.value(),
+				makeBatchQuery(table.sql, values ? "\"hash\", \"key\", \"value\"" : "\"hash\", \"key\"")
+			);
+		}
+		SQLite::Statement& stmt = cached.value();
+
+		KVOpTimer timer(data->status, values ? KVOp::Get : KVOp::Contains);
+		timer.count = count;
+
+		// Hash everything first, then sort so that each chunk is a contiguous run of the primary key.
+		std::vector<Probe> probes;
+		probes.reserve(count);
+		for (std::size_t i = 0; i < count; ++i) {
+			int64_t hash = hashKey(names[i]);
+			if (!filterRejects(table, hash)) {
+				probes.push_back(Probe{ hash, i });
+			}
+		}
+		std::sort(probes.begin(), probes.end());
+
+		std::size_t found = 0;
+		// Requests whose home slot holds a different key, these are probed one by one afterwards.
+		std::vector<std::size_t> displaced;
+		auto first = probes.begin();
+		while (first != probes.end()) {
+			// Bind up to batch_width distinct hashes.
+			stmt.reset();
+			auto last = first;
+			int param = 0;
+			while (last != probes.end() && param < static_cast<int>(batch_width)) {
+				int64_t hash = last->hash;
+				stmt.bind(++param, hash);
+				while (last != probes.end() && last->hash == hash) {
+					++last;
+				}
+			}
+			int64_t pad = std::prev(last)->hash;
+			while (param < static_cast<int>(batch_width)) {
+				stmt.bind(++param, pad);
+			}
+
+			while (stmt.executeStep()) {
+				int64_t hash = stmt.getColumn(0).getInt64();
+				SQLite::Column key = stmt.getColumn(1);
+
+				std::string_view value;
+				bool decoded = !values;
+
+				auto range = std::equal_range(first, last, Probe{ hash, 0 });
+				for (auto it = range.first; it != range.second; ++it) {
+					if (!kvkeyequal(key.getBlob(), key.getBytes(), names[it->index])) {
+						displaced.push_back(it->index);
+						continue;
+					}
+					if (!decoded) {
+						SQLite::Column col = stmt.getColumn(2);
+						value = decodeValue(std::string_view((const char*)col.getBlob(), col.getBytes()));
+						decoded = true;
+					}
+					callback(it->index, value);
+					timer.bytesRead += value.length();
+					++found;
+				}
+			}
+
+			first = last;
+		}
+		stmt.reset();
+
+		if (data->filter && table.id == 0) {
+			data->filterStats.falsePositives += probes.size() - found - displaced.size();
+		}
+
+		for (std::size_t index : displaced) {
+			std::string_view value;
+			bool copied;
+			int64_t slot;
+			if (values ? lookup(table, names[index], value, copied) : findSlot(table, names[index], hashKey(names[index]), slot)) {
+				callback(index, value);
+				timer.bytesRead += value.length();
+				++found;
+			}
+		}
+
+		return found;
+	}
+
+	std::size_t KVStore::containsMany(const std::string_view* names, std::size_t count, std::vector<bool>& found) const {
+		found.assign(count, false);
+		return lookupMany(data->main, names, count, false, [&](std::size_t index, std::string_view) {
+			found[index] = true;
+		});
+	}
+	std::size_t KVStore::containsMany(const std::vector<std::string_view>& names, std::vector<bool>& found) const {
+		return containsMany(names.data(), names.size(), found);
+	}
+
+	std::size_t KVStore::getMany(const std::string_view* names, std::size_t count, KVBatchResult& result) const {
+		result.reset(count);
+		return lookupMany(data->main, names, count, true, [&](std::size_t index, std::string_view value) {
+			result.assign(index, value);
+		});
+	}
+	std::size_t KVStore::getMany(const std::vector<std::string_view>& names, KVBatchResult& result) const {
+		return getMany(names.data(), names.size(), result);
+	}
+
+	std::size_t KVStore::getViewMany(const std::string_view* names, std::size_t count, const LookupCallback& callback) const {
+		return lookupMany(data->main, names, count, true, callback);
+	}
+	std::size_t KVStore::getViewMany(const std::vector<std::string_view>& names, const LookupCallback& callback) const {
+		return getViewMany(names.data(), names.size(), callback);
+	}
+
+	KVBulkStats KVStore::bulkLoad(const BulkSource& source, const KVBulkOptions& options) {
+		KVBulkStats stats;
+		if (!data->db) {
+			return stats;
+		}
+
+		using clock_t = std::chrono::steady_clock;
+		clock_t::time_point start = clock_t::now();
+
+		std::size_t chunkEntries = std::max(options.chunkEntries, std::size_t(1));
+
+		// Keys and values are copied into a single arena, so the source is free to reuse its buffers.
+		std::string arena;
+		std::vector<BulkEntry> chunk;
+		chunk.reserve(std::min(chunkEntries, std::size_t(1) << 16));
+
+		auto flush = [&]() {
+			if (chunk.empty()) {
+				return;
+			}
+
+			// Stable, so that later duplicates are written last and win.
+			std::stable_sort(chunk.begin(), chunk.end());
+
+			std::optional<SQLite::Transaction> transaction;
+			if (!inBatch()) {
+				transaction.emplace(data->db.value());
+			}
+
+			for (const BulkEntry& entry : chunk) {
+				const char* key = arena.data() + entry.offset;
+
+				SQLite::Statement& stmt = setStatement(data->main);
+				stmt.bind(2, (const void*)key, static_cast<int>(entry.keyLength));
+				std::string_view value = encodeValue(std::string_view(key + entry.keyLength, entry.valueLength));
+				stmt.bind(3, (const void*)value.data(), static_cast<int>(value.length()));
+				bool inserted = storeSlot(data->main, stmt, std::string_view(key, entry.keyLength), entry.hash);
+
+				if (data->cache) {
+					data->cache->erase(entry.hash);
+				}
+				if (inserted) {
+					filterInsert(data->main, entry.hash);
+				}
+			}
+			data->main.setStmt.value().reset();
+
+			if (transaction) {
+				transaction.value().commit();
+			}
+
+			++stats.chunks;
+			chunk.clear();
+			arena.clear();
+		};
+
+		KVEntryView entry;
+		while (source(entry)) {
+			chunk.push_back(BulkEntry{ hashKey(entry.key), arena.size(), entry.key.length(), entry.value.length() });
+			arena.append(entry.key.data(), entry.key.length());
+			arena.append(entry.value.data(), entry.value.length());
+
+			++stats.entries;
+			stats.bytes += entry.key.length() + entry.value.length();
+
+			if (chunk.size() >= chunkEntries || arena.size() >= options.chunkBytes) {
+				flush();
+			}
+		}
+		flush();
+
+		clock_t::duration elapsed = clock_t::now() - start;
+		stats.seconds = std::chrono::duration<double>(elapsed).count();
+		data->status.record(KVOp::Set, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed), stats.entries, 0, stats.bytes);
+		return stats;
+	}
+}
\ No newline at end of file
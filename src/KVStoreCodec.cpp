@@ -0,0 +1,147 @@
+#include <ez/KVStore.hpp>
+
+#include <cassert>
+#include <fmt/core.h>
+#include <fmt/format.h>
+
+namespace ez {
+	bool KVStore::hasCodec() const {
+		return bool(data->codec);
+	}
+
+	bool KVStore::enableCodec(std::size_t threshold) {
+		if (!isOpen()) {
+			return false;
+		}
+
+		SQLite::Database& db = data->db.value();
+		if (!data->codec) {
+			finishReads();
+
+			db.exec("SAVEPOINT ez_kvstore_codec;");
+			try {
+				// Existing values become raw values, with the header in front, in the named tables as well.
+				std::vector<std::string> tables{ "main" };
+				{
+					SQLite::Statement stmt(db, "SELECT \"name\" FROM sqlite_master WHERE \"type\" = 'table' AND \"name\" GLOB 'ez_kvstore_table_*';");
+					while (stmt.executeStep()) {
+						tables.push_back(stmt.getColumn(0).getString());
+					}
+				}
+				for (const std::string& table : tables) {
+					db.exec(fmt::format("UPDATE \"{}\" SET \"value\" = CAST(X'00' || \"value\" AS BLOB);", table));
+				}
+
+				SQLite::Statement stmt{
+					db,
+					"INSERT INTO ez_kvstore_meta(\"key\", \"value\") VALUES ('codec', ?);"
+				};
+				stmt.bind(1, static_cast<int64_t>(threshold));
+				stmt.exec();
+				db.exec("RELEASE ez_kvstore_codec;");
+			}
+			catch (...) {
+				db.exec("ROLLBACK TO ez_kvstore_codec;");
+				db.exec("RELEASE ez_kvstore_codec;");
+				throw;
+			}
+			loadCodec();
+		}
+		else {
+			// The threshold in the file stays as it was first enabled with.
+			data->codec->threshold = threshold;
+		}
+		return true;
+	}
+
+	void KVStore::setCodec(std::shared_ptr<const KVCodec> codec) {
+		if (!codec) {
+			return;
+		}
+
+		data->customCodecs.push_back(codec);
+		if (data->codec) {
+			data->codec->use(std::move(codec));
+		}
+	}
+
+	bool KVStore::trainDictionary(std::size_t size, std::size_t samples) {
+		if (!isOpen() || !data->codec || data->codec->dictionary()) {
+			return false;
+		}
+
+		std::vector<std::string> values;
+		{
+			SQLite::Statement stmt{
+				data->db.value(),
+				"SELECT \"value\" FROM \"main\" ORDER BY random() LIMIT ?;"
+			};
+			stmt.bind(1, static_cast<int64_t>(samples));
+			while (stmt.executeStep()) {
+				SQLite::Column col = stmt.getColumn(0);
+				values.emplace_back(decodeValue(std::string_view((const char*)col.getBlob(), col.getBytes())));
+			}
+		}
+
+		std::vector<std::string_view> views(values.begin(), values.end());
+		std::string dictionary = KVLZCodec::train(views, size);
+		if (dictionary.empty()) {
+			return false;
+		}
+
+		SQLite::Statement stmt{
+			data->db.value(),
+			"INSERT OR REPLACE INTO ez_kvstore_meta(\"key\", \"value\") VALUES ('dictionary', ?);"
+		};
+		stmt.bind(1, dictionary.data(), static_cast<int>(dictionary.size()));
+		stmt.exec();
+
+		data->codec->setDictionary(dictionary);
+		return true;
+	}
+
+	void KVStore::loadCodec() {
+		data->codec.reset();
+
+		SQLite::Statement stmt{
+			data->db.value(),
+			"SELECT \"key\", \"value\" FROM ez_kvstore_meta WHERE \"key\" IN ('codec', 'dictionary') ORDER BY \"key\";"
+		};
+
+		while (stmt.executeStep()) {
+			std::string key = stmt.getColumn(0).getString();
+			SQLite::Column col = stmt.getColumn(1);
+
+			if (key == "codec") {
+				data->codec = std::make_shared<KVValueCodec>(static_cast<std::size_t>(col.getInt64()));
+				for (const std::shared_ptr<const KVCodec>& codec : data->customCodecs) {
+					data->codec->use(codec);
+				}
+			}
+			else if (key == "dictionary" && data->codec) {
+				data->codec->setDictionary(std::string_view((const char*)col.getBlob(), col.getBytes()));
+			}
+		}
+	}
+
+	std::string_view KVStore::encodeValue(std::string_view value) const {
+		if (!data->codec) {
+			return value;
+		}
+		return data->codec->encode(value, data->encodeBuffer);
+	}
+	std::string_view KVStore::decodeValue(std::string_view stored) const {
+		if (!data->codec) {
+			return stored;
+		}
+
+		std::string_view value;
+		if (!data->codec->decode(stored, value, data->decodeBuffer)) {
+			throw std::logic_error(fmt::format(
+				"ez::KVStore failed to decode a value encoded with codec {}!",
+				KVValueCodec::header(stored)
+			));
+		}
+		return value;
+	}
+}
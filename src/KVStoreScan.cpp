@@ -0,0 +1,217 @@
+#include <ez/KVStore.hpp>
+
+#include <algorithm>
+#include <exception>
+#include <limits>
+#include <thread>
+
+#include "status.hpp"
+
+namespace ez {
+	namespace {
+		// Inclusive range of the hash space.
+		struct Partition {
+			int64_t first, last;
+		};
+
+		std::size_t numPartitions(const KVScanOptions& options) {
+			if (options.partitions != 0) {
+				return options.partitions;
+			}
+			return std::max(std::thread::hardware_concurrency(), 1u);
+		}
+
+		// The hashes are uniformly distributed, so equal slices of the hash space hold roughly equal numbers of entries.
+		std::vector<Partition> splitHashes(std::size_t count) {
+			const uint64_t start = static_cast<uint64_t>(std::numeric_limits<int64_t>::min());
+			const uint64_t width = std::numeric_limits<uint64_t>::max() / count;
+
+			std::vector<Partition> result(count);
+			for (std::size_t i = 0; i < count; ++i) {
+				result[i].first = static_cast<int64_t>(start + width * i);
+				result[i].last = i + 1 == count
+					? std::numeric_limits<int64_t>::max()
+					: static_cast<int64_t>(start + width * (i + 1) - 1);
+			}
+			return result;
+		}
+
+		template<typename Func>
+		void scanRange(SQLite::Database& db, const Partition& partition, const KVValueCodec* codec, Func&& func) {
+			SQLite::Statement stmt(
+				db,
+				"SELECT \"key\", \"value\" FROM \"main\" WHERE \"hash\" BETWEEN ? AND ?;"
+			);
+			stmt.bind(1, partition.first);
+			stmt.bind(2, partition.last);
+
+			std::string buffer;
+			KVEntryView entry;
+			while (stmt.executeStep()) {
+				SQLite::Column key = stmt.getColumn(0);
+				SQLite::Column value = stmt.getColumn(1);
+				entry.key = std::string_view((const char*)key.getBlob(), key.getBytes());
+				entry.value = std::string_view((const char*)value.getBlob(), value.getBytes());
+
+				if (codec && !codec->decode(entry.value, entry.value, buffer)) {
+					throw std::logic_error("ez::KVStore failed to decode a value while scanning!");
+				}
+				func(entry);
+			}
+		}
+	}
+
+	void KVStore::scanPartitions(const KVScanOptions& options, const PartitionTask& task) const {
+		if (!isOpen()) {
+			return;
+		}
+
+		std::vector<Partition> partitions = splitHashes(numPartitions(options));
+		std::shared_ptr<const KVValueCodec> codec = data->codec;
+
+		// Summed per partition, so the workers never share a counter.
+		KVOpTimer timer(data->status, KVOp::Scan);
+		std::vector<uint64_t> bytes(partitions.size(), 0);
+		auto counted = [&](std::size_t i, const EntryFunc& func) {
+			return [&bytes, i, &func](const KVEntryView& entry) {
+				bytes[i] += entry.key.length() + entry.value.length();
+				func(entry);
+			};
+		};
+		auto total = [&]() {
+			for (uint64_t count : bytes) {
+				timer.bytesRead += count;
+			}
+		};
+
+		// Other connections can't see the changes of a batch in progress, and in memory databases can't be shared.
+		const std::string& filename = data->db->getFilename();
+		if (inBatch() || filename.empty() || filename == ":memory:" || partitions.size() == 1) {
+			for (std::size_t i = 0; i < partitions.size(); ++i) {
+				task(i, [&](const EntryFunc& func) {
+					scanRange(data->db.value(), partitions[i], codec.get(), counted(i, func));
+				});
+			}
+			total();
+			return;
+		}
+
+		int busyTimeout = data->db->execAndGet("PRAGMA busy_timeout;").getInt();
+
+		std::vector<std::exception_ptr> errors(partitions.size());
+		std::vector<std::thread> workers;
+		workers.reserve(partitions.size());
+		for (std::size_t i = 0; i < partitions.size(); ++i) {
+			workers.emplace_back([&, i]() {
+				try {
+					SQLite::Database db(filename, SQLite::OPEN_READONLY);
+					if (busyTimeout > 0) {
+						db.setBusyTimeout(busyTimeout);
+					}
+					task(i, [&](const EntryFunc& func) {
+						scanRange(db, partitions[i], codec.get(), counted(i, func));
+					});
+				}
+				catch (...) {
+					errors[i] = std::current_exception();
+				}
+			});
+		}
+		for (std::thread& worker : workers) {
+			worker.join();
+		}
+		total();
+
+		for (std::exception_ptr& error : errors) {
+			if (error) {
+				std::rethrow_exception(error);
+			}
+		}
+	}
+
+	void KVStore::parallelScan(const ScanVisitor& visitor, const KVScanOptions& options) const {
+		scanPartitions(options, [&](std::size_t partition, const PartitionScan& scan) {
+			scan([&](const KVEntryView& entry) {
+				visitor(partition, entry);
+			});
+		});
+	}
+
+	void KVStore::parallelScanBatches(const ScanBatchVisitor& visitor, const KVScanOptions& options) const {
+		const std::size_t batchSize = std::max(options.batchSize, std::size_t(1));
+
+		scanPartitions(options, [&](std::size_t partition, const PartitionScan& scan) {
+			// The views handed out by sqlite only last until the next row, so a batch is copied into an arena first.
+			std::string arena;
+			std::vector<std::size_t> lengths;
+			std::vector<KVEntryView> entries;
+
+			auto flush = [&]() {
+				if (lengths.empty()) {
+					return;
+				}
+
+				entries.resize(lengths.size() / 2);
+				const char* ptr = arena.data();
+				for (std::size_t i = 0; i < entries.size(); ++i) {
+					entries[i].key = std::string_view(ptr, lengths[i * 2]);
+					ptr += lengths[i * 2];
+					entries[i].value = std::string_view(ptr, lengths[i * 2 + 1]);
+					ptr += lengths[i * 2 + 1];
+				}
+				visitor(partition, entries.data(), entries.size());
+
+				arena.clear();
+				lengths.clear();
+			};
+
+			scan([&](const KVEntryView& entry) {
+				arena.append(entry.key.data(), entry.key.size());
+				arena.append(entry.value.data(), entry.value.size());
+				lengths.push_back(entry.key.size());
+				lengths.push_back(entry.value.size());
+				if (lengths.size() / 2 >= batchSize) {
+					flush();
+				}
+			});
+			flush();
+		});
+	}
+
+	std::vector<std::vector<KVEntry>> KVStore::getPartitions(const KVScanOptions& options) const {
+		std::vector<std::vector<KVEntry>> result(isOpen() ? numPartitions(options) : 0);
+
+		// Each worker only ever touches its own vector.
+		parallelScan([&](std::size_t partition, const KVEntryView& entry) {
+			result[partition].push_back(KVEntry{ std::string(entry.key), std::string(entry.value) });
+		}, options);
+
+		return result;
+	}
+	std::vector<KVEntry> KVStore::getEntries(const KVScanOptions& options) const {
+		std::vector<std::vector<KVEntry>> partitions = getPartitions(options);
+
+		std::size_t total = 0;
+		for (const std::vector<KVEntry>& partition : partitions) {
+			total += partition.size();
+		}
+
+		std::vector<KVEntry> result;
+		result.reserve(total);
+		for (std::vector<KVEntry>& partition : partitions) {
+			std::move(partition.begin(), partition.end(), std::back_inserter(result));
+		}
+		return result;
+	}
+	std::unordered_map<std::string, std::string> KVStore::getMap(const KVScanOptions& options) const {
+		std::vector<std::vector<KVEntry>> partitions = getPartitions(options);
+
+		std::unordered_map<std::string, std::string> result;
+		for (std::vector<KVEntry>& partition : partitions) {
+			for (KVEntry& entry : partition) {
+				result.emplace(std::move(entry.key), std::move(entry.value));
+			}
+		}
+		return result;
+	}
+}
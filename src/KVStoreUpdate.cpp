@@ -0,0 +1,262 @@
+#include <ez/KVStore.hpp>
+
+#include <fmt/core.h>
+#include <fmt/format.h>
+#include <sqlite3.h>
+
+#include "status.hpp"
+
+namespace ez {
+	struct KVStore::Update {
+		// Decode the stored value passed to a function, a null value decodes to nothing.
+		static bool decode(sqlite3_context* ctx, const Data& data, sqlite3_value* arg, std::string_view& value) {
+			if (sqlite3_value_type(arg) == SQLITE_NULL) {
+				value = std::string_view();
+				return true;
+			}
+
+			std::string_view stored((const char*)sqlite3_value_blob(arg), sqlite3_value_bytes(arg));
+			if (!data.codec) {
+				value = stored;
+				return true;
+			}
+			if (!data.codec->decode(stored, value, data.decodeBuffer)) {
+				sqlite3_result_error(ctx, "ez::KVStore failed to decode a value to update!", -1);
+				return false;
+			}
+			return true;
+		}
+		static void result(sqlite3_context* ctx, const Data& data, std::string_view value) {
+			if (data.codec) {
+				value = data.codec->encode(value, data.encodeBuffer);
+			}
+			sqlite3_result_blob(ctx, value.data(), static_cast<int>(value.length()), SQLITE_TRANSIENT);
+		}
+
+		// ez_kvstore_increment(stored, delta)
+		static void increment(sqlite3_context* ctx, int, sqlite3_value** argv) {
+			const Data& data = *static_cast<const Data*>(sqlite3_user_data(ctx));
+
+			std::string_view value;
+			if (!decode(ctx, data, argv[0], value)) {
+				return;
+			}
+
+			int64_t count = 0;
+			if (sqlite3_value_type(argv[0]) != SQLITE_NULL) {
+				if (value.length() != sizeof(count)) {
+					// Left as it is, the caller is told through the mismatch flag.
+					data.counterMismatch = true;
+					sqlite3_result_value(ctx, argv[0]);
+					return;
+				}
+				std::memcpy(&count, value.data(), sizeof(count));
+			}
+
+			// Wraps around instead of overflowing.
+			count = static_cast<int64_t>(static_cast<uint64_t>(count) + static_cast<uint64_t>(sqlite3_value_int64(argv[1])));
+			data.counter = count;
+			result(ctx, data, std::string_view((const char*)&count, sizeof(count)));
+		}
+
+		// ez_kvstore_append(stored, bytes)
+		static void append(sqlite3_context* ctx, int, sqlite3_value** argv) {
+			const Data& data = *static_cast<const Data*>(sqlite3_user_data(ctx));
+
+			std::string_view value;
+			if (!decode(ctx, data, argv[0], value)) {
+				return;
+			}
+
+			std::string& buffer = data.typedBuffer;
+			buffer.assign(value.data(), value.length());
+			buffer.append((const char*)sqlite3_value_blob(argv[1]), sqlite3_value_bytes(argv[1]));
+			result(ctx, data, buffer);
+		}
+
+		// ez_kvstore_equal(stored, expected)
+		static void equal(sqlite3_context* ctx, int, sqlite3_value** argv) {
+			const Data& data = *static_cast<const Data*>(sqlite3_user_data(ctx));
+
+			std::string_view value;
+			if (!decode(ctx, data, argv[0], value)) {
+				return;
+			}
+
+			std::string_view expected((const char*)sqlite3_value_blob(argv[1]), sqlite3_value_bytes(argv[1]));
+			sqlite3_result_int(ctx, value == expected ? 1 : 0);
+		}
+	};
+
+	void KVStore::installFunctions() {
+		sqlite3* handle = data->db->getHandle();
+		auto install = [&](const char* name, void(*func)(sqlite3_context*, int, sqlite3_value**)) {
+			// Only usable from statements prepared directly on the connection, not from triggers or views in the file.
+			int flags = SQLITE_UTF8 | SQLITE_DIRECTONLY;
+			if (sqlite3_create_function_v2(handle, name, 2, flags, data.get(), func, nullptr, nullptr, nullptr) != SQLITE_OK) {
+				throw std::logic_error(fmt::format("ez::KVStore failed to register the sql function {}!", name));
+			}
+		};
+
+		install("ez_kvstore_increment", &Update::increment);
+		install("ez_kvstore_append", &Update::append);
+		install("ez_kvstore_equal", &Update::equal);
+	}
+
+	SQLite::Statement& KVStore::updateStatement(std::optional<SQLite::Statement>& stmt, const char* query) const {
+		if (!stmt) {
+			stmt.emplace(data->db.value(), fmt::format(fmt::runtime(query), data->main.sql));
+		}
+		else {
+			stmt.value().reset();
+		}
+		return stmt.value();
+	}
+
+	bool KVStore::increment(std::string_view name, int64_t delta) {
+		int64_t value;
+		return increment(name, delta, value);
+	}
+	bool KVStore::increment(std::string_view name, int64_t delta, int64_t& value) {
+		if (!data->db) {
+			return false;
+		}
+
+		const Table& table = data->main;
+		KVOpTimer timer(data->status, KVOp::Set, name);
+		timer.bytesWritten = name.length() + sizeof(int64_t);
+		SQLite::Statement& stmt = updateStatement(
+			table.incrementStmt,
+			"INSERT INTO \"{}\" (\"hash\", \"key\", \"value\") "
+			"VALUES (?1, ?2, ez_kvstore_increment(NULL, ?3)) ON CONFLICT(\"hash\") "
+			"DO UPDATE SET \"value\"=ez_kvstore_increment(\"value\", ?3) WHERE \"key\"=excluded.\"key\";"
+		);
+
+		int64_t hv = hashKey(name);
+		stmt.bind(2, (const void*)name.data(), static_cast<int>(name.length()));
+		stmt.bind(3, delta);
+		data->counterMismatch = false;
+		bool inserted = storeSlot(table, stmt, name, hv);
+
+		if (data->counterMismatch) {
+			return false;
+		}
+		value = data->counter;
+
+		if (KVValueCache* cache = cacheOf(table)) {
+			cache->update(hv, name, std::string_view((const char*)&value, sizeof(value)));
+		}
+		if (inserted) {
+			filterInsert(table, hv);
+		}
+		return true;
+	}
+
+	bool KVStore::append(std::string_view name, std::string_view bytes) {
+		if (!data->db) {
+			return false;
+		}
+
+		const Table& table = data->main;
+		KVOpTimer timer(data->status, KVOp::Set, name);
+		timer.bytesWritten = name.length() + bytes.length();
+		SQLite::Statement& stmt = updateStatement(
+			table.appendStmt,
+			"INSERT INTO \"{}\" (\"hash\", \"key\", \"value\") "
+			"VALUES (?1, ?2, ez_kvstore_append(NULL, ?3)) ON CONFLICT(\"hash\") "
+			"DO UPDATE SET \"value\"=ez_kvstore_append(\"value\", ?3) WHERE \"key\"=excluded.\"key\";"
+		);
+
+		int64_t hv = hashKey(name);
+		stmt.bind(2, (const void*)name.data(), static_cast<int>(name.length()));
+		stmt.bind(3, (const void*)bytes.data(), static_cast<int>(bytes.length()));
+		bool inserted = storeSlot(table, stmt, name, hv);
+
+		if (KVValueCache* cache = cacheOf(table)) {
+			cache->erase(hv);
+		}
+		if (inserted) {
+			filterInsert(table, hv);
+		}
+		return true;
+	}
+
+	bool KVStore::compareAndSet(std::string_view name, std::string_view expected, std::string_view desired) {
+		if (!data->db) {
+			return false;
+		}
+
+		const Table& table = data->main;
+		KVOpTimer timer(data->status, KVOp::Set, name);
+		SQLite::Statement& stmt = updateStatement(
+			table.compareStmt,
+			"UPDATE \"{}\" SET \"value\" = ?3 "
+			"WHERE \"hash\" = ?1 AND \"key\" = ?2 AND ez_kvstore_equal(\"value\", ?4);"
+		);
+
+		int64_t hv = hashKey(name);
+		stmt.bind(1, hv);
+		stmt.bind(2, (const void*)name.data(), static_cast<int>(name.length()));
+		std::string_view stored = encodeValue(desired);
+		stmt.bind(3, (const void*)stored.data(), static_cast<int>(stored.length()));
+		stmt.bind(4, (const void*)expected.data(), static_cast<int>(expected.length()));
+
+		bool replaced = stmt.exec() == 1;
+		if (!replaced) {
+			// Either a different value, or the key is stored further along the probe sequence.
+			int64_t slot;
+			if (findSlot(table, name, hv, slot) && slot != hv) {
+				stmt.reset();
+				stmt.bind(1, slot);
+				replaced = stmt.exec() == 1;
+			}
+		}
+		if (!replaced) {
+			return false;
+		}
+
+		timer.bytesWritten = name.length() + desired.length();
+		if (KVValueCache* cache = cacheOf(table)) {
+			cache->update(hv, name, desired);
+		}
+		return true;
+	}
+
+	bool KVStore::setIfAbsent(std::string_view name, std::string_view value) {
+		if (!data->db) {
+			return false;
+		}
+
+		const Table& table = data->main;
+		KVOpTimer timer(data->status, KVOp::Set, name);
+		SQLite::Statement& stmt = updateStatement(
+			table.insertStmt,
+			"INSERT INTO \"{}\" (\"hash\", \"key\", \"value\") "
+			"VALUES (?1, ?2, ?3) ON CONFLICT(\"hash\") DO NOTHING;"
+		);
+
+		int64_t hv = hashKey(name);
+		stmt.bind(1, hv);
+		stmt.bind(2, (const void*)name.data(), static_cast<int>(name.length()));
+		std::string_view stored = encodeValue(value);
+		stmt.bind(3, (const void*)stored.data(), static_cast<int>(stored.length()));
+
+		if (stmt.exec() == 0) {
+			// The home slot is taken, by this key or by another one, in which case this key goes in the first free slot after it.
+			int64_t slot;
+			if (findSlot(table, name, hv, slot)) {
+				return false;
+			}
+			stmt.reset();
+			stmt.bind(1, slot);
+			stmt.exec();
+		}
+
+		timer.bytesWritten = name.length() + value.length();
+		if (KVValueCache* cache = cacheOf(table)) {
+			cache->update(hv, name, value);
+		}
+		filterInsert(table, hv);
+		return true;
+	}
+}
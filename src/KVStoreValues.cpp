@@ -3,125 +3,250 @@
 #include <cassert>
 #include <iostream>
 #include <fmt/core.h>
+#include <sqlite3.h>
 #include "hashing.hpp"
+#include "schema.hpp"
+#include "status.hpp"
 
 namespace ez {
 	std::size_t KVStore::numValues() const {
+		return numValues(data->main);
+	}
+	std::size_t KVStore::numValues(const Table& table) const {
 		if (!data->db) {
 			return 0;
 		}
 
-		SQLite::Statement stmt(
-			data->db.value(),
-			"SELECT COUNT(*) FROM \"main\";"
-		);
+		if (table.id == 0 && !data->hasCounter) {
+			SQLite::Statement stmt(
+				data->db.value(),
+				"SELECT COUNT(*) FROM \"main\";"
+			);
+			bool res = stmt.executeStep();
+			assert(res == true);
+
+			int64_t val = stmt.getColumn(0).getInt64();
+			assert(val >= 0);
+			return static_cast<std::size_t>(val);
+		}
+
+		if (!table.countStmt) {
+			if (table.id == 0) {
+				table.countStmt.emplace(
+					data->db.value(),
+					"SELECT \"value\" FROM ez_kvstore_meta WHERE \"key\" = 'count';"
+				);
+			}
+			else {
+				// Named tables keep their count next to their name.
+				table.countStmt.emplace(
+					data->db.value(),
+					"SELECT \"count\" FROM ez_kvstore_tables WHERE \"id\" = ?;"
+				);
+				table.countStmt->bind(1, table.id);
+			}
+		}
+		else {
+			table.countStmt.value().reset();
+		}
+
+		SQLite::Statement& stmt = table.countStmt.value();
 		bool res = stmt.executeStep();
 		assert(res == true);
 
 		int64_t val = stmt.getColumn(0).getInt64();
 		assert(val >= 0);
+		stmt.reset();
 		return static_cast<std::size_t>(val);
 	}
 
 	bool KVStore::contains(std::string_view name) const {
+		return contains(data->main, name);
+	}
+	bool KVStore::contains(const Table& table, std::string_view name) const {
 		if (!data->db) {
 			return false;
 		}
 
-		if (!data->containsStmt) {
-			data->containsStmt.emplace(
-				data->db.value(),
-				"SELECT 1 WHERE EXISTS (SELECT * FROM \"main\" WHERE \"hash\" = ?);"
-			);
+		KVOpTimer timer(data->status, KVOp::Contains, name);
+		int64_t hv = hashKey(name);
+		KVValueCache* cache = cacheOf(table);
+		if (cache && cache->find(hv, name)) {
+			return true;
 		}
-		else {
-			data->containsStmt.value().reset();
+		if (filterRejects(table, hv)) {
+			return false;
 		}
 
-		SQLite::Statement& stmt = data->containsStmt.value();
-
-		stmt.bind(1, kvhash(name));
-
-		return stmt.executeStep();
+		int64_t slot;
+		if (findSlot(table, name, hv, slot)) {
+			return true;
+		}
+		if (data->filter && table.id == 0) {
+			++data->filterStats.falsePositives;
+		}
+		return false;
 	}
 
 	bool KVStore::getRaw(std::string_view name, const void*& raw, std::size_t& len) const {
+		return getRaw(data->main, name, raw, len);
+	}
+	bool KVStore::getRaw(const Table& table, std::string_view name, const void*& raw, std::size_t& len) const {
+		KVOpTimer timer(data->status, KVOp::Get, name);
+		std::string_view value;
+		bool copied;
+		if (lookup(table, name, value, copied)) {
+			raw = value.data();
+			len = value.length();
+			timer.bytesRead = len;
+			return true;
+		}
+		return false;
+	}
+
+	bool KVStore::lookup(const Table& table, std::string_view name, std::string_view& value, bool& copied) const {
 		if (data->db) {
-			if (!data->getStmt) {
-				data->getStmt.emplace(
+			int64_t hv = hashKey(name);
+			KVValueCache* cache = cacheOf(table);
+			if (cache) {
+				if (const std::string* cached = cache->find(hv, name)) {
+					value = *cached;
+					copied = true;
+					return true;
+				}
+			}
+			if (filterRejects(table, hv)) {
+				return false;
+			}
+
+			if (!table.getStmt) {
+				table.getStmt.emplace(
 					data->db.value(),
-					"SELECT \"value\" FROM \"main\" WHERE \"hash\" = ?"
+					fmt::format("SELECT \"key\", \"value\" FROM \"{}\" WHERE \"hash\" = ?", table.sql)
 				);
 			}
-			else {
-				data->getStmt.value().reset();
-			}
+			SQLite::Statement& stmt = table.getStmt.value();
+
+			// Almost always a single seek, the following slots are only probed when another key holds this one.
+			for (int64_t slot = hv; ; slot = kvprobe(slot)) {
+				stmt.reset();
+				stmt.bind(1, slot);
+				if (!stmt.executeStep()) {
+					break;
+				}
 
-			SQLite::Statement& stmt = data->getStmt.value();
+				SQLite::Column key = stmt.getColumn(0);
+				if (!kvkeyequal(key.getBlob(), key.getBytes(), name)) {
+					continue;
+				}
 
-			stmt.bind(1, kvhash(name));
-			if (stmt.executeStep()) {
-				SQLite::Column col = stmt.getColumn(0);
-				raw = col.getBlob();
-				len = static_cast<std::size_t>(col.getBytes());
+				SQLite::Column col = stmt.getColumn(1);
+				std::string_view stored((const char*)col.getBlob(), col.getBytes());
+				value = decodeValue(stored);
+				// Raw values in a store with codecs enabled still point into the stored bytes, just past the header.
+				copied = value.data() != stored.data() && value.data() != stored.data() + 1;
+
+				if (cache) {
+					cache->insert(hv, name, value);
+				}
 
 				return true;
 			}
-			else {
-				return false;
+
+			if (data->filter && table.id == 0) {
+				++data->filterStats.falsePositives;
 			}
+			return false;
 		}
 		else {
 			return false;
 		}
 	}
 
-	bool KVStore::setRaw(std::string_view key, const void* raw, std::size_t len) {
-		if (!data->db) {
-			return false;
-		}
-		
-		if (!data->setStmt) {
-			data->setStmt.emplace(
+	SQLite::Statement& KVStore::setStatement(const Table& table) const {
+		if (!table.setStmt) {
+			table.setStmt.emplace(
 				data->db.value(),
-				"INSERT INTO \"main\" (\"hash\", \"key\", \"value\") "
-				"VALUES (?, ?, ?) ON CONFLICT(\"hash\") "
-				"DO UPDATE SET \"value\"=excluded.\"value\";"
+				fmt::format(
+					"INSERT INTO \"{}\" (\"hash\", \"key\", \"value\") "
+					"VALUES (?, ?, ?) ON CONFLICT(\"hash\") "
+					"DO UPDATE SET \"value\"=excluded.\"value\" WHERE \"key\"=excluded.\"key\";",
+					table.sql
+				)
 			);
 		}
 		else {
-			data->setStmt.value().reset();
+			table.setStmt.value().reset();
+		}
+
+		return table.setStmt.value();
+	}
+
+	bool KVStore::setRaw(std::string_view key, const void* raw, std::size_t len) {
+		return setRaw(data->main, key, raw, len);
+	}
+	bool KVStore::setRaw(const Table& table, std::string_view key, const void* raw, std::size_t len) {
+		if (!data->db) {
+			return false;
 		}
 
-		SQLite::Statement& stmt = data->setStmt.value();
+		KVOpTimer timer(data->status, KVOp::Set, key);
+		timer.bytesWritten = key.length() + len;
+		SQLite::Statement& stmt = setStatement(table);
 
-		stmt.bind(1, kvhash(key));
+		int64_t hv = hashKey(key);
 		stmt.bind(2, key.data(), key.length());
-		stmt.bind(3, raw, len);
-		bool res = stmt.executeStep();
-		assert(res == false);
+		std::string_view stored = encodeValue(std::string_view((const char*)raw, len));
+		stmt.bind(3, stored.data(), static_cast<int>(stored.length()));
+		bool inserted = storeSlot(table, stmt, key, hv);
+
+		if (KVValueCache* cache = cacheOf(table)) {
+			cache->update(hv, key, std::string_view((const char*)raw, len));
+		}
+		// Overwrites are already in the filter.
+		if (inserted) {
+			filterInsert(table, hv);
+		}
 
 		return true;
 	}
 
 
 	bool KVStore::erase(std::string_view name) {
+		return erase(data->main, name);
+	}
+	bool KVStore::erase(const Table& table, std::string_view name) {
 		if (data->db) {
-			if (!data->eraseStmt) {
-				data->eraseStmt.emplace(
+			if (!table.eraseStmt) {
+				table.eraseStmt.emplace(
 					data->db.value(),
-					"DELETE FROM \"main\" WHERE \"hash\" = ?;"
+					fmt::format("DELETE FROM \"{}\" WHERE \"hash\" = ? AND \"key\" = ?;", table.sql)
 				);
 			}
-			else {
-				data->eraseStmt.value().reset();
-			}
+			SQLite::Statement& stmt = table.eraseStmt.value();
 
-			SQLite::Statement& stmt = data->eraseStmt.value();
+			KVOpTimer timer(data->status, KVOp::Erase, name);
+			int64_t hv = hashKey(name);
+			if (KVValueCache* cache = cacheOf(table)) {
+				cache->erase(hv);
+			}
 
-			stmt.bind(1, kvhash(name));
+			int64_t slot = hv;
+			stmt.reset();
+			stmt.bind(1, slot);
+			stmt.bind(2, (const void*)name.data(), static_cast<int>(name.length()));
+			if (stmt.exec() == 0) {
+				// Either missing, or stored further along the probe sequence.
+				if (!findSlot(table, name, hv, slot)) {
+					return false;
+				}
+				stmt.reset();
+				stmt.bind(1, slot);
+				stmt.exec();
+			}
 
-			return stmt.exec() == 1;
+			closeGap(table, slot);
+			return true;
 		}
 		else {
 			return false;
@@ -129,34 +254,200 @@ namespace ez {
 	}
 
 	void KVStore::clear() {
+		clear(data->main);
+	}
+	void KVStore::clear(const Table& table) {
 		if (!data->db) {
 			return;
 		}
 
-		SQLite::Statement stmt(
-			data->db.value(),
-			"DELETE FROM \"main\";"
-		);
-		stmt.exec();
+		if (table.id != 0) {
+			// Cheaper to start over with an empty table than to delete row by row through the count triggers,
+			// but sqlite refuses to drop tables while a scan or blob is still open on the connection.
+			finishReads();
+			bool busy = hasBusyStatements();
+
+			SQLite::Database& db = data->db.value();
+			db.exec("SAVEPOINT ez_kvstore_clear;");
+			try {
+				if (busy) {
+					db.exec(fmt::format("DELETE FROM \"{}\";", table.sql));
+				}
+				else {
+					db.exec(fmt::format("DROP TABLE \"{}\";", table.sql));
+					createNamedTable(table.id);
+				}
+				db.exec(fmt::format("UPDATE ez_kvstore_tables SET \"count\" = 0 WHERE \"id\" = {};", table.id));
+				db.exec("RELEASE ez_kvstore_clear;");
+			}
+			catch (...) {
+				db.exec("ROLLBACK TO ez_kvstore_clear;");
+				db.exec("RELEASE ez_kvstore_clear;");
+				throw;
+			}
+			return;
+		}
+
+		if (data->hasCounter) {
+			// Drop the delete trigger for the duration, so sqlite can truncate the table instead of deleting row by row.
+			finishReads();
+
+			SQLite::Database& db = data->db.value();
+			db.exec("SAVEPOINT ez_kvstore_clear;");
+			try {
+				db.exec("DROP TRIGGER IF EXISTS ez_kvstore_count_delete;");
+				db.exec("DELETE FROM \"main\";");
+				db.exec("UPDATE ez_kvstore_meta SET \"value\" = 0 WHERE \"key\" = 'count';");
+				db.exec(schema::count_delete_trigger);
+				db.exec("RELEASE ez_kvstore_clear;");
+			}
+			catch (...) {
+				db.exec("ROLLBACK TO ez_kvstore_clear;");
+				db.exec("RELEASE ez_kvstore_clear;");
+				throw;
+			}
+		}
+		else {
+			SQLite::Statement stmt(
+				data->db.value(),
+				"DELETE FROM \"main\";"
+			);
+			stmt.exec();
+		}
+
+		if (data->cache) {
+			data->cache->clear();
+		}
+		if (data->filter) {
+			data->filter->clear();
+		}
 	}
 
 	bool KVStore::rename(std::string_view old, std::string_view name) {
-		if (!data->db || contains(name)) {
+		return rename(data->main, old, name);
+	}
+	bool KVStore::rename(const Table& table, std::string_view old, std::string_view name) {
+		if (!data->db) {
+			return false;
+		}
+
+		KVOpTimer timer(data->status, KVOp::Rename, old);
+		int64_t oldhv = hashKey(old);
+		int64_t namehv = hashKey(name);
+		int64_t from, to;
+		if (!findSlot(table, old, oldhv, from) || findSlot(table, name, namehv, to)) {
 			return false;
 		}
 
 		SQLite::Statement stmt(
 			data->db.value(),
-			"UPDATE \"main\" SET \"hash\" = ?, \"key\" = ? WHERE \"hash\" = ?;"
+			fmt::format("UPDATE \"{}\" SET \"hash\" = ?, \"key\" = ? WHERE \"hash\" = ?;", table.sql)
 		);
 
-		int64_t oldhv = kvhash(old);
-		int64_t namehv = kvhash(name);
-
-		stmt.bind(1, namehv);
+		stmt.bind(1, to);
 		stmt.bind(2, (const void*)name.data(), name.length());
-		stmt.bind(3, oldhv);
+		stmt.bind(3, from);
+
+		if (KVValueCache* cache = cacheOf(table)) {
+			cache->erase(oldhv);
+			cache->erase(namehv);
+		}
 
-		return stmt.exec() == 1;
+		if (stmt.exec() == 1) {
+			closeGap(table, from);
+			filterInsert(table, namehv);
+			return true;
+		}
+		return false;
+	}
+
+	int64_t KVStore::hashKey(std::string_view name) const {
+		return data->legacyHash ? kvhash_legacy(name) : kvhash(name);
+	}
+
+	SQLite::Statement& KVStore::slotStatement(const Table& table) const {
+		if (!table.containsStmt) {
+			table.containsStmt.emplace(
+				data->db.value(),
+				fmt::format("SELECT \"key\" FROM \"{}\" WHERE \"hash\" = ?;", table.sql)
+			);
+		}
+		return table.containsStmt.value();
+	}
+
+	bool KVStore::findSlot(const Table& table, std::string_view name, int64_t hash, int64_t& slot) const {
+		SQLite::Statement& stmt = slotStatement(table);
+
+		for (slot = hash; ; slot = kvprobe(slot)) {
+			stmt.reset();
+			stmt.bind(1, slot);
+			if (!stmt.executeStep()) {
+				stmt.reset();
+				return false;
+			}
+
+			SQLite::Column key = stmt.getColumn(0);
+			if (kvkeyequal(key.getBlob(), key.getBytes(), name)) {
+				stmt.reset();
+				return true;
+			}
+		}
+	}
+
+	bool KVStore::storeSlot(const Table& table, SQLite::Statement& stmt, std::string_view name, int64_t hash) {
+		// The upsert only overwrites a slot holding the same key.
+		// Updating leaves the last insert rowid alone, so it tells whether the row was inserted.
+		sqlite3* handle = data->db->getHandle();
+		sqlite3_set_last_insert_rowid(handle, ~hash);
+		stmt.bind(1, hash);
+		if (stmt.exec() == 0) {
+			int64_t slot;
+			bool found = findSlot(table, name, hash, slot);
+			stmt.reset();
+			stmt.bind(1, slot);
+			stmt.exec();
+			return !found;
+		}
+		return sqlite3_last_insert_rowid(handle) == hash;
+	}
+
+	void KVStore::closeGap(const Table& table, int64_t slot) {
+		// Linear probing needs the probe sequences to stay unbroken, so later entries that can't be found
+		// without passing through the freed slot are shifted back into it.
+		SQLite::Statement& stmt = slotStatement(table);
+		std::optional<SQLite::Statement> move;
+
+		int64_t hole = slot;
+		for (int64_t next = kvprobe(slot); ; next = kvprobe(next)) {
+			stmt.reset();
+			stmt.bind(1, next);
+			if (!stmt.executeStep()) {
+				break;
+			}
+
+			SQLite::Column key = stmt.getColumn(0);
+			int64_t home = hashKey(std::string_view((const char*)key.getBlob(), key.getBytes()));
+
+			// The entry stays if its home lies between the hole and itself.
+			uint64_t distance = static_cast<uint64_t>(next) - static_cast<uint64_t>(hole);
+			uint64_t offset = static_cast<uint64_t>(home) - static_cast<uint64_t>(hole);
+			if (offset != 0 && offset <= distance) {
+				continue;
+			}
+
+			stmt.reset();
+			if (!move) {
+				move.emplace(
+					data->db.value(),
+					fmt::format("UPDATE \"{}\" SET \"hash\" = ? WHERE \"hash\" = ?;", table.sql)
+				);
+			}
+			move->reset();
+			move->bind(1, hole);
+			move->bind(2, next);
+			move->exec();
+			hole = next;
+		}
+		stmt.reset();
 	}
-}
\ No newline at end of file
+}
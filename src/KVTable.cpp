@@ -0,0 +1,308 @@
+#include <ez/KVTable.hpp>
+
+#include <fmt/core.h>
+#include <fmt/format.h>
+#include <sqlite3.h>
+
+#include "schema.hpp"
+#include "status.hpp"
+
+namespace ez {
+	KVTable KVStore::table(std::string_view name) {
+		return KVTable(this, name);
+	}
+	bool KVStore::hasTable(std::string_view name) const {
+		return findTable(name, false) != nullptr;
+	}
+	std::vector<std::string> KVStore::tableNames() const {
+		std::vector<std::string> names;
+		if (!isOpen()) {
+			return names;
+		}
+
+		SQLite::Database& db = data->db.value();
+		if (!db.tableExists("ez_kvstore_tables")) {
+			return names;
+		}
+
+		SQLite::Statement stmt(db, "SELECT \"name\" FROM ez_kvstore_tables ORDER BY \"name\";");
+		while (stmt.executeStep()) {
+			SQLite::Column col = stmt.getColumn(0);
+			names.emplace_back((const char*)col.getBlob(), col.getBytes());
+		}
+		return names;
+	}
+	bool KVStore::dropTable(std::string_view name) {
+		Table* table = findTable(name, false);
+		if (!table) {
+			return false;
+		}
+
+		// Statements on the table keep it from being dropped, and sqlite refuses any drop while a scan or blob is open on the connection.
+		finishReads();
+		if (hasBusyStatements()) {
+			return false;
+		}
+		int64_t id = table->id;
+		std::string sql = table->sql;
+		data->tables.erase(data->tables.find(name));
+
+		SQLite::Database& db = data->db.value();
+		db.exec("SAVEPOINT ez_kvstore_drop;");
+		try {
+			// Dropping the table drops its triggers too.
+			db.exec(fmt::format("DROP TABLE \"{}\";", sql));
+			db.exec(fmt::format("DELETE FROM ez_kvstore_tables WHERE \"id\" = {};", id));
+			db.exec("RELEASE ez_kvstore_drop;");
+		}
+		catch (...) {
+			db.exec("ROLLBACK TO ez_kvstore_drop;");
+			db.exec("RELEASE ez_kvstore_drop;");
+			throw;
+		}
+		return true;
+	}
+
+	KVStore::Table* KVStore::findTable(std::string_view name, bool create) const {
+		if (!isOpen()) {
+			return nullptr;
+		}
+
+		auto it = data->tables.find(name);
+		if (it != data->tables.end()) {
+			return it->second.get();
+		}
+
+		// Not opened through this handle yet, or created by another connection.
+		SQLite::Database& db = data->db.value();
+		int64_t id = 0;
+		if (db.tableExists("ez_kvstore_tables")) {
+			SQLite::Statement stmt(db, "SELECT \"id\" FROM ez_kvstore_tables WHERE \"name\" = ?;");
+			stmt.bind(1, (const void*)name.data(), static_cast<int>(name.length()));
+			if (stmt.executeStep()) {
+				id = stmt.getColumn(0).getInt64();
+			}
+		}
+
+		if (id == 0) {
+			// Named tables only exist in the current layout, older files have to be upgraded first.
+			if (!create || data->legacyHash || sqlite3_db_readonly(db.getHandle(), "main") == 1) {
+				return nullptr;
+			}
+
+			db.exec("SAVEPOINT ez_kvstore_table;");
+			try {
+				db.exec(schema::tables_table);
+
+				SQLite::Statement stmt(db, "INSERT INTO ez_kvstore_tables(\"name\") VALUES (?);");
+				stmt.bind(1, (const void*)name.data(), static_cast<int>(name.length()));
+				stmt.exec();
+				id = db.getLastInsertRowid();
+
+				createNamedTable(id);
+				db.exec("RELEASE ez_kvstore_table;");
+			}
+			catch (...) {
+				db.exec("ROLLBACK TO ez_kvstore_table;");
+				db.exec("RELEASE ez_kvstore_table;");
+				throw;
+			}
+		}
+
+		std::unique_ptr<Table> table{ new Table() };
+		table->sql = fmt::format("ez_kvstore_table_{}", id);
+		table->id = id;
+		return data->tables.emplace(std::string(name), std::move(table)).first->second.get();
+	}
+	void KVStore::createNamedTable(int64_t id) const {
+		SQLite::Database& db = data->db.value();
+
+		db.exec(fmt::format(
+			"CREATE TABLE \"ez_kvstore_table_{0}\"("
+			"\"hash\" INTEGER UNIQUE, "
+			"\"key\" BLOB NOT NULL, "
+			"\"value\" BLOB NOT NULL, "
+			"PRIMARY KEY(\"hash\"));",
+			id
+		));
+		db.exec(fmt::format(
+			"CREATE TRIGGER \"ez_kvstore_table_{0}_insert\" AFTER INSERT ON \"ez_kvstore_table_{0}\" BEGIN "
+				"UPDATE ez_kvstore_tables SET \"count\" = \"count\" + 1 WHERE \"id\" = {0}; "
+			"END;",
+			id
+		));
+		db.exec(fmt::format(
+			"CREATE TRIGGER \"ez_kvstore_table_{0}_delete\" AFTER DELETE ON \"ez_kvstore_table_{0}\" BEGIN "
+				"UPDATE ez_kvstore_tables SET \"count\" = \"count\" - 1 WHERE \"id\" = {0}; "
+			"END;",
+			id
+		));
+	}
+
+
+	KVTable::KVTable(KVStore* _store, std::string_view name)
+		: store(_store)
+		, tableName(name)
+	{
+		// Creates the table right away, so isOpen tells whether it can be used.
+		store->findTable(tableName, true);
+	}
+
+	const KVStore::Table* KVTable::find() const {
+		return store ? store->findTable(tableName, false) : nullptr;
+	}
+
+	bool KVTable::isOpen() const {
+		return find() != nullptr;
+	}
+	const std::string& KVTable::name() const noexcept {
+		return tableName;
+	}
+
+	std::size_t KVTable::numValues() const {
+		const KVStore::Table* table = find();
+		return table ? store->numValues(*table) : 0;
+	}
+	std::size_t KVTable::size() const {
+		return numValues();
+	}
+	bool KVTable::empty() const {
+		return numValues() == 0;
+	}
+
+	bool KVTable::contains(std::string_view name) const {
+		const KVStore::Table* table = find();
+		return table && store->contains(*table, name);
+	}
+	bool KVTable::get(std::string_view name, std::string& data) const {
+		const KVStore::Table* table = find();
+		const void* ptr;
+		std::size_t len;
+		if (table && store->getRaw(*table, name, ptr, len)) {
+			data.assign((const char*)ptr, len);
+			return true;
+		}
+		return false;
+	}
+	bool KVTable::getView(std::string_view name, std::string_view& data) const {
+		const KVStore::Table* table = find();
+		const void* ptr;
+		std::size_t len;
+		if (table && store->getRaw(*table, name, ptr, len)) {
+			data = std::string_view((const char*)ptr, len);
+			return true;
+		}
+		return false;
+	}
+	bool KVTable::getStream(std::string_view name, ez::imemstream& stream) const {
+		const KVStore::Table* table = find();
+		const void* ptr;
+		std::size_t len;
+		if (table && store->getRaw(*table, name, ptr, len)) {
+			stream.reset((const char*)ptr, len);
+			return true;
+		}
+		return false;
+	}
+
+	std::size_t KVTable::containsMany(const std::vector<std::string_view>& names, std::vector<bool>& found) const {
+		found.assign(names.size(), false);
+		const KVStore::Table* table = find();
+		if (!table) {
+			return 0;
+		}
+		return store->lookupMany(*table, names.data(), names.size(), false, [&](std::size_t index, std::string_view) {
+			found[index] = true;
+		});
+	}
+	std::size_t KVTable::getMany(const std::vector<std::string_view>& names, KVBatchResult& result) const {
+		result.reset(names.size());
+		const KVStore::Table* table = find();
+		if (!table) {
+			return 0;
+		}
+		return store->lookupMany(*table, names.data(), names.size(), true, [&](std::size_t index, std::string_view value) {
+			result.assign(index, value);
+		});
+	}
+
+	bool KVTable::set(std::string_view name, std::string_view data) {
+		const KVStore::Table* table = find();
+		return table && store->setRaw(*table, name, (const void*)data.data(), data.length());
+	}
+	bool KVTable::erase(std::string_view name) {
+		const KVStore::Table* table = find();
+		return table && store->erase(*table, name);
+	}
+	bool KVTable::rename(std::string_view old, std::string_view name) {
+		const KVStore::Table* table = find();
+		return table && store->rename(*table, old, name);
+	}
+	void KVTable::clear() {
+		if (const KVStore::Table* table = find()) {
+			store->clear(*table);
+		}
+	}
+
+	KVTable::const_iterator KVTable::begin() const {
+		const KVStore::Table* table = find();
+		if (!table) {
+			return const_iterator();
+		}
+		return const_iterator(KVEntryViewGenerator(store->data->db.value(), table->sql, store->data->codec));
+	}
+	KVTable::const_iterator KVTable::end() const {
+		return const_iterator();
+	}
+
+	KVTable::ordered_range KVTable::lowerBound(std::string_view key) const {
+		const KVStore::Table* table = find();
+		if (!table) {
+			return ordered_range(KVStore::ordered_iterator());
+		}
+		return ordered_range(KVStore::ordered_iterator(KVOrderedGenerator(store->data->db.value(), table->sql, key, std::nullopt, store->data->codec)));
+	}
+	KVTable::ordered_range KVTable::range(std::string_view first, std::string_view last) const {
+		const KVStore::Table* table = find();
+		if (!table) {
+			return ordered_range(KVStore::ordered_iterator());
+		}
+		return ordered_range(KVStore::ordered_iterator(KVOrderedGenerator(store->data->db.value(), table->sql, first, last, store->data->codec)));
+	}
+	KVTable::ordered_range KVTable::prefix(std::string_view prefix) const {
+		std::optional<std::string> last = KVStore::prefixEnd(prefix);
+		if (!last) {
+			return lowerBound(prefix);
+		}
+		return range(prefix, *last);
+	}
+
+	std::vector<KVEntry> KVTable::getEntries() const {
+		std::vector<KVEntry> result;
+		if (!store) {
+			return result;
+		}
+
+		KVOpTimer timer(store->data->status, KVOp::Scan);
+		result.reserve(size());
+		for (const KVEntryView& entry : *this) {
+			result.push_back(KVEntry{ std::string(entry.key), std::string(entry.value) });
+			timer.bytesRead += entry.key.length() + entry.value.length();
+		}
+		return result;
+	}
+	std::unordered_map<std::string, std::string> KVTable::getMap() const {
+		std::unordered_map<std::string, std::string> result;
+		if (!store) {
+			return result;
+		}
+
+		KVOpTimer timer(store->data->status, KVOp::Scan);
+		result.reserve(size());
+		for (const KVEntryView& entry : *this) {
+			result.insert(std::make_pair(std::string(entry.key), std::string(entry.value)));
+			timer.bytesRead += entry.key.length() + entry.value.length();
+		}
+		return result;
+	}
+}
@@ -0,0 +1,91 @@
+#include <ez/KVStore.hpp>
+
+#include <algorithm>
+
+namespace ez {
+	namespace {
+		// The header is the byte order, a zero byte, and the layout version in little endian.
+		void writeLayout(char* header, const KVLayout& layout) {
+			header[0] = static_cast<char>(layout.endian);
+			header[1] = 0;
+			header[2] = static_cast<char>(layout.version & 0xFF);
+			header[3] = static_cast<char>(layout.version >> 8);
+		}
+		bool readLayout(const char* header, const KVLayout& layout, bool& swap) {
+			uint8_t endian = static_cast<uint8_t>(header[0]);
+			uint16_t version = static_cast<uint16_t>(
+				static_cast<uint8_t>(header[2]) | (static_cast<uint8_t>(header[3]) << 8));
+			if (endian != static_cast<uint8_t>(KVEndian::Little) && endian != static_cast<uint8_t>(KVEndian::Big)) {
+				return false;
+			}
+			if (header[1] != 0 || version != layout.version) {
+				return false;
+			}
+
+			swap = endian != static_cast<uint8_t>(KVEndian::Native);
+			return true;
+		}
+		void byteswap(char* bytes, std::size_t len, std::size_t width) {
+			for (std::size_t i = 0; i + width <= len; i += width) {
+				std::reverse(bytes + i, bytes + i + width);
+			}
+		}
+	}
+
+	bool KVStore::getTyped(std::string_view name, const KVLayout* layout, std::size_t size, std::size_t align, std::size_t swapSize, const void*& values, std::size_t& count) const {
+		const void* raw;
+		std::size_t len;
+		if (!getRaw(name, raw, len)) {
+			return false;
+		}
+
+		const char* bytes = static_cast<const char*>(raw);
+		bool swap = false;
+		if (layout) {
+			if (len < kvLayoutBytes || !readLayout(bytes, *layout, swap)) {
+				return false;
+			}
+			if (swap && swapSize == 0) {
+				return false;
+			}
+			bytes += kvLayoutBytes;
+			len -= kvLayoutBytes;
+		}
+		if (len % size != 0) {
+			return false;
+		}
+
+		// Stored bytes are only copied when they can't be used as they are.
+		if (swap || reinterpret_cast<std::uintptr_t>(bytes) % align != 0) {
+			std::vector<std::max_align_t>& buffer = data->alignBuffer;
+			buffer.resize((len + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t));
+			char* copy = reinterpret_cast<char*>(buffer.data());
+			std::memcpy(copy, bytes, len);
+			if (swap) {
+				byteswap(copy, len, swapSize);
+			}
+			bytes = copy;
+		}
+
+		values = bytes;
+		count = len / size;
+		return true;
+	}
+
+	bool KVStore::setTyped(std::string_view name, const KVLayout& layout, const void* value, std::size_t len, std::size_t swapSize) {
+		bool swap = layout.endian != KVEndian::Native;
+		if (swap && swapSize == 0) {
+			return false;
+		}
+
+		std::string& buffer = data->typedBuffer;
+		buffer.resize(kvLayoutBytes + len);
+		writeLayout(buffer.data(), layout);
+		std::memcpy(buffer.data() + kvLayoutBytes, value, len);
+		if (swap) {
+			byteswap(buffer.data() + kvLayoutBytes, len, swapSize);
+		}
+
+		return setRaw(name, buffer.data(), buffer.size());
+	}
+}
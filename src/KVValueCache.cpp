@@ -0,0 +1,140 @@
+#include <ez/intern/KVValueCache.hpp>
+
+#include <cassert>
+
+namespace ez {
+	// Approximate bookkeeping cost of an entry, on top of the key and value.
+	static constexpr std::size_t entry_overhead = sizeof(void*) * 8 + 32;
+
+	KVValueCache::KVValueCache(std::size_t capacity)
+		: maxBytes(capacity)
+		, protectBytes(0)
+		, totalBytes(0)
+	{}
+
+	std::size_t KVValueCache::charge(const Entry& entry) noexcept {
+		return entry.key.size() + entry.value.size() + entry_overhead;
+	}
+
+	const std::string* KVValueCache::find(int64_t hash, std::string_view key) {
+		auto found = index.find(hash);
+		if (found == index.end() || found->second->key != key) {
+			++counters.misses;
+			return nullptr;
+		}
+
+		++counters.hits;
+		list_t::iterator it = found->second;
+		promote(it);
+		return &it->value;
+	}
+
+	void KVValueCache::insert(int64_t hash, std::string_view key, std::string_view value) {
+		if (maxBytes == 0) {
+			return;
+		}
+
+		auto found = index.find(hash);
+		if (found != index.end()) {
+			list_t::iterator it = found->second;
+			std::size_t old = charge(*it);
+			it->key.assign(key.data(), key.size());
+			it->value.assign(value.data(), value.size());
+
+			totalBytes = totalBytes - old + charge(*it);
+			if (it->protect) {
+				protectBytes = protectBytes - old + charge(*it);
+			}
+		}
+		else {
+			probation.push_front(Entry{ hash, std::string(key), std::string(value), false });
+			index.emplace(hash, probation.begin());
+			totalBytes += charge(probation.front());
+		}
+
+		evict();
+	}
+	void KVValueCache::update(int64_t hash, std::string_view key, std::string_view value) {
+		if (index.count(hash) != 0) {
+			insert(hash, key, value);
+		}
+	}
+	void KVValueCache::erase(int64_t hash) {
+		auto found = index.find(hash);
+		if (found == index.end()) {
+			return;
+		}
+
+		list_t::iterator it = found->second;
+		std::size_t size = charge(*it);
+		totalBytes -= size;
+		if (it->protect) {
+			protectBytes -= size;
+			protect.erase(it);
+		}
+		else {
+			probation.erase(it);
+		}
+		index.erase(found);
+	}
+	void KVValueCache::clear() {
+		probation.clear();
+		protect.clear();
+		index.clear();
+		totalBytes = 0;
+		protectBytes = 0;
+	}
+
+	void KVValueCache::setCapacity(std::size_t capacity) {
+		maxBytes = capacity;
+		evict();
+	}
+	std::size_t KVValueCache::capacity() const noexcept {
+		return maxBytes;
+	}
+
+	KVCacheStats KVValueCache::stats() const noexcept {
+		KVCacheStats result = counters;
+		result.entries = index.size();
+		result.bytes = totalBytes;
+		result.capacity = maxBytes;
+		return result;
+	}
+
+	void KVValueCache::promote(list_t::iterator it) {
+		if (it->protect) {
+			protect.splice(protect.begin(), protect, it);
+			return;
+		}
+
+		// Second hit, move it into the protected segment.
+		it->protect = true;
+		protectBytes += charge(*it);
+		protect.splice(protect.begin(), probation, it);
+
+		// The protected segment gets 80% of the capacity, anything beyond that is demoted back to probation.
+		std::size_t protectMax = maxBytes - maxBytes / 5;
+		while (protectBytes > protectMax && protect.size() > 1) {
+			list_t::iterator last = std::prev(protect.end());
+			last->protect = false;
+			protectBytes -= charge(*last);
+			probation.splice(probation.begin(), protect, last);
+		}
+	}
+	void KVValueCache::evict() {
+		while (totalBytes > maxBytes && !index.empty()) {
+			list_t& victims = probation.empty() ? protect : probation;
+			list_t::iterator last = std::prev(victims.end());
+
+			std::size_t size = charge(*last);
+			totalBytes -= size;
+			if (last->protect) {
+				protectBytes -= size;
+			}
+			index.erase(last->hash);
+			victims.erase(last);
+
+			++counters.evictions;
+		}
+	}
+}
@@ -0,0 +1,80 @@
+#include <ez/intern/KVValueCodec.hpp>
+
+namespace ez {
+	KVValueCodec::KVValueCodec(std::size_t _threshold)
+		: threshold(_threshold)
+		, dictionaryLimit(std::size_t(4) << 10)
+	{
+		use(std::make_shared<KVLZCodec>());
+	}
+
+	void KVValueCodec::add(std::shared_ptr<const KVCodec> codec) {
+		if (codec && codec->id() != raw_id) {
+			codecs[codec->id()] = std::move(codec);
+		}
+	}
+	void KVValueCodec::use(std::shared_ptr<const KVCodec> codec) {
+		add(codec);
+		encoder = std::move(codec);
+	}
+	void KVValueCodec::setDictionary(std::string_view dictionary) {
+		dict = std::make_shared<KVLZCodec>(dictionary);
+		add(dict);
+	}
+	const KVLZCodec* KVValueCodec::dictionary() const noexcept {
+		return dict.get();
+	}
+
+	std::string_view KVValueCodec::encode(std::string_view value, std::string& buffer) const {
+		buffer.clear();
+
+		if (value.size() >= threshold) {
+			const KVCodec* codec = encoder.get();
+			if (dict && value.size() < dictionaryLimit) {
+				codec = dict.get();
+			}
+
+			if (codec) {
+				buffer.push_back(char(codec->id()));
+				if (codec->encode(value, buffer)) {
+					return buffer;
+				}
+				buffer.clear();
+			}
+		}
+
+		buffer.reserve(value.size() + 1);
+		buffer.push_back(char(raw_id));
+		buffer.append(value.data(), value.size());
+		return buffer;
+	}
+
+	bool KVValueCodec::decode(std::string_view stored, std::string_view& value, std::string& buffer) const {
+		if (stored.empty()) {
+			return false;
+		}
+
+		uint8_t id = header(stored);
+		stored.remove_prefix(1);
+		if (id == raw_id) {
+			value = stored;
+			return true;
+		}
+
+		const KVCodec* codec = codecs[id].get();
+		if (!codec) {
+			return false;
+		}
+
+		buffer.clear();
+		if (!codec->decode(stored, buffer)) {
+			return false;
+		}
+		value = buffer;
+		return true;
+	}
+
+	uint8_t KVValueCodec::header(std::string_view stored) noexcept {
+		return stored.empty() ? raw_id : uint8_t(stored[0]);
+	}
+}
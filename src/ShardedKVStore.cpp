@@ -0,0 +1,460 @@
+#include <ez/ShardedKVStore.hpp>
+
+#include <cassert>
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <fmt/core.h>
+#include <fmt/format.h>
+
+#include "hashing.hpp"
+
+namespace ez {
+	namespace {
+		static constexpr const char* manifest_name = "manifest";
+		static constexpr const char* manifest_kind = "ez_kvstore_sharded";
+		static constexpr int manifest_version = 1;
+
+		std::filesystem::path shardPath(const std::filesystem::path& directory, std::size_t shard) {
+			return directory / fmt::format("shard_{:03}.db3", shard);
+		}
+
+		// Returns zero if there is no valid manifest.
+		std::size_t readManifest(const std::filesystem::path& directory) {
+			std::ifstream in(directory / manifest_name);
+			std::string kind, field;
+			int version = 0;
+			std::size_t shards = 0;
+			if (!(in >> kind >> field >> version) || kind != manifest_kind || field != "version" || version != manifest_version) {
+				return 0;
+			}
+			if (!(in >> field >> shards) || field != "shards") {
+				return 0;
+			}
+			return shards;
+		}
+		bool writeManifest(const std::filesystem::path& directory, std::size_t shards) {
+			// Written to the side and moved into place, so a store that failed to be created never opens.
+			std::filesystem::path temp = directory / fmt::format("{}.tmp", manifest_name);
+			{
+				std::ofstream out(temp, std::ios::trunc);
+				out << fmt::format("{}\nversion {}\nshards {}\n", manifest_kind, manifest_version, shards);
+				if (!out) {
+					return false;
+				}
+			}
+			std::error_code ec;
+			std::filesystem::rename(temp, directory / manifest_name, ec);
+			return !ec;
+		}
+	}
+
+	struct ShardedKVStore::Data {
+		struct Shard {
+			std::mutex mutex;
+			KVStore store;
+		};
+		std::vector<std::unique_ptr<Shard>> shards;
+
+		Shard& shardFor(std::string_view name) {
+			return *shards[shardIndex(name)];
+		}
+		std::size_t shardIndex(std::string_view name) const {
+			return static_cast<std::size_t>(static_cast<uint64_t>(kvhash(name)) % shards.size());
+		}
+
+		// Run the function for every shard on its own thread, rethrowing the first failure.
+		void forEach(const std::function<void(std::size_t, Shard&)>& func) {
+			if (shards.size() == 1) {
+				func(0, *shards[0]);
+				return;
+			}
+
+			std::vector<std::exception_ptr> errors(shards.size());
+			std::vector<std::thread> workers;
+			workers.reserve(shards.size());
+			for (std::size_t i = 0; i < shards.size(); ++i) {
+				workers.emplace_back([&, i]() {
+					try {
+						func(i, *shards[i]);
+					}
+					catch (...) {
+						errors[i] = std::current_exception();
+					}
+				});
+			}
+			for (std::thread& worker : workers) {
+				worker.join();
+			}
+			for (std::exception_ptr& error : errors) {
+				if (error) {
+					std::rethrow_exception(error);
+				}
+			}
+		}
+	};
+
+
+	KVShardedGenerator::KVShardedGenerator(std::vector<const KVStore*> _stores)
+		: stores(std::move(_stores))
+		, next(0)
+	{}
+	bool KVShardedGenerator::advance(KVEntryView& value) {
+		// The views point into the current statement, so the iterator is only advanced right before reading the next entry.
+		for (;;) {
+			if (current) {
+				++(*current);
+			}
+			else if (next < stores.size()) {
+				current.emplace(stores[next++]->begin());
+			}
+			else {
+				return false;
+			}
+
+			if (*current == KVStore::const_iterator()) {
+				current.reset();
+				continue;
+			}
+			value = **current;
+			return true;
+		}
+	}
+
+
+	ShardedKVStore::ShardedKVStore()
+		: data(new Data())
+	{}
+	ShardedKVStore::~ShardedKVStore() {
+		if (data) {
+			close();
+		}
+	}
+	ShardedKVStore::ShardedKVStore(ShardedKVStore&&) noexcept = default;
+	ShardedKVStore& ShardedKVStore::operator=(ShardedKVStore&&) noexcept = default;
+
+	bool ShardedKVStore::create(const std::filesystem::path& directory, std::size_t shards, bool overwrite, const KVOpenOptions& options) {
+		namespace fs = std::filesystem;
+		if (!data || isOpen()) {
+			return false;
+		}
+		if (shards == 0) {
+			shards = std::max(std::thread::hardware_concurrency(), 1u);
+		}
+
+		std::error_code ec;
+		fs::create_directories(directory, ec);
+		if (ec) {
+			return false;
+		}
+
+		std::size_t existing = readManifest(directory);
+		if (existing != 0 || fs::exists(directory / manifest_name)) {
+			if (!overwrite) {
+				return false;
+			}
+			fs::remove(directory / manifest_name, ec);
+			for (std::size_t i = 0; i < existing; ++i) {
+				fs::remove(shardPath(directory, i), ec);
+			}
+		}
+
+		for (std::size_t i = 0; i < shards; ++i) {
+			std::unique_ptr<Data::Shard> shard{ new Data::Shard() };
+			if (!shard->store.create(shardPath(directory, i), overwrite, options)) {
+				data->shards.clear();
+				return false;
+			}
+			data->shards.push_back(std::move(shard));
+		}
+
+		if (!writeManifest(directory, shards)) {
+			data->shards.clear();
+			return false;
+		}
+		return true;
+	}
+	bool ShardedKVStore::open(const std::filesystem::path& directory, bool readonly, const KVOpenOptions& options) {
+		if (!data || isOpen()) {
+			return false;
+		}
+
+		std::size_t shards = readManifest(directory);
+		if (shards == 0) {
+			return false;
+		}
+
+		for (std::size_t i = 0; i < shards; ++i) {
+			std::unique_ptr<Data::Shard> shard{ new Data::Shard() };
+			if (!shard->store.open(shardPath(directory, i), readonly, options)) {
+				data->shards.clear();
+				return false;
+			}
+			data->shards.push_back(std::move(shard));
+		}
+		return true;
+	}
+	void ShardedKVStore::close() {
+		if (data) {
+			data->shards.clear();
+		}
+	}
+	bool ShardedKVStore::isOpen() const noexcept {
+		return data && !data->shards.empty();
+	}
+
+	std::size_t ShardedKVStore::numShards() const noexcept {
+		return data ? data->shards.size() : 0;
+	}
+	std::size_t ShardedKVStore::shardOf(std::string_view name) const {
+		assert(isOpen());
+		return data->shardIndex(name);
+	}
+
+	std::size_t ShardedKVStore::numValues() const {
+		std::size_t total = 0;
+		if (!isOpen()) {
+			return total;
+		}
+		for (std::unique_ptr<Data::Shard>& shard : data->shards) {
+			std::lock_guard<std::mutex> lock(shard->mutex);
+			total += shard->store.numValues();
+		}
+		return total;
+	}
+	std::size_t ShardedKVStore::size() const {
+		return numValues();
+	}
+	bool ShardedKVStore::empty() const {
+		return size() == 0;
+	}
+
+	bool ShardedKVStore::contains(std::string_view name) const {
+		if (!isOpen()) {
+			return false;
+		}
+		Data::Shard& shard = data->shardFor(name);
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		return shard.store.contains(name);
+	}
+	bool ShardedKVStore::get(std::string_view name, std::string& value) const {
+		if (!isOpen()) {
+			return false;
+		}
+		Data::Shard& shard = data->shardFor(name);
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		return shard.store.get(name, value);
+	}
+	std::size_t ShardedKVStore::getMany(const std::vector<std::string_view>& names, KVBatchResult& result) const {
+		result.reset(names.size());
+		if (!isOpen()) {
+			return 0;
+		}
+
+		// Group the request by shard, so each shard still gets a batched lookup.
+		std::vector<std::vector<std::string_view>> requests(data->shards.size());
+		std::vector<std::vector<std::size_t>> indices(data->shards.size());
+		for (std::size_t i = 0; i < names.size(); ++i) {
+			std::size_t shard = data->shardIndex(names[i]);
+			requests[shard].push_back(names[i]);
+			indices[shard].push_back(i);
+		}
+
+		std::size_t found = 0;
+		for (std::size_t i = 0; i < data->shards.size(); ++i) {
+			if (requests[i].empty()) {
+				continue;
+			}
+			Data::Shard& shard = *data->shards[i];
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			found += shard.store.getViewMany(requests[i], [&](std::size_t index, std::string_view value) {
+				result.assign(indices[i][index], value);
+			});
+		}
+		return found;
+	}
+
+	bool ShardedKVStore::set(std::string_view name, std::string_view value) {
+		return setRaw(name, (const void*)value.data(), value.length());
+	}
+	bool ShardedKVStore::setRaw(std::string_view name, const void* raw, std::size_t len) {
+		if (!isOpen()) {
+			return false;
+		}
+		Data::Shard& shard = data->shardFor(name);
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		return shard.store.setRaw(name, raw, len);
+	}
+	bool ShardedKVStore::erase(std::string_view name) {
+		if (!isOpen()) {
+			return false;
+		}
+		Data::Shard& shard = data->shardFor(name);
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		return shard.store.erase(name);
+	}
+	bool ShardedKVStore::rename(std::string_view old, std::string_view name) {
+		if (!isOpen()) {
+			return false;
+		}
+
+		Data::Shard& from = data->shardFor(old);
+		Data::Shard& to = data->shardFor(name);
+		if (&from == &to) {
+			std::lock_guard<std::mutex> lock(from.mutex);
+			return from.store.rename(old, name);
+		}
+
+		std::scoped_lock lock(from.mutex, to.mutex);
+		std::string value;
+		if (to.store.contains(name) || !from.store.get(old, value)) {
+			return false;
+		}
+		return to.store.set(name, value) && from.store.erase(old);
+	}
+	void ShardedKVStore::clear() {
+		if (!isOpen()) {
+			return;
+		}
+		data->forEach([](std::size_t, Data::Shard& shard) {
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			shard.store.clear();
+		});
+	}
+
+	bool ShardedKVStore::inBatch() const {
+		if (!isOpen()) {
+			return false;
+		}
+		std::lock_guard<std::mutex> lock(data->shards[0]->mutex);
+		return data->shards[0]->store.inBatch();
+	}
+	bool ShardedKVStore::beginBatch() {
+		if (!isOpen() || inBatch()) {
+			return false;
+		}
+		for (std::unique_ptr<Data::Shard>& shard : data->shards) {
+			std::lock_guard<std::mutex> lock(shard->mutex);
+			shard->store.beginBatch();
+		}
+		return true;
+	}
+	void ShardedKVStore::commitBatch() {
+		if (!inBatch()) {
+			throw std::logic_error("Attempt to commit a batch when not in a batch!");
+		}
+		// Each commit waits on its own fsync, so doing them side by side is where the shards pay off.
+		data->forEach([](std::size_t, Data::Shard& shard) {
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			shard.store.commitBatch();
+		});
+	}
+	void ShardedKVStore::cancelBatch() {
+		if (!isOpen()) {
+			return;
+		}
+		for (std::unique_ptr<Data::Shard>& shard : data->shards) {
+			std::lock_guard<std::mutex> lock(shard->mutex);
+			shard->store.cancelBatch();
+		}
+	}
+
+	KVBulkStats ShardedKVStore::bulkLoad(const KVStore::BulkSource& source, const KVBulkOptions& options) {
+		KVBulkStats stats;
+		if (!isOpen()) {
+			return stats;
+		}
+
+		using clock_t = std::chrono::steady_clock;
+		clock_t::time_point start = clock_t::now();
+
+		// Entries are copied into an arena per shard until the byte limit is reached, then every shard loads its part at once.
+		struct Buffer {
+			std::string arena;
+			std::vector<std::pair<std::size_t, std::size_t>> lengths;
+		};
+		std::vector<Buffer> buffers(data->shards.size());
+		std::size_t buffered = 0;
+
+		auto flush = [&]() {
+			std::vector<KVBulkStats> results(buffers.size());
+			data->forEach([&](std::size_t i, Data::Shard& shard) {
+				Buffer& buffer = buffers[i];
+				if (buffer.lengths.empty()) {
+					return;
+				}
+
+				std::size_t next = 0, offset = 0;
+				std::lock_guard<std::mutex> lock(shard.mutex);
+				results[i] = shard.store.bulkLoad([&](KVEntryView& entry) {
+					if (next == buffer.lengths.size()) {
+						return false;
+					}
+					auto [keyLength, valueLength] = buffer.lengths[next++];
+					entry.key = std::string_view(buffer.arena.data() + offset, keyLength);
+					entry.value = std::string_view(buffer.arena.data() + offset + keyLength, valueLength);
+					offset += keyLength + valueLength;
+					return true;
+				}, options);
+
+				buffer.arena.clear();
+				buffer.lengths.clear();
+			});
+			for (const KVBulkStats& result : results) {
+				stats.entries += result.entries;
+				stats.bytes += result.bytes;
+				stats.chunks += result.chunks;
+			}
+			buffered = 0;
+		};
+
+		KVEntryView entry;
+		while (source(entry)) {
+			Buffer& buffer = buffers[data->shardIndex(entry.key)];
+			buffer.arena.append(entry.key.data(), entry.key.size());
+			buffer.arena.append(entry.value.data(), entry.value.size());
+			buffer.lengths.emplace_back(entry.key.size(), entry.value.size());
+			buffered += entry.key.size() + entry.value.size();
+			if (buffered >= options.chunkBytes) {
+				flush();
+			}
+		}
+		flush();
+
+		stats.seconds = std::chrono::duration<double>(clock_t::now() - start).count();
+		return stats;
+	}
+
+	void ShardedKVStore::parallel(const std::function<void(std::size_t shard, KVStore& store)>& func) {
+		if (!isOpen()) {
+			return;
+		}
+		data->forEach([&](std::size_t i, Data::Shard& shard) {
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			func(i, shard.store);
+		});
+	}
+	void ShardedKVStore::write(std::size_t shard, const std::function<void(KVStore&)>& func) {
+		if (shard >= numShards()) {
+			return;
+		}
+		std::lock_guard<std::mutex> lock(data->shards[shard]->mutex);
+		func(data->shards[shard]->store);
+	}
+
+	ShardedKVStore::const_iterator ShardedKVStore::begin() const {
+		std::vector<const KVStore*> stores;
+		if (!isOpen()) {
+			return const_iterator();
+		}
+		for (const std::unique_ptr<Data::Shard>& shard : data->shards) {
+			stores.push_back(&shard->store);
+		}
+		return const_iterator(KVShardedGenerator(std::move(stores)));
+	}
+	ShardedKVStore::const_iterator ShardedKVStore::end() const {
+		return const_iterator();
+	}
+}
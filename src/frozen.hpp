@@ -0,0 +1,64 @@
+#pragma once
+#include <cinttypes>
+#include <cstddef>
+
+// Layout of the files written by KVStore::exportFrozen and read by KVFrozenStore.
+// Everything is stored in native byte order, the byte order field guards against reading a file from a different platform.
+namespace ez::frozen {
+	static constexpr char magic[8] = { 'e', 'z', 'k', 'v', 'f', 'r', 'z', '\0' };
+	static constexpr uint32_t version = 1;
+	static constexpr uint32_t byte_order = 0x01020304;
+	// Alignment of the sections, records and values.
+	static constexpr std::size_t alignment = 8;
+
+	struct Header {
+		char magic[8];
+		uint32_t version;
+		uint32_t byteOrder;
+		uint64_t count;
+		// Size of the table the pilots map into, slightly larger than count. The slots past count are remapped below it.
+		uint64_t tableSize;
+		uint64_t numBuckets;
+		uint64_t seed;
+		// Offsets of the sections from the start of the file.
+		uint64_t pilotsOffset;
+		uint64_t remapOffset;
+		uint64_t offsetsOffset;
+		uint64_t dataOffset;
+		uint64_t fileSize;
+	};
+
+	// Followed by the key, padding, the value and padding again.
+	struct Record {
+		uint64_t hash;
+		uint64_t valueLength;
+		uint32_t keyLength;
+		uint32_t reserved;
+	};
+
+	inline constexpr std::size_t align(std::size_t value) noexcept {
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+	inline constexpr std::size_t valueOffset(uint32_t keyLength) noexcept {
+		return align(sizeof(Record) + keyLength);
+	}
+
+	// The splitmix64 finalizer.
+	inline uint64_t mix(uint64_t x) noexcept {
+		x ^= x >> 30;
+		x *= 0xBF58476D1CE4E5B9ull;
+		x ^= x >> 27;
+		x *= 0x94D049BB133111EBull;
+		x ^= x >> 31;
+		return x;
+	}
+
+	// Minimal perfect hash in the style of PTHash, keys are split into buckets
+	// and each bucket gets a pilot value that moves all of its keys into free slots.
+	inline uint64_t bucket(uint64_t hash, uint64_t seed, uint64_t numBuckets) noexcept {
+		return mix(hash ^ seed) % numBuckets;
+	}
+	inline uint64_t position(uint64_t hash, uint64_t seed, uint32_t pilot, uint64_t tableSize) noexcept {
+		return (hash ^ mix(uint64_t(pilot) ^ ~seed)) % tableSize;
+	}
+}
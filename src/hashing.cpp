@@ -3,15 +3,22 @@
 #include <xxhash.h>
 
 int64_t kvhash(const char* data, std::size_t len) {
-	return kvhash(data, len, 0);
+	return static_cast<int64_t>(XXH3_64bits(data, len));
 }
 int64_t kvhash(std::string_view text) {
-	return kvhash(text.data(), text.length(), 0);
+	return kvhash(text.data(), text.length());
 }
 
 int64_t kvhash(const char* data, std::size_t len, int64_t seed) {
-	return static_cast<int64_t>(XXH64(data, len, static_cast<uint64_t>(seed)));
+	return static_cast<int64_t>(XXH3_64bits_withSeed(data, len, static_cast<uint64_t>(seed)));
 }
 int64_t kvhash(std::string_view text, int64_t seed) {
 	return kvhash(text.data(), text.length(), seed);
-}
\ No newline at end of file
+}
+
+int64_t kvhash_legacy(const char* data, std::size_t len) {
+	return static_cast<int64_t>(XXH64(data, len, 0));
+}
+int64_t kvhash_legacy(std::string_view text) {
+	return kvhash_legacy(text.data(), text.length());
+}
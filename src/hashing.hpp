@@ -1,10 +1,26 @@
 #pragma once
 #include <cinttypes>
 #include <cstddef>
+#include <cstring>
 #include <string_view>
 
+// XXH3, the key hash of files from version 3 on.
 int64_t kvhash(const char* data, std::size_t len);
 int64_t kvhash(std::string_view data);
 
 int64_t kvhash(const char* data, std::size_t len, int64_t seed);
-int64_t kvhash(std::string_view data, int64_t seed);
\ No newline at end of file
+int64_t kvhash(std::string_view data, int64_t seed);
+
+// XXH64, the key hash of older files.
+int64_t kvhash_legacy(const char* data, std::size_t len);
+int64_t kvhash_legacy(std::string_view data);
+
+// Keys that collide are stored in the next free slot after their hash, wrapping around.
+inline int64_t kvprobe(int64_t slot) noexcept {
+	return static_cast<int64_t>(static_cast<uint64_t>(slot) + 1);
+}
+
+// Compare a stored key against a requested one.
+inline bool kvkeyequal(const void* stored, int bytes, std::string_view key) noexcept {
+	return static_cast<std::size_t>(bytes) == key.length() && (bytes == 0 || std::memcmp(stored, key.data(), key.length()) == 0);
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <cinttypes>
+
+namespace ez::schema {
+	// Version of the file layout, stored in ez_kvstore_meta under "version".
+	// 1: The original layout, which has no version entry.
+	// 2: The number of entries is kept up to date in ez_kvstore_meta under "count", by triggers on the table.
+	// 3: Keys are hashed with XXH3 instead of XXH64, and colliding keys are stored in the following free slot.
+	static constexpr int64_t version = 3;
+
+	static constexpr const char* count_insert_trigger =
+		"CREATE TRIGGER IF NOT EXISTS ez_kvstore_count_insert AFTER INSERT ON \"main\" BEGIN "
+			"UPDATE ez_kvstore_meta SET \"value\" = \"value\" + 1 WHERE \"key\" = 'count'; "
+		"END;";
+	static constexpr const char* count_delete_trigger =
+		"CREATE TRIGGER IF NOT EXISTS ez_kvstore_count_delete AFTER DELETE ON \"main\" BEGIN "
+			"UPDATE ez_kvstore_meta SET \"value\" = \"value\" - 1 WHERE \"key\" = 'count'; "
+		"END;";
+
+	// Named tables, each stored in a table called ez_kvstore_table_<id>, with the number of entries kept up to date by triggers.
+	// Created the first time a named table is opened, older versions of the library simply ignore these tables.
+	static constexpr const char* tables_table =
+		"CREATE TABLE IF NOT EXISTS ez_kvstore_tables("
+			"\"id\" INTEGER PRIMARY KEY AUTOINCREMENT, "
+			"\"name\" BLOB NOT NULL UNIQUE, "
+			"\"count\" INTEGER NOT NULL DEFAULT 0);";
+}
\ No newline at end of file
@@ -0,0 +1,35 @@
+#pragma once
+#include <chrono>
+#include <string_view>
+
+#include <ez/intern/KVStatusRecorder.hpp>
+
+namespace ez {
+	// Times an operation for as long as it is alive, and records it once it goes out of scope.
+	class KVOpTimer {
+	public:
+		using clock_t = std::chrono::steady_clock;
+
+		KVOpTimer(KVStatusRecorder& _recorder, KVOp _op, std::string_view _key = {})
+			: recorder(_recorder)
+			, op(_op)
+			, key(_key)
+			, start(clock_t::now())
+		{}
+		~KVOpTimer() {
+			recorder.record(op, clock_t::now() - start, count, bytesRead, bytesWritten, key);
+		}
+
+		KVOpTimer(const KVOpTimer&) = delete;
+		KVOpTimer& operator=(const KVOpTimer&) = delete;
+
+		uint64_t count = 1;
+		uint64_t bytesRead = 0;
+		uint64_t bytesWritten = 0;
+	private:
+		KVStatusRecorder& recorder;
+		KVOp op;
+		std::string_view key;
+		clock_t::time_point start;
+	};
+}
@@ -3,9 +3,22 @@
 #include "config.hpp"
 
 #include <ez/KVStore.hpp>
+#include <ez/KVAsyncWriter.hpp>
+#include <ez/KVAsyncStore.hpp>
+#include <ez/ConcurrentKVStore.hpp>
+#include <ez/KVFrozenStore.hpp>
+#include <ez/KVMaintenance.hpp>
+#include <ez/KVReadSnapshot.hpp>
+#include <ez/KVTable.hpp>
+#include <ez/ShardedKVStore.hpp>
+#include <ez/blobstream.hpp>
+#include <fmt/core.h>
 
+#include <fstream>
 #include <unordered_map>
 #include <unordered_set>
+#include <atomic>
+#include <thread>
 
 namespace fs = std::filesystem;
 
@@ -109,3 +122,2054 @@ TEST_CASE("reading") {
 }
 
 
+TEST_CASE("batched lookups") {
+	fs::path path = test_dir;
+	path /= "write.db3";
+
+	ez::KVStore store;
+	REQUIRE(store.create(path, true));
+
+	std::vector<std::string> keys;
+	REQUIRE(store.beginBatch());
+	for (int i = 0; i < 200; ++i) {
+		keys.push_back("key" + std::to_string(i));
+		REQUIRE(store.set(keys.back(), "value" + std::to_string(i)));
+	}
+	store.commitBatch();
+
+	// Mix of present, missing and duplicated keys.
+	std::vector<std::string_view> request;
+	for (int i = 0; i < 200; i += 2) {
+		request.push_back(keys[i]);
+		request.push_back("missing");
+	}
+	request.push_back(keys[10]);
+
+	std::vector<bool> found;
+	REQUIRE(store.containsMany(request, found) == 101);
+	REQUIRE(found.size() == request.size());
+	REQUIRE(found[0]);
+	REQUIRE(!found[1]);
+	REQUIRE(found.back());
+
+	ez::KVBatchResult result;
+	REQUIRE(store.getMany(request, result) == 101);
+	REQUIRE(result.size() == request.size());
+	REQUIRE(result.count() == 101);
+	for (std::size_t i = 0; i + 1 < request.size(); i += 2) {
+		std::string expected = "value" + std::string(request[i].substr(3));
+		REQUIRE(result.found(i));
+		REQUIRE(result.value(i) == expected);
+		REQUIRE(!result.found(i + 1));
+	}
+	REQUIRE(result.value(request.size() - 1) == "value10");
+
+	std::size_t calls = 0;
+	REQUIRE(store.getViewMany(request, [&](std::size_t index, std::string_view value) {
+		REQUIRE(index < request.size());
+		REQUIRE(value.substr(0, 5) == "value");
+		++calls;
+	}) == 101);
+	REQUIRE(calls == 101);
+}
+
+TEST_CASE("bulk loading") {
+	fs::path path = test_dir;
+	path /= "write.db3";
+
+	ez::KVStore store;
+	REQUIRE(store.create(path, true));
+
+	std::vector<ez::KVEntry> entries;
+	for (int i = 0; i < 1000; ++i) {
+		entries.push_back(ez::KVEntry{ "key" + std::to_string(i), "value" + std::to_string(i) });
+	}
+	// Duplicate key, the later value should win.
+	entries.push_back(ez::KVEntry{ "key5", "replaced" });
+
+	ez::KVBulkOptions options;
+	options.chunkEntries = 128;
+
+	ez::KVBulkStats stats = store.bulkLoad(entries.begin(), entries.end(), options);
+	REQUIRE(stats.entries == entries.size());
+	REQUIRE(stats.chunks == 8);
+	REQUIRE(stats.seconds >= 0.0);
+
+	REQUIRE(store.numValues() == 1000);
+
+	std::string value;
+	REQUIRE(store.get("key999", value));
+	REQUIRE(value == "value999");
+	REQUIRE(store.get("key5", value));
+	REQUIRE(value == "replaced");
+
+	// Inside of a batch, the whole load can be rolled back.
+	REQUIRE(store.beginBatch());
+	int count = 0;
+	stats = store.bulkLoad([&](ez::KVEntryView& entry) {
+		if (count == 10) {
+			return false;
+		}
+		value = "extra" + std::to_string(count++);
+		entry.key = value;
+		entry.value = value;
+		return true;
+	});
+	REQUIRE(stats.entries == 10);
+	REQUIRE(store.numValues() == 1010);
+	store.cancelBatch();
+	REQUIRE(store.numValues() == 1000);
+}
+
+TEST_CASE("async writer") {
+	fs::path path = test_dir;
+	path /= "write.db3";
+
+	{
+		ez::KVStore store;
+		REQUIRE(store.create(path, true));
+		REQUIRE(store.set("old", "value"));
+	}
+
+	ez::KVAsyncWriter writer;
+	REQUIRE(!writer.isOpen());
+	REQUIRE(!writer.set("early", "value").get());
+
+	ez::KVAsyncOptions options;
+	options.maxBatch = 16;
+	REQUIRE(writer.open(path, options));
+	REQUIRE(writer.isOpen());
+
+	std::vector<std::future<bool>> results;
+	for (int i = 0; i < 100; ++i) {
+		results.push_back(writer.set("key" + std::to_string(i), "value" + std::to_string(i)));
+	}
+	results.push_back(writer.erase("old"));
+	results.push_back(writer.erase("never existed"));
+
+	int called = 0;
+	writer.set("callback", "value", [&](bool result) {
+		called += result ? 1 : 0;
+	});
+
+	REQUIRE(writer.flush().get());
+	for (std::size_t i = 0; i + 1 < results.size(); ++i) {
+		REQUIRE(results[i].get());
+	}
+	REQUIRE(!results.back().get());
+	REQUIRE(called == 1);
+	REQUIRE(writer.pending() == 0);
+	// The writes should have been grouped together, not committed one at a time.
+	REQUIRE(writer.numCommits() < 100);
+
+	writer.close();
+	REQUIRE(!writer.isOpen());
+
+	// Writes queued while closing are refused instead of being left incomplete.
+	ez::KVAsyncOptions slow;
+	slow.maxDelay = std::chrono::seconds(10);
+	REQUIRE(writer.open(path, slow));
+	std::promise<bool> lateResult;
+	std::future<bool> late = lateResult.get_future();
+	std::future<bool> closing = writer.set("closing", "value");
+	writer.set("closing2", "value", [&](bool) {
+		// Runs on the writer thread while close drains the queue.
+		writer.set("late", "value", [&](bool ok) {
+			lateResult.set_value(ok);
+		});
+	});
+	writer.close();
+	REQUIRE(closing.get());
+	REQUIRE(late.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+	REQUIRE(!late.get());
+
+	// A moved from writer is closed and empty.
+	ez::KVAsyncWriter moved = std::move(writer);
+	REQUIRE(!writer.isOpen());
+	REQUIRE(writer.pending() == 0);
+	REQUIRE(writer.numCommits() == 0);
+	REQUIRE(!writer.set("key", "value").get());
+
+	// Callbacks that throw don't take the writer thread down, and assigning over an open writer closes it first.
+	ez::KVAsyncWriter other;
+	REQUIRE(other.open(path));
+	REQUIRE(moved.open(path));
+	other.set("thrown", "value", [](bool) {
+		throw std::runtime_error("callback failed");
+	});
+	REQUIRE(other.flush().get());
+	other = std::move(moved);
+	REQUIRE(other.isOpen());
+	REQUIRE(other.set("assigned", "value").get());
+	other.close();
+
+	ez::KVStore store;
+	REQUIRE(store.open(path, true));
+	REQUIRE(store.numValues() == 105);
+	REQUIRE(!store.contains("late"));
+	REQUIRE(!store.contains("old"));
+
+	std::string value;
+	REQUIRE(store.get("key42", value));
+	REQUIRE(value == "value42");
+}
+
+TEST_CASE("open options") {
+	fs::path path = test_dir;
+	path /= "write.db3";
+
+	{
+		ez::KVOpenOptions options = ez::KVOpenOptions::fastWrite();
+		options.pageSize = 8192;
+
+		ez::KVStore store;
+		REQUIRE(store.create(path, true, options));
+		REQUIRE(store.set("hello", "world"));
+	}
+
+	{
+		SQLite::Database db(path.u8string(), SQLite::OPEN_READONLY);
+		REQUIRE(db.execAndGet("PRAGMA main.page_size;").getInt() == 8192);
+		REQUIRE(db.execAndGet("PRAGMA main.journal_mode;").getString() == "wal");
+	}
+
+	ez::KVStore store;
+	REQUIRE(store.open(path, true, ez::KVOpenOptions::readMostly()));
+
+	std::string value;
+	REQUIRE(store.get("hello", value));
+	REQUIRE(value == "world");
+	store.close();
+
+	// Switch the file back, so the other tests are unaffected by the journal mode.
+	ez::KVOpenOptions options;
+	options.journal = ez::KVOpenOptions::Journal::Delete;
+
+	// Options that can't be applied fail the open, instead of leaving a half configured store.
+	{
+		SQLite::Database reader(path.u8string(), SQLite::OPEN_READONLY);
+		reader.exec("BEGIN;");
+		REQUIRE(reader.execAndGet("SELECT COUNT(*) FROM \"main\";").getInt() == 1);
+		REQUIRE(!store.open(path, false, options));
+		REQUIRE(!store.isOpen());
+		reader.exec("COMMIT;");
+	}
+
+	REQUIRE(store.open(path, false, options));
+	REQUIRE(store.contains("hello"));
+}
+
+TEST_CASE("concurrent reader pool") {
+	fs::path path = test_dir;
+	path /= "write.db3";
+
+	{
+		ez::KVStore store;
+		REQUIRE(store.create(path, true));
+		for (int i = 0; i < 100; ++i) {
+			REQUIRE(store.set("key" + std::to_string(i), "value" + std::to_string(i)));
+		}
+	}
+
+	ez::ConcurrentKVStore store;
+	REQUIRE(store.open(path, 4));
+	REQUIRE(store.numReaders() == 4);
+
+	std::atomic<int> failures{ 0 };
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; ++t) {
+		threads.emplace_back([&, t] {
+			// Pin a reader to this thread for a while, then go back to leasing per call.
+			{
+				ez::ConcurrentKVStore::Reader reader = store.reader();
+				std::string value;
+				for (int i = 0; i < 100; ++i) {
+					if (!reader->get("key" + std::to_string(i), value) || value != "value" + std::to_string(i)) {
+						++failures;
+					}
+				}
+			}
+			for (int i = 0; i < 50; ++i) {
+				if (!store.contains("key" + std::to_string(i))) {
+					++failures;
+				}
+				store.set("thread" + std::to_string(t) + "_" + std::to_string(i), "value");
+			}
+		});
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	REQUIRE(failures == 0);
+	REQUIRE(store.numValues() == 300);
+
+	store.write([](ez::KVStore& writer) {
+		REQUIRE(writer.beginBatch());
+		writer.clear();
+		writer.commitBatch();
+	});
+	REQUIRE(store.numValues() == 0);
+
+	// Moving hands over the connections, the moved from store is closed.
+	ez::ConcurrentKVStore moved(std::move(store));
+	REQUIRE(moved.isOpen());
+	REQUIRE(!store.isOpen());
+	REQUIRE(store.numReaders() == 0);
+	REQUIRE(!store.set("key", "value"));
+	REQUIRE(moved.set("key", "value"));
+	store = std::move(moved);
+	REQUIRE(store.contains("key"));
+
+	store.close();
+	REQUIRE(!store.isOpen());
+}
+
+TEST_CASE("value cache") {
+	fs::path path = test_dir;
+	path /= "write.db3";
+
+	ez::KVStore store;
+	REQUIRE(store.create(path, true));
+	REQUIRE(store.getCacheCapacity() == 0);
+
+	store.setCacheCapacity(4096);
+	REQUIRE(store.getCacheCapacity() == 4096);
+
+	REQUIRE(store.set("hello", "world"));
+
+	std::string value;
+	REQUIRE(store.get("hello", value));
+	REQUIRE(store.get("hello", value));
+	REQUIRE(value == "world");
+
+	ez::KVCacheStats stats = store.getCacheStats();
+	REQUIRE(stats.misses == 1);
+	REQUIRE(stats.hits == 1);
+	REQUIRE(stats.entries == 1);
+
+	// Writes through the store update the cached value.
+	REQUIRE(store.set("hello", "there"));
+	REQUIRE(store.get("hello", value));
+	REQUIRE(value == "there");
+
+	REQUIRE(store.rename("hello", "moved"));
+	REQUIRE(!store.get("hello", value));
+	REQUIRE(store.get("moved", value));
+	REQUIRE(value == "there");
+
+	REQUIRE(store.erase("moved"));
+	REQUIRE(!store.contains("moved"));
+
+	// Rolled back writes must not linger in the cache.
+	REQUIRE(store.set("kept", "before"));
+	REQUIRE(store.get("kept", value));
+	REQUIRE(store.beginBatch());
+	REQUIRE(store.set("kept", "after"));
+	REQUIRE(store.get("kept", value));
+	REQUIRE(value == "after");
+	store.cancelBatch();
+	REQUIRE(store.get("kept", value));
+	REQUIRE(value == "before");
+
+	// Stays within its budget, a one off scan cannot evict the frequently read entry.
+	REQUIRE(store.get("kept", value));
+	std::string big(256, 'x');
+	for (int i = 0; i < 100; ++i) {
+		std::string key = "scan" + std::to_string(i);
+		REQUIRE(store.set(key, big));
+		REQUIRE(store.get(key, value));
+	}
+	stats = store.getCacheStats();
+	REQUIRE(stats.bytes <= 4096);
+	REQUIRE(stats.evictions > 0);
+
+	std::size_t hits = stats.hits;
+	REQUIRE(store.get("kept", value));
+	REQUIRE(store.getCacheStats().hits == hits + 1);
+
+	store.clear();
+	REQUIRE(store.getCacheStats().entries == 0);
+	REQUIRE(!store.get("kept", value));
+
+	store.setCacheCapacity(0);
+	REQUIRE(store.getCacheCapacity() == 0);
+}
+
+TEST_CASE("negative lookup filter") {
+	fs::path path = test_dir;
+	path /= "write.db3";
+
+	{
+		ez::KVStore store;
+		REQUIRE(store.create(path, true));
+		for (int i = 0; i < 500; ++i) {
+			REQUIRE(store.set("key" + std::to_string(i), "value"));
+		}
+	}
+
+	ez::KVStore store;
+	REQUIRE(!store.hasFilter());
+	store.enableFilter(0.01);
+	REQUIRE(store.hasFilter());
+
+	// Built when the store is opened.
+	REQUIRE(store.open(path));
+	REQUIRE(store.getFilterStats().entries == 500);
+
+	// Overwrites are already in the filter, and don't count towards the next rebuild.
+	for (int i = 0; i < 500; ++i) {
+		REQUIRE(store.set("key" + std::to_string(i), "value"));
+	}
+	for (int i = 0; i < 100; ++i) {
+		REQUIRE(store.increment("counter", 1));
+	}
+	REQUIRE(store.getFilterStats().entries == 501);
+	REQUIRE(store.erase("counter"));
+
+	for (int i = 0; i < 500; ++i) {
+		REQUIRE(store.contains("key" + std::to_string(i)));
+	}
+	for (int i = 0; i < 2000; ++i) {
+		REQUIRE(!store.contains("missing" + std::to_string(i)));
+	}
+
+	ez::KVFilterStats stats = store.getFilterStats();
+	REQUIRE(stats.queries == 2500);
+	REQUIRE(stats.definiteMisses + stats.falsePositives == 2000);
+	REQUIRE(stats.falsePositiveRate() < 0.05);
+
+	// Entries added through the store, or renamed, must never be rejected.
+	for (int i = 0; i < 2000; ++i) {
+		REQUIRE(store.set("added" + std::to_string(i), "value"));
+	}
+	REQUIRE(store.rename("key0", "renamed"));
+
+	std::string value;
+	for (int i = 0; i < 2000; ++i) {
+		REQUIRE(store.get("added" + std::to_string(i), value));
+	}
+	REQUIRE(store.contains("renamed"));
+
+	std::vector<std::string_view> names{ "added5", "missing", "renamed" };
+	std::vector<bool> found;
+	REQUIRE(store.containsMany(names, found) == 2);
+
+	store.clear();
+	REQUIRE(!store.contains("renamed"));
+	REQUIRE(store.set("renamed", "value"));
+	REQUIRE(store.contains("renamed"));
+
+	store.disableFilter();
+	REQUIRE(!store.hasFilter());
+	REQUIRE(store.contains("renamed"));
+}
+
+TEST_CASE("entry count") {
+	fs::path path = test_dir;
+	path /= "write.db3";
+
+	// Files written before the count existed get it added when opened for writing.
+	fs::copy_file(fs::path(test_dir) / "read.db3", path, fs::copy_options::overwrite_existing);
+
+	ez::KVStore store;
+	REQUIRE(store.open(path));
+	REQUIRE(store.size() == 2);
+	REQUIRE(!store.empty());
+
+	REQUIRE(store.set("hello", "again"));
+	REQUIRE(store.size() == 2);
+	REQUIRE(store.set("new", "value"));
+	REQUIRE(store.size() == 3);
+	REQUIRE(store.rename("new", "newer"));
+	REQUIRE(store.size() == 3);
+	REQUIRE(store.erase("newer"));
+	REQUIRE(!store.erase("newer"));
+	REQUIRE(store.size() == 2);
+
+	REQUIRE(store.beginBatch());
+	REQUIRE(store.set("batched", "value"));
+	REQUIRE(store.size() == 3);
+	store.cancelBatch();
+	REQUIRE(store.size() == 2);
+
+	store.clear();
+	REQUIRE(store.empty());
+
+	// The delete trigger has to be back in place after a clear.
+	REQUIRE(store.set("a", "1"));
+	REQUIRE(store.set("b", "2"));
+	REQUIRE(store.erase("a"));
+	REQUIRE(store.size() == 1);
+	store.close();
+
+	// Writes from another connection are counted as well.
+	{
+		SQLite::Database db(path.u8string(), SQLite::OPEN_READWRITE);
+		db.exec("INSERT INTO \"main\"(\"hash\", \"key\", \"value\") VALUES (1, 'raw', 'value');");
+	}
+	REQUIRE(store.open(path, true));
+	REQUIRE(store.size() == 2);
+}
+
+TEST_CASE("blob streaming") {
+	fs::path path = test_dir;
+	path /= "write.db3";
+
+	ez::KVStore store;
+	REQUIRE(store.create(path, true));
+
+	ez::KVBlob blob;
+	REQUIRE(!store.openBlob("large", blob));
+	REQUIRE(!blob.isOpen());
+
+	// Fill a reserved value piece by piece.
+	const std::size_t size = 100000;
+	REQUIRE(store.reserve("large", size));
+	REQUIRE(store.size() == 1);
+	REQUIRE(store.openBlob("large", blob, true));
+	REQUIRE(blob.isWritable());
+	REQUIRE(blob.size() == size);
+	{
+		ez::oblobstream out(blob, 4096);
+		for (std::size_t i = 0; i < size; ++i) {
+			out.put(char('a' + i % 26));
+		}
+		REQUIRE(out.good());
+
+		// Values can not grow through a blob.
+		out.put('!');
+		out.flush();
+		REQUIRE(!out.good());
+	}
+	blob.close();
+
+	std::string value;
+	REQUIRE(store.get("large", value));
+	REQUIRE(value.size() == size);
+	REQUIRE(value[0] == 'a');
+	REQUIRE(value[size - 1] == char('a' + (size - 1) % 26));
+
+	// Chunked random access.
+	REQUIRE(store.openBlob("large", blob));
+	REQUIRE(!blob.isWritable());
+	char chunk[4];
+	REQUIRE(blob.readAt(26 * 10 + 3, chunk, 4));
+	REQUIRE(std::string_view(chunk, 4) == "defg");
+	REQUIRE(!blob.readAt(size - 2, chunk, 4));
+	REQUIRE(!blob.writeAt(0, "x", 1));
+
+	{
+		ez::iblobstream in(blob, 1000);
+		in.seekg(26 * 100);
+		std::string word(26, '\0');
+		REQUIRE(in.read(word.data(), 26));
+		REQUIRE(word == "abcdefghijklmnopqrstuvwxyz");
+		REQUIRE(in.tellg() == std::streampos(26 * 101));
+
+		in.seekg(0);
+		std::size_t count = 0;
+		char c;
+		while (in.get(c)) {
+			++count;
+		}
+		REQUIRE(count == size);
+	}
+	blob.close();
+
+	// Overwriting the beginning, through writeAt.
+	REQUIRE(store.openBlob("large", blob, true));
+	REQUIRE(blob.writeAt(0, "zz", 2));
+	blob.close();
+	REQUIRE(store.get("large", value));
+	REQUIRE(value.substr(0, 3) == "zzc");
+}
+
+TEST_CASE("value codec") {
+	fs::path path = test_dir;
+	path /= "write.db3";
+
+	auto document = [](int i) {
+		std::string value = "{";
+		for (int k = 0; k < 8; ++k) {
+			value += fmt::format("\"field_{}\": \"some repetitive text for entry {}\", ", k, i);
+		}
+		value += "}";
+		return value;
+	};
+
+	ez::KVStore store;
+	REQUIRE(store.create(path, true));
+	REQUIRE(!store.hasCodec());
+
+	// Existing values are kept readable when the codec is enabled.
+	REQUIRE(store.set("before", document(-1)));
+	REQUIRE(store.set("tiny", "x"));
+	REQUIRE(store.set("empty", ""));
+	REQUIRE(store.enableCodec(32));
+	REQUIRE(store.hasCodec());
+
+	std::string value;
+	REQUIRE(store.get("before", value));
+	REQUIRE(value == document(-1));
+	REQUIRE(store.get("tiny", value));
+	REQUIRE(value == "x");
+	REQUIRE(store.get("empty", value));
+	REQUIRE(value.empty());
+
+	for (int i = 0; i < 200; ++i) {
+		REQUIRE(store.set(fmt::format("doc{}", i), document(i)));
+	}
+	REQUIRE(store.size() == 203);
+
+	{
+		SQLite::Database db(path.u8string(), SQLite::OPEN_READONLY);
+		std::size_t stored = db.execAndGet("SELECT SUM(length(\"value\")) FROM \"main\" WHERE \"key\" LIKE 'doc%';").getInt64();
+		std::size_t plain = 0;
+		for (int i = 0; i < 200; ++i) {
+			plain += document(i).size();
+		}
+		REQUIRE(stored < plain / 2);
+	}
+
+	std::string_view view;
+	bool copied = false;
+	REQUIRE(store.getView("doc7", view, copied));
+	REQUIRE(copied);
+	REQUIRE(view == document(7));
+	REQUIRE(store.getView("tiny", view, copied));
+	REQUIRE(!copied);
+	REQUIRE(view == "x");
+
+	std::size_t count = 0;
+	for (const ez::KVEntryView& entry : store) {
+		if (entry.key.substr(0, 3) == "doc") {
+			REQUIRE(entry.value == document(std::stoi(std::string(entry.key.substr(3)))));
+		}
+		++count;
+	}
+	REQUIRE(count == 203);
+
+	std::vector<std::string_view> request{ "doc1", "tiny", "missing", "doc199" };
+	ez::KVBatchResult result;
+	REQUIRE(store.getMany(request, result) == 3);
+	REQUIRE(result.value(0) == document(1));
+	REQUIRE(result.value(1) == "x");
+	REQUIRE(!result.found(2));
+	REQUIRE(result.value(3) == document(199));
+
+	// Encoded values can't be streamed, values reserved afterwards can.
+	ez::KVBlob blob;
+	REQUIRE(!store.openBlob("doc1", blob));
+	REQUIRE(store.reserve("blob", 4));
+	REQUIRE(store.openBlob("blob", blob, true));
+	REQUIRE(blob.size() == 4);
+	REQUIRE(blob.writeAt(0, "abcd", 4));
+	blob.close();
+	REQUIRE(store.get("blob", value));
+	REQUIRE(value == "abcd");
+
+	// A dictionary helps values below the regular threshold.
+	REQUIRE(store.trainDictionary(4096, 100));
+	REQUIRE(!store.trainDictionary());
+	REQUIRE(store.set("small", "\"field_3\": \"some repetitive"));
+	REQUIRE(store.get("small", value));
+	REQUIRE(value == "\"field_3\": \"some repetitive");
+	REQUIRE(store.get("doc3", value));
+	REQUIRE(value == document(3));
+
+	// Everything needed to read the values back is kept in the file.
+	store.close();
+	REQUIRE(store.open(path, true));
+	REQUIRE(store.hasCodec());
+	REQUIRE(store.get("small", value));
+	REQUIRE(value == "\"field_3\": \"some repetitive");
+	REQUIRE(store.get("doc42", value));
+	REQUIRE(value == document(42));
+	REQUIRE(store.get("before", value));
+	REQUIRE(value == document(-1));
+	store.close();
+
+	// Enabling it again only changes the threshold of the handle, reopening goes back to the stored one.
+	auto storedLength = [&](std::string_view key) {
+		SQLite::Database db(path.u8string(), SQLite::OPEN_READONLY);
+		SQLite::Statement stmt(db, "SELECT length(\"value\") FROM \"main\" WHERE \"key\" = CAST(? AS BLOB);");
+		stmt.bind(1, std::string(key));
+		REQUIRE(stmt.executeStep());
+		return static_cast<std::size_t>(stmt.getColumn(0).getInt64());
+	};
+	REQUIRE(store.open(path));
+	REQUIRE(store.enableCodec(4096));
+	REQUIRE(store.set("raw", document(-2)));
+	REQUIRE(storedLength("raw") > document(-2).size());
+	store.close();
+
+	REQUIRE(store.open(path));
+	REQUIRE(store.set("compressed", document(-2)));
+	REQUIRE(storedLength("compressed") < document(-2).size() / 2);
+	REQUIRE(store.get("raw", value));
+	REQUIRE(value == document(-2));
+
+	// Corrupt values are refused, instead of allocating whatever size they claim to decode to.
+	ez::KVLZCodec codec;
+	std::string encoded, decoded;
+	REQUIRE(codec.encode(document(1), encoded));
+	REQUIRE(codec.decode(encoded, decoded));
+	REQUIRE(decoded == document(1));
+	decoded.clear();
+	std::string corrupt("\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\x7F\x10x", 11);
+	REQUIRE(!codec.decode(corrupt, decoded));
+	REQUIRE(decoded.empty());
+}
+
+TEST_CASE("hash collisions") {
+	fs::path path = test_dir;
+	path /= "write.db3";
+
+	ez::KVStore store;
+	REQUIRE(store.create(path, true));
+	REQUIRE(store.set("a", "1"));
+	REQUIRE(store.set("b", "2"));
+
+	// Simulate another key hashing to the same slot as "a", by moving "a" along to the next slot and putting a different key in its place.
+	{
+		SQLite::Database db(path.u8string(), SQLite::OPEN_READWRITE);
+		db.exec("UPDATE \"main\" SET \"hash\" = \"hash\" + 1 WHERE \"key\" = CAST('a' AS BLOB);");
+		db.exec("INSERT INTO \"main\"(\"hash\", \"key\", \"value\") SELECT \"hash\" - 1, CAST('other' AS BLOB), 'x' FROM \"main\" WHERE \"key\" = CAST('a' AS BLOB);");
+	}
+	REQUIRE(store.size() == 3);
+
+	std::string value;
+	REQUIRE(store.contains("a"));
+	REQUIRE(store.get("a", value));
+	REQUIRE(value == "1");
+
+	std::vector<std::string_view> request{ "a", "b", "missing" };
+	ez::KVBatchResult result;
+	REQUIRE(store.getMany(request, result) == 2);
+	REQUIRE(result.value(0) == "1");
+	REQUIRE(result.value(1) == "2");
+
+	// Writes must not overwrite the colliding key.
+	REQUIRE(store.set("a", "3"));
+	REQUIRE(store.size() == 3);
+	REQUIRE(store.get("a", value));
+	REQUIRE(value == "3");
+
+	auto otherValue = [&]() {
+		SQLite::Database db(path.u8string(), SQLite::OPEN_READONLY);
+		return db.execAndGet("SELECT \"value\" FROM \"main\" WHERE \"key\" = CAST('other' AS BLOB);").getString();
+	};
+	REQUIRE(otherValue() == "x");
+
+	REQUIRE(store.rename("a", "c"));
+	REQUIRE(!store.contains("a"));
+	REQUIRE(store.get("c", value));
+	REQUIRE(value == "3");
+	REQUIRE(store.rename("c", "a"));
+	REQUIRE(store.get("a", value));
+	REQUIRE(value == "3");
+
+	REQUIRE(store.erase("a"));
+	REQUIRE(!store.erase("a"));
+	REQUIRE(!store.contains("a"));
+	REQUIRE(store.size() == 2);
+	REQUIRE(otherValue() == "x");
+}
+
+TEST_CASE("hash migration") {
+	fs::path path = test_dir;
+	path /= "write.db3";
+
+	// Files written with XXH64 keep it when opened for writing, until they are upgraded.
+	fs::copy_file(fs::path(test_dir) / "read.db3", path, fs::copy_options::overwrite_existing);
+
+	ez::KVStore store;
+	REQUIRE(store.open(path));
+	REQUIRE(store.needsUpgrade());
+	REQUIRE(!store.table("named").isOpen());
+
+	std::string value;
+	REQUIRE(store.get("hello", value));
+	REQUIRE(value == "world");
+	REQUIRE(store.get("what", value));
+	REQUIRE(value == "fun");
+	REQUIRE(store.set("hello", "again"));
+	for (int i = 0; i < 100; ++i) {
+		REQUIRE(store.set(fmt::format("key{}", i), fmt::format("value{}", i)));
+	}
+	REQUIRE(store.size() == 102);
+	store.close();
+
+	{
+		SQLite::Database db(path.u8string(), SQLite::OPEN_READONLY);
+		REQUIRE(db.execAndGet("SELECT \"value\" FROM ez_kvstore_meta WHERE \"key\" = 'version';").getInt64() == 2);
+		REQUIRE(db.execAndGet("PRAGMA main.application_id;").getInt() == static_cast<int32_t>(0xCB4D74FF));
+	}
+
+	// The upgrade works through the table a chunk at a time.
+	REQUIRE(store.open(path));
+	{
+		auto it = store.begin();
+		REQUIRE(!store.upgrade());
+	}
+	REQUIRE(store.upgrade(7));
+	REQUIRE(!store.needsUpgrade());
+	REQUIRE(store.upgrade());
+	REQUIRE(store.size() == 102);
+	for (int i = 0; i < 100; ++i) {
+		REQUIRE(store.get(fmt::format("key{}", i), value));
+		REQUIRE(value == fmt::format("value{}", i));
+	}
+	REQUIRE(store.table("named").isOpen());
+	store.close();
+
+	{
+		SQLite::Database db(path.u8string(), SQLite::OPEN_READONLY);
+		REQUIRE(db.execAndGet("SELECT \"value\" FROM ez_kvstore_meta WHERE \"key\" = 'version';").getInt64() == 3);
+		// Migrated files get a new application id, so older builds refuse them.
+		REQUIRE(db.execAndGet("PRAGMA main.application_id;").getInt() != static_cast<int32_t>(0xCB4D74FF));
+	}
+
+	REQUIRE(store.open(path, true));
+	REQUIRE(store.get("hello", value));
+	REQUIRE(value == "again");
+	REQUIRE(store.contains("what"));
+	REQUIRE(store.contains("key99"));
+	store.close();
+
+	// Files from newer versions of the library are refused.
+	{
+		SQLite::Database db(path.u8string(), SQLite::OPEN_READWRITE);
+		db.exec("UPDATE ez_kvstore_meta SET \"value\" = 4 WHERE \"key\" = 'version';");
+	}
+	REQUIRE(!store.open(path));
+	REQUIRE(!store.open(path, true));
+	REQUIRE(!store.isOpen());
+}
+
+TEST_CASE("ordered scans") {
+	fs::path path = test_dir;
+	path /= "write.db3";
+
+	ez::KVStore store;
+	REQUIRE(store.create(path, true));
+	REQUIRE(!store.hasKeyIndex());
+	REQUIRE(store.enableKeyIndex());
+	REQUIRE(store.hasKeyIndex());
+
+	for (int tenant = 40; tenant < 45; ++tenant) {
+		for (int i = 0; i < 20; ++i) {
+			REQUIRE(store.set(fmt::format("tenant{}/item{:02}", tenant, i), fmt::format("{}:{}", tenant, i)));
+		}
+	}
+	REQUIRE(store.set("tenant42", "parent"));
+	REQUIRE(store.set(std::string("tenant42/\xFF", 10), "last"));
+
+	std::vector<std::string> keys;
+	for (const ez::KVEntryView& entry : store.prefix("tenant42/")) {
+		keys.emplace_back(entry.key);
+	}
+	REQUIRE(keys.size() == 21);
+	REQUIRE(keys.front() == "tenant42/item00");
+	REQUIRE(keys[19] == "tenant42/item19");
+	REQUIRE(keys.back() == std::string("tenant42/\xFF", 10));
+	REQUIRE(std::is_sorted(keys.begin(), keys.end()));
+
+	keys.clear();
+	for (const ez::KVEntryView& entry : store.range("tenant43/item05", "tenant43/item08")) {
+		keys.emplace_back(entry.key);
+		REQUIRE(entry.value == fmt::format("43:{}", std::stoi(keys.back().substr(13))));
+	}
+	REQUIRE(keys == std::vector<std::string>{ "tenant43/item05", "tenant43/item06", "tenant43/item07" });
+
+	{
+		auto scan = store.lowerBound("tenant44/item19");
+		REQUIRE(scan.begin() != scan.end());
+		REQUIRE(scan.begin()->key == "tenant44/item19");
+	}
+	std::size_t count = 0;
+	for (const ez::KVEntryView& entry : store.lowerBound("tenant44")) {
+		(void)entry;
+		++count;
+	}
+	REQUIRE(count == 20);
+
+	REQUIRE(store.prefix("tenant99/").begin() == store.prefix("tenant99/").end());
+
+	// The scans make use of the index.
+	{
+		SQLite::Database db(path.u8string(), SQLite::OPEN_READONLY);
+		SQLite::Statement plan(db, "EXPLAIN QUERY PLAN SELECT \"key\", \"value\" FROM \"main\" WHERE \"key\" >= ? AND \"key\" < ? ORDER BY \"key\";");
+		std::string detail;
+		while (plan.executeStep()) {
+			detail += plan.getColumn(3).getString();
+		}
+		REQUIRE(detail.find("ez_kvstore_key_index") != std::string::npos);
+	}
+
+	// Scans still work without the index, just slower.
+	store.dropKeyIndex();
+	REQUIRE(!store.hasKeyIndex());
+	count = 0;
+	for (const ez::KVEntryView& entry : store.prefix("tenant40/")) {
+		REQUIRE(entry.key.substr(0, 9) == "tenant40/");
+		++count;
+	}
+	REQUIRE(count == 20);
+}
+
+TEST_CASE("parallel scan") {
+	fs::path path = test_dir;
+	path /= "write.db3";
+
+	ez::KVStore store;
+	REQUIRE(store.create(path, true));
+	REQUIRE(store.enableCodec(32));
+
+	const int count = 5000;
+	std::vector<ez::KVEntry> entries;
+	for (int i = 0; i < count; ++i) {
+		entries.push_back(ez::KVEntry{ fmt::format("key{}", i), fmt::format("value {} value {} value {}", i, i, i) });
+	}
+	store.bulkLoad(entries.begin(), entries.end());
+	REQUIRE(store.size() == count);
+
+	ez::KVScanOptions options;
+	options.partitions = 4;
+
+	// Every entry is visited exactly once.
+	std::vector<std::atomic<int>> seen(count);
+	std::atomic<std::size_t> total{ 0 };
+	std::atomic<bool> badPartition{ false };
+	store.parallelScan([&](std::size_t partition, const ez::KVEntryView& entry) {
+		// Catch assertions aren't thread safe, so the results are checked afterwards.
+		if (partition >= 4) {
+			badPartition = true;
+		}
+		int i = std::stoi(std::string(entry.key.substr(3)));
+		if (entry.value == fmt::format("value {} value {} value {}", i, i, i)) {
+			++seen[i];
+		}
+		++total;
+	}, options);
+	REQUIRE(!badPartition);
+	REQUIRE(total == count);
+	REQUIRE(std::all_of(seen.begin(), seen.end(), [](const std::atomic<int>& n) { return n == 1; }));
+
+	// Partitions hold contiguous hash ranges, and are reasonably balanced.
+	std::vector<std::vector<ez::KVEntry>> partitions = store.getPartitions(options);
+	REQUIRE(partitions.size() == 4);
+	std::size_t sum = 0;
+	for (const std::vector<ez::KVEntry>& partition : partitions) {
+		REQUIRE(partition.size() > count / 8);
+		sum += partition.size();
+	}
+	REQUIRE(sum == count);
+
+	options.batchSize = 100;
+	std::atomic<std::size_t> batched{ 0 };
+	std::atomic<bool> oversized{ false };
+	store.parallelScanBatches([&](std::size_t, const ez::KVEntryView* batch, std::size_t n) {
+		if (n > 100) {
+			oversized = true;
+		}
+		for (std::size_t i = 0; i < n; ++i) {
+			if (batch[i].key.substr(0, 3) == "key") {
+				++batched;
+			}
+		}
+	}, options);
+	REQUIRE(!oversized);
+	REQUIRE(batched == count);
+
+	std::unordered_map<std::string, std::string> map = store.getMap(options);
+	REQUIRE(map.size() == count);
+	REQUIRE(map["key42"] == "value 42 value 42 value 42");
+
+	// Changes of a batch in progress are only visible on the store's own connection.
+	REQUIRE(store.beginBatch());
+	REQUIRE(store.set("uncommitted", "value"));
+	REQUIRE(store.getEntries(options).size() == count + 1);
+	store.cancelBatch();
+	REQUIRE(store.getEntries(options).size() == count);
+}
+
+TEST_CASE("snapshot") {
+	fs::path path = test_dir;
+	path /= "write.db3";
+
+	ez::KVStore store;
+	REQUIRE(store.create(path, true));
+	REQUIRE(store.getSnapshot().empty());
+	REQUIRE(!store.getSnapshot().contains("anything"));
+
+	const int count = 2000;
+	for (int i = 0; i < count; ++i) {
+		REQUIRE(store.set(fmt::format("key{}", i), fmt::format("value{}", i)));
+	}
+	REQUIRE(store.set("empty", ""));
+
+	// A key displaced by a collision, as in the hash collision test.
+	{
+		SQLite::Database db(path.u8string(), SQLite::OPEN_READWRITE);
+		db.exec("UPDATE \"main\" SET \"hash\" = \"hash\" + 1 WHERE \"key\" = CAST('key7' AS BLOB);");
+		db.exec("INSERT INTO \"main\"(\"hash\", \"key\", \"value\") SELECT \"hash\" - 1, CAST('other' AS BLOB), 'x' FROM \"main\" WHERE \"key\" = CAST('key7' AS BLOB);");
+	}
+
+	ez::KVSnapshot snapshot = store.getSnapshot();
+	REQUIRE(snapshot.size() == count + 2);
+
+	std::size_t bytes = 0;
+	for (const ez::KVEntryView& entry : snapshot) {
+		bytes += entry.key.size() + entry.value.size();
+	}
+	REQUIRE(snapshot.bytes() == bytes);
+
+	std::string_view value;
+	for (int i = 0; i < count; ++i) {
+		REQUIRE(snapshot.get(fmt::format("key{}", i), value));
+		REQUIRE(value == fmt::format("value{}", i));
+	}
+	REQUIRE(snapshot.get("empty", value));
+	REQUIRE(value.empty());
+	REQUIRE(!snapshot.contains("key-1"));
+	REQUIRE(!snapshot.contains("other"));
+
+	// The snapshot is unaffected by later changes, and survives moves.
+	REQUIRE(store.erase("key1"));
+	ez::KVSnapshot moved = std::move(snapshot);
+	REQUIRE(moved.get("key1", value));
+	REQUIRE(value == "value1");
+	REQUIRE(moved.find("key7")->value == "value7");
+}
+
+TEST_CASE("frozen store") {
+	fs::path path = test_dir;
+	path /= "write.db3";
+	fs::path frozenPath = test_dir;
+	frozenPath /= "write.kvf";
+
+	ez::KVStore store;
+	REQUIRE(store.create(path, true));
+
+	// Empty stores freeze too.
+	REQUIRE(store.exportFrozen(frozenPath));
+	{
+		ez::KVFrozenStore frozen;
+		REQUIRE(frozen.open(frozenPath));
+		REQUIRE(frozen.empty());
+		REQUIRE(!frozen.contains("anything"));
+		REQUIRE(frozen.begin() == frozen.end());
+	}
+
+	REQUIRE(store.enableCodec(32));
+	const int count = 10000;
+	for (int i = 0; i < count; ++i) {
+		REQUIRE(store.set(fmt::format("key{}", i), std::string(i % 100, char('a' + i % 26))));
+	}
+	REQUIRE(store.set("", "empty key"));
+	REQUIRE(store.exportFrozen(frozenPath));
+	store.close();
+
+	ez::KVFrozenStore frozen;
+	REQUIRE(!frozen.open(path));
+	REQUIRE(frozen.open(frozenPath));
+	REQUIRE(frozen.size() == count + 1);
+
+	std::string_view view;
+	for (int i = 0; i < count; ++i) {
+		REQUIRE(frozen.getView(fmt::format("key{}", i), view));
+		REQUIRE(view == std::string(i % 100, char('a' + i % 26)));
+		// Values are aligned in the mapping.
+		REQUIRE(reinterpret_cast<std::uintptr_t>(view.data()) % 8 == 0);
+	}
+	std::string value;
+	REQUIRE(frozen.get("", value));
+	REQUIRE(value == "empty key");
+	REQUIRE(!frozen.contains("key-1"));
+	REQUIRE(!frozen.contains(std::to_string(count)));
+
+	std::size_t seen = 0;
+	for (const ez::KVEntryView& entry : frozen) {
+		if (entry.key.substr(0, 3) == "key") {
+			int i = std::stoi(std::string(entry.key.substr(3)));
+			REQUIRE(entry.value == std::string(i % 100, char('a' + i % 26)));
+		}
+		++seen;
+	}
+	REQUIRE(seen == count + 1);
+	REQUIRE(frozen.getMap().size() == count + 1);
+
+	ez::KVFrozenStore moved = std::move(frozen);
+	REQUIRE(!frozen.isOpen());
+	REQUIRE(moved.contains("key42"));
+	moved.close();
+
+	// Counts in the header that only fit once multiplied out and wrapped around are refused.
+	{
+		std::fstream file(frozenPath, std::ios::in | std::ios::out | std::ios::binary);
+		uint64_t numBuckets = (uint64_t(1) << 62) + 1;
+		file.seekp(32);
+		file.write((const char*)&numBuckets, sizeof(numBuckets));
+	}
+	REQUIRE(!frozen.open(frozenPath));
+
+	fs::remove(frozenPath);
+}
+
+TEST_CASE("sharded store") {
+	fs::path directory = test_dir;
+	directory /= "sharded";
+	fs::remove_all(directory);
+
+	ez::ShardedKVStore store;
+	REQUIRE(!store.open(directory));
+	REQUIRE(store.create(directory, 4));
+	REQUIRE(store.numShards() == 4);
+	REQUIRE(store.empty());
+
+	// Concurrent writers, spread over the shards.
+	const int threads = 4, perThread = 500;
+	{
+		std::vector<std::thread> writers;
+		for (int t = 0; t < threads; ++t) {
+			writers.emplace_back([&, t]() {
+				for (int i = 0; i < perThread; ++i) {
+					store.set(fmt::format("t{}/{}", t, i), fmt::format("{}", i));
+				}
+			});
+		}
+		for (std::thread& writer : writers) {
+			writer.join();
+		}
+	}
+	REQUIRE(store.size() == threads * perThread);
+
+	std::vector<std::size_t> perShard(4, 0);
+	for (int i = 0; i < perThread; ++i) {
+		++perShard[store.shardOf(fmt::format("t0/{}", i))];
+	}
+	for (std::size_t n : perShard) {
+		REQUIRE(n > 0);
+	}
+
+	std::string value;
+	REQUIRE(store.get("t3/42", value));
+	REQUIRE(value == "42");
+	REQUIRE(store.contains("t0/0"));
+	REQUIRE(!store.contains("missing"));
+
+	std::vector<std::string_view> request{ "t1/1", "missing", "t2/2", "t3/3" };
+	ez::KVBatchResult result;
+	REQUIRE(store.getMany(request, result) == 3);
+	REQUIRE(result.value(0) == "1");
+	REQUIRE(!result.found(1));
+	REQUIRE(result.value(3) == "3");
+
+	// Renames across shards.
+	std::string target = "renamed";
+	while (store.shardOf(target) == store.shardOf("t0/7")) {
+		target += "+";
+	}
+	REQUIRE(store.rename("t0/7", target));
+	REQUIRE(!store.contains("t0/7"));
+	REQUIRE(store.get(target, value));
+	REQUIRE(value == "7");
+	REQUIRE(store.erase(target));
+
+	// Batches commit in parallel, or not at all.
+	REQUIRE(store.beginBatch());
+	REQUIRE(store.inBatch());
+	for (int i = 0; i < 100; ++i) {
+		REQUIRE(store.set(fmt::format("batch{}", i), "x"));
+	}
+	store.cancelBatch();
+	REQUIRE(!store.contains("batch1"));
+	REQUIRE(store.beginBatch());
+	for (int i = 0; i < 100; ++i) {
+		REQUIRE(store.set(fmt::format("batch{}", i), "x"));
+	}
+	store.commitBatch();
+	REQUIRE(!store.inBatch());
+	REQUIRE(store.size() == threads * perThread - 1 + 100);
+
+	std::vector<ez::KVEntry> entries;
+	for (int i = 0; i < 1000; ++i) {
+		entries.push_back(ez::KVEntry{ fmt::format("bulk{}", i), std::string(i % 50, 'b') });
+	}
+	std::size_t next = 0;
+	ez::KVBulkOptions options;
+	options.chunkBytes = 4096;
+	ez::KVBulkStats stats = store.bulkLoad([&](ez::KVEntryView& entry) {
+		if (next == entries.size()) {
+			return false;
+		}
+		entry.key = entries[next].key;
+		entry.value = entries[next].value;
+		++next;
+		return true;
+	}, options);
+	REQUIRE(stats.entries == 1000);
+	REQUIRE(store.get("bulk999", value));
+	REQUIRE(value == std::string(999 % 50, 'b'));
+
+	std::size_t count = 0;
+	for (const ez::KVEntryView& entry : store) {
+		(void)entry;
+		++count;
+	}
+	REQUIRE(count == store.size());
+
+	// A moved from store behaves like a closed one.
+	ez::ShardedKVStore moved(std::move(store));
+	REQUIRE(moved.isOpen());
+	REQUIRE(!store.isOpen());
+	REQUIRE(store.numShards() == 0);
+	REQUIRE(store.numValues() == 0);
+	REQUIRE(!store.set("key", "value"));
+	REQUIRE(store.begin() == store.end());
+	store.close();
+	store = std::move(moved);
+	REQUIRE(store.size() == count);
+
+	// The manifest brings back the same shard layout.
+	store.close();
+	REQUIRE(!store.create(directory, 2));
+	REQUIRE(store.open(directory, true));
+	REQUIRE(store.numShards() == 4);
+	REQUIRE(store.get("t2/499", value));
+	REQUIRE(value == "499");
+	store.close();
+
+	REQUIRE(store.create(directory, 2, true));
+	REQUIRE(store.empty());
+	store.close();
+	REQUIRE(!fs::exists(directory / "shard_003.db3"));
+
+	fs::remove_all(directory);
+}
+
+TEST_CASE("status") {
+	fs::path path = test_dir;
+	path /= "write.db3";
+
+	ez::KVStore store;
+	REQUIRE(store.create(path, true, ez::KVOpenOptions::fastWrite()));
+	store.resetStatus();
+
+	REQUIRE(store.set("alpha", "12345"));
+	REQUIRE(store.set("beta", "678"));
+
+	std::string value;
+	REQUIRE(store.get("alpha", value));
+	REQUIRE(!store.get("missing", value));
+	REQUIRE(store.contains("beta"));
+
+	std::vector<std::string_view> names{ "alpha", "beta", "missing" };
+	ez::KVBatchResult batch;
+	REQUIRE(store.getMany(names, batch) == 2);
+
+	REQUIRE(store.beginBatch());
+	REQUIRE(store.rename("beta", "gamma"));
+	REQUIRE(store.erase("gamma"));
+	store.commitBatch();
+	REQUIRE(store.getMap().size() == 1);
+
+	ez::KVStatus status = store.getStatus();
+	REQUIRE(status[ez::KVOp::Set].count == 2);
+	REQUIRE(status[ez::KVOp::Set].bytesWritten == 5 + 5 + 4 + 3);
+	REQUIRE(status[ez::KVOp::Get].count == 5);
+	REQUIRE(status[ez::KVOp::Get].latency.samples == 3);
+	REQUIRE(status[ez::KVOp::Get].bytesRead == 5 + 5 + 3);
+	REQUIRE(status[ez::KVOp::Contains].count == 1);
+	REQUIRE(status[ez::KVOp::Rename].count == 1);
+	REQUIRE(status[ez::KVOp::Erase].count == 1);
+	REQUIRE(status[ez::KVOp::Commit].count == 1);
+	REQUIRE(status[ez::KVOp::Scan].count == 1);
+	REQUIRE(status[ez::KVOp::Scan].bytesRead == 5 + 5);
+	REQUIRE(status.bytesWritten() == 17);
+
+	const ez::KVHistogram& latency = status[ez::KVOp::Set].latency;
+	REQUIRE(latency.percentile(0.5) <= latency.percentile(0.99));
+	REQUIRE(latency.percentile(1.0) <= latency.max());
+	REQUIRE(latency.mean() <= latency.max());
+
+	REQUIRE(status.sqlite.pageSize > 0);
+	REQUIRE(status.sqlite.pageCount > 0);
+	REQUIRE(status.sqlite.memoryUsed > 0);
+	REQUIRE(status.sqlite.walBytes > 0);
+	REQUIRE(status.sqlite.cacheHits + status.sqlite.cacheMisses > 0);
+
+	// A zero threshold reports every operation.
+	std::vector<ez::KVOp> slow;
+	std::string slowKey;
+	store.setSlowOperationCallback(std::chrono::nanoseconds(0), [&](ez::KVOp op, std::string_view key, std::chrono::nanoseconds) {
+		slow.push_back(op);
+		slowKey = key;
+	});
+	REQUIRE(store.contains("alpha"));
+	REQUIRE(slow.size() == 1);
+	REQUIRE(slow[0] == ez::KVOp::Contains);
+	REQUIRE(slowKey == "alpha");
+
+	store.setSlowOperationCallback(std::chrono::hours(1), nullptr);
+	REQUIRE(store.contains("alpha"));
+	REQUIRE(slow.size() == 1);
+	REQUIRE(store.getStatus().slowOps == 1);
+
+	store.resetStatus();
+	status = store.getStatus();
+	REQUIRE(status[ez::KVOp::Contains].count == 0);
+	REQUIRE(status[ez::KVOp::Contains].latency.samples == 0);
+	REQUIRE(status.slowOps == 0);
+	REQUIRE(status.sqlite.cacheHits == 0);
+}
+
+TEST_CASE("cursor") {
+	fs::path path = test_dir;
+	path /= "write.db3";
+
+	ez::KVStore store;
+	REQUIRE(store.create(path, true));
+
+	std::unordered_map<std::string, std::string> expected;
+	for (int i = 0; i < 1000; ++i) {
+		expected[fmt::format("key{}", i)] = fmt::format("value{}", i * 7);
+	}
+	std::vector<ez::KVEntryView> source;
+	for (const auto& [key, value] : expected) {
+		source.push_back(ez::KVEntryView{ key, value });
+	}
+	store.bulkLoad(source.begin(), source.end());
+
+	ez::KVCursor cursor;
+	REQUIRE(!cursor.isOpen());
+	REQUIRE(store.openCursor(cursor));
+	REQUIRE(cursor.isOpen());
+
+	// Page through the store, resuming each page from a token as a stateless listing would.
+	std::unordered_map<std::string, std::string> seen;
+	std::vector<ez::KVEntryView> page;
+	std::string token = cursor.token();
+	int pages = 0;
+	while (true) {
+		REQUIRE(store.openCursor(cursor, token));
+		cursor.next(page, 64);
+		for (const ez::KVEntryView& entry : page) {
+			REQUIRE(seen.emplace(std::string(entry.key), std::string(entry.value)).second);
+		}
+		token = cursor.token();
+		++pages;
+		if (cursor.atEnd()) {
+			break;
+		}
+	}
+	REQUIRE(pages == 16);
+	REQUIRE(seen == expected);
+
+	// An exhausted cursor stays exhausted, even through its token.
+	REQUIRE(!cursor.next(page[0]));
+	REQUIRE(store.openCursor(cursor, token));
+	REQUIRE(cursor.atEnd());
+
+	// Paused cursors carry on where they left off, and writes in between are allowed.
+	REQUIRE(store.openCursor(cursor));
+	std::size_t count = cursor.next(page, 500);
+	REQUIRE(count == 500);
+	cursor.pause();
+	REQUIRE(store.set("extra", "value"));
+	REQUIRE(store.erase("extra"));
+	ez::KVEntryView entry;
+	while (cursor.next(entry)) {
+		++count;
+	}
+	REQUIRE(count == expected.size());
+
+	// Seeking past the last entry finds nothing.
+	cursor.seek(std::numeric_limits<int64_t>::max());
+	count = cursor.next(page, 10);
+	REQUIRE(count <= 1);
+	REQUIRE(cursor.atEnd());
+
+	REQUIRE(!cursor.resume("bogus"));
+	REQUIRE(!cursor.resume("ezkv1:123"));
+	REQUIRE(!store.openCursor(cursor, "ezkv1:zzzzzzzzzzzzzzzz"));
+	REQUIRE(!cursor.isOpen());
+
+	cursor.close();
+	store.close();
+}
+
+TEST_CASE("async store") {
+	fs::path path = test_dir;
+	path /= "write.db3";
+
+	{
+		ez::KVStore store;
+		REQUIRE(store.create(path, true));
+		REQUIRE(store.set("old", "value"));
+	}
+
+	ez::KVAsyncStore store;
+	REQUIRE(!store.isOpen());
+	REQUIRE(!store.getAsync("old").get());
+	REQUIRE(!store.setAsync("early", "value").get());
+
+	// Deliveries are queued up and run by the test, as an event loop would.
+	std::mutex mutex;
+	std::vector<std::function<void()>> posted;
+	ez::KVAsyncStoreOptions options;
+	options.readers = 2;
+	options.dispatch = [&](std::function<void()> task) {
+		std::lock_guard<std::mutex> lock(mutex);
+		posted.push_back(std::move(task));
+	};
+	auto runPosted = [&]() {
+		std::vector<std::function<void()>> tasks;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			tasks.swap(posted);
+		}
+		for (std::function<void()>& task : tasks) {
+			task();
+		}
+		return tasks.size();
+	};
+
+	REQUIRE(store.open(path, options));
+	REQUIRE(store.isOpen());
+
+	std::vector<ez::KVAsync<bool>> writes;
+	for (int i = 0; i < 200; ++i) {
+		writes.push_back(store.setAsync(fmt::format("key{}", i), fmt::format("value{}", i)));
+	}
+	writes.push_back(store.eraseAsync("old"));
+	ez::KVAsync<bool> flushed = store.flushAsync();
+
+	// Nothing completes until the posted deliveries run.
+	while (!flushed.ready()) {
+		runPosted();
+		std::this_thread::yield();
+	}
+	REQUIRE(flushed.get());
+	for (ez::KVAsync<bool>& write : writes) {
+		REQUIRE(write.ready());
+		REQUIRE(write.get());
+	}
+
+	std::vector<ez::KVAsync<std::optional<std::string>>> reads;
+	for (int i = 0; i < 200; i += 7) {
+		reads.push_back(store.getAsync(fmt::format("key{}", i)));
+	}
+	reads.push_back(store.getAsync("old"));
+
+	std::atomic<int> called{ 0 };
+	store.getAsync("key5", [&](std::optional<std::string> value) {
+		called += value && *value == "value5" ? 1 : 0;
+	});
+
+	std::size_t delivered = 0;
+	while (delivered < reads.size() + 1) {
+		delivered += runPosted();
+		std::this_thread::yield();
+	}
+	for (std::size_t i = 0; i + 1 < reads.size(); ++i) {
+		std::optional<std::string> value = reads[i].get();
+		REQUIRE(value);
+		REQUIRE(*value == fmt::format("value{}", i * 7));
+	}
+	REQUIRE(!reads.back().get());
+	REQUIRE(called == 1);
+
+	// Page through everything with tokens.
+	std::unordered_set<std::string> keys;
+	std::string token;
+	while (true) {
+		ez::KVAsync<ez::KVScanPage> pending = store.scanAsync(token, 64);
+		while (!pending.ready()) {
+			runPosted();
+			std::this_thread::yield();
+		}
+		ez::KVScanPage page = pending.get();
+		for (const ez::KVEntry& entry : page.entries) {
+			REQUIRE(keys.insert(entry.key).second);
+		}
+		token = page.token;
+		if (page.done) {
+			break;
+		}
+	}
+	REQUIRE(keys.size() == 200);
+
+	// Awaiting goes through the same protocol a coroutine uses, with the handle resumed where the result is delivered.
+	struct Handle {
+		int* resumed;
+		void resume() {
+			++*resumed;
+		}
+	};
+	int resumed = 0;
+	ez::KVAsync<std::optional<std::string>> awaited = store.getAsync("key1");
+	if (!awaited.await_ready() && awaited.await_suspend(Handle{ &resumed })) {
+		while (resumed == 0) {
+			runPosted();
+			std::this_thread::yield();
+		}
+	}
+	REQUIRE(*awaited.await_resume() == "value1");
+
+	// Moving keeps the threads running, the moved from store refuses everything right away.
+	ez::KVAsyncStore moved(std::move(store));
+	REQUIRE(moved.isOpen());
+	REQUIRE(!store.isOpen());
+	REQUIRE(!store.getAsync("key1").get());
+	REQUIRE(!store.setAsync("key1", "value").get());
+	REQUIRE(store.pendingReads() == 0);
+	ez::KVAsync<std::optional<std::string>> afterMove = moved.getAsync("key2");
+	while (!afterMove.ready()) {
+		runPosted();
+		std::this_thread::yield();
+	}
+	REQUIRE(*afterMove.get() == "value2");
+	store = std::move(moved);
+	REQUIRE(store.isOpen());
+
+	store.close();
+	REQUIRE(!store.isOpen());
+	// Reads issued after closing are completed right away, still delivered through dispatch.
+	ez::KVAsync<std::optional<std::string>> closedGet = store.getAsync("key1");
+	ez::KVAsync<ez::KVScanPage> closedScan = store.scanAsync("", 10);
+	REQUIRE(runPosted() == 2);
+	REQUIRE(!closedGet.get());
+	REQUIRE(closedScan.get().done);
+}
+
+TEST_CASE("read snapshot") {
+	fs::path path = test_dir;
+	path /= "write.db3";
+
+	ez::KVStore store;
+	REQUIRE(store.create(path, true));
+	std::unordered_map<std::string, std::string> before;
+	for (int i = 0; i < 500; ++i) {
+		before[fmt::format("key{}", i)] = fmt::format("value{}", i);
+	}
+	REQUIRE(store.beginBatch());
+	for (const auto& [key, value] : before) {
+		REQUIRE(store.set(key, value));
+	}
+	store.commitBatch();
+
+	// The store is switched to WAL for the snapshot.
+	ez::KVReadSnapshot snapshot = store.snapshot();
+	REQUIRE(snapshot.isOpen());
+	REQUIRE(snapshot.numValues() == 500);
+
+	// Write through this handle and another one while the snapshot is read.
+	ez::KVStore other;
+	REQUIRE(other.open(path));
+	std::size_t count = 0;
+	for (const ez::KVEntryView& entry : snapshot) {
+		REQUIRE(before.at(std::string(entry.key)) == entry.value);
+		if (count % 10 == 0) {
+			REQUIRE(store.set(fmt::format("new{}", count), "value"));
+			REQUIRE(other.erase(fmt::format("key{}", count)));
+			REQUIRE(store.set(fmt::format("key{}", count + 1), "changed"));
+		}
+		++count;
+	}
+	REQUIRE(count == 500);
+	REQUIRE(store.numValues() == 500);
+	REQUIRE(store.contains("new0"));
+	REQUIRE(!store.contains("key0"));
+
+	// Every read sees the file as it was.
+	REQUIRE(snapshot.getMap() == before);
+	REQUIRE(snapshot.numValues() == 500);
+	REQUIRE(!snapshot.contains("new0"));
+	REQUIRE(snapshot.contains("key0"));
+	std::string value;
+	REQUIRE(snapshot.get("key1", value));
+	REQUIRE(value == "value1");
+
+	std::vector<std::string_view> names{ "key0", "key1", "new0" };
+	ez::KVBatchResult batch;
+	REQUIRE(snapshot.getMany(names, batch) == 2);
+
+	ez::KVCursor cursor;
+	REQUIRE(snapshot.openCursor(cursor));
+	std::vector<ez::KVEntryView> page;
+	REQUIRE(cursor.next(page, 1000) == 500);
+	cursor.close();
+
+	// A new snapshot sees the writes.
+	ez::KVReadSnapshot later = store.snapshot();
+	REQUIRE(later.isOpen());
+	REQUIRE(later.contains("new0"));
+	REQUIRE(later.get("key1", value));
+	REQUIRE(value == "changed");
+
+	snapshot.close();
+	REQUIRE(!snapshot.isOpen());
+	later.close();
+	other.close();
+	store.close();
+}
+
+TEST_CASE("compaction") {
+	fs::path path = test_dir;
+	path /= "write.db3";
+	std::string value(2000, 'x');
+
+	ez::KVOpenOptions options;
+	options.autoVacuum = ez::KVOpenOptions::AutoVacuum::Incremental;
+
+	ez::KVStore store;
+	REQUIRE(store.create(path, true, options));
+	REQUIRE(store.getSpaceStats().incremental);
+
+	auto fill = [&] {
+		store.beginBatch();
+		for (int i = 0; i < 1000; ++i) {
+			REQUIRE(store.set(fmt::format("key{}", i), value));
+		}
+		store.commitBatch();
+	};
+	auto drain = [&] {
+		store.beginBatch();
+		for (int i = 0; i < 1000; i += 2) {
+			REQUIRE(store.erase(fmt::format("key{}", i)));
+		}
+		store.commitBatch();
+	};
+
+	fill();
+	drain();
+	ez::KVSpaceStats stats = store.getSpaceStats();
+	REQUIRE(stats.freePages > 10);
+	REQUIRE(stats.fragmentation() > 0.0);
+	REQUIRE(stats.freeBytes() == stats.freePages * stats.pageSize);
+
+	// Bounded steps, then whatever is left.
+	REQUIRE(store.compact(10) == 10);
+	REQUIRE(store.getSpaceStats().freePages == stats.freePages - 10);
+	REQUIRE(store.compact() == std::size_t(stats.freePages - 10));
+	stats = store.getSpaceStats();
+	REQUIRE(stats.freePages == 0);
+	REQUIRE(stats.fragmentation() == 0.0);
+	REQUIRE(store.numValues() == 500);
+
+	// A store without incremental auto vacuum can't be compacted until it is rebuilt.
+	store.clear();
+	REQUIRE(store.vacuum(ez::KVOpenOptions::AutoVacuum::None));
+	fill();
+	drain();
+	stats = store.getSpaceStats();
+	REQUIRE(!stats.incremental);
+	REQUIRE(stats.freePages > 0);
+	REQUIRE(store.compact() == 0);
+
+	REQUIRE(store.vacuum(ez::KVOpenOptions::AutoVacuum::Incremental));
+	stats = store.getSpaceStats();
+	REQUIRE(stats.incremental);
+	REQUIRE(stats.freePages == 0);
+	REQUIRE(store.numValues() == 500);
+
+	store.beginBatch();
+	REQUIRE(!store.vacuum());
+	store.commitBatch();
+
+	// The maintenance thread frees the pages in steps, one per pass.
+	store.clear();
+	fill();
+	drain();
+	stats = store.getSpaceStats();
+	store.close();
+
+	ez::KVMaintenanceOptions maintenanceOptions;
+	maintenanceOptions.interval = std::chrono::milliseconds(5);
+	maintenanceOptions.stepPages = 16;
+	maintenanceOptions.minFreePages = 1;
+	maintenanceOptions.minFragmentation = 0.0;
+
+	ez::KVMaintenance maintenance;
+	REQUIRE(maintenance.open(path, maintenanceOptions));
+	REQUIRE(maintenance.getSpaceStats().freePages == stats.freePages);
+	maintenance.wake();
+	for (int i = 0; i < 1000 && maintenance.pagesFreed() < std::size_t(stats.freePages); ++i) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	}
+	REQUIRE(maintenance.pagesFreed() == std::size_t(stats.freePages));
+	REQUIRE(maintenance.numPasses() >= std::size_t(stats.freePages / 16));
+
+	ez::KVMaintenance moved(std::move(maintenance));
+	REQUIRE(moved.isOpen());
+	REQUIRE(!maintenance.isOpen());
+	REQUIRE(maintenance.numPasses() == 0);
+	maintenance.wake();
+	maintenance = std::move(moved);
+	maintenance.close();
+	REQUIRE(!maintenance.isOpen());
+
+	// Attaching maintenance leaves the journal mode of the file alone.
+	{
+		SQLite::Database db(path.u8string(), SQLite::OPEN_READONLY);
+		REQUIRE(db.execAndGet("PRAGMA main.journal_mode;").getString() != "wal");
+	}
+
+	REQUIRE(store.open(path));
+	REQUIRE(store.getSpaceStats().freePages == 0);
+	REQUIRE(store.numValues() == 500);
+	store.close();
+}
+
+TEST_CASE("named tables") {
+	fs::path path = test_dir;
+	path /= "write.db3";
+
+	ez::KVStore store;
+	REQUIRE(store.create(path, true));
+	REQUIRE(store.tableNames().empty());
+	REQUIRE(!store.hasTable("sessions"));
+
+	ez::KVTable sessions = store.table("sessions");
+	ez::KVTable users = store.table("users");
+	REQUIRE(sessions.isOpen());
+	REQUIRE(sessions.name() == "sessions");
+	REQUIRE(store.hasTable("sessions"));
+	REQUIRE(store.tableNames() == std::vector<std::string>{ "sessions", "users" });
+
+	// The same key in every table, each with its own value.
+	REQUIRE(store.set("key", "main"));
+	REQUIRE(sessions.set("key", "session"));
+	REQUIRE(users.set("key", "user"));
+	std::string value;
+	REQUIRE(store.get("key", value));
+	REQUIRE(value == "main");
+	REQUIRE(sessions.get("key", value));
+	REQUIRE(value == "session");
+	REQUIRE(users.get("key", value));
+	REQUIRE(value == "user");
+
+	store.beginBatch();
+	for (int i = 0; i < 1000; ++i) {
+		REQUIRE(sessions.set(fmt::format("session{}", i), fmt::format("value{}", i)));
+	}
+	store.commitBatch();
+	REQUIRE(sessions.numValues() == 1001);
+	REQUIRE(users.numValues() == 1);
+	REQUIRE(store.numValues() == 1);
+	REQUIRE(sessions.getMap().size() == 1001);
+	REQUIRE(!store.contains("session0"));
+
+	REQUIRE(sessions.erase("session0"));
+	REQUIRE(!sessions.erase("session0"));
+	REQUIRE(sessions.rename("session1", "renamed"));
+	REQUIRE(sessions.get("renamed", value));
+	REQUIRE(value == "value1");
+	REQUIRE(sessions.numValues() == 1000);
+
+	std::vector<std::string_view> names{ "session2", "session0", "renamed" };
+	std::vector<bool> found;
+	REQUIRE(sessions.containsMany(names, found) == 2);
+	REQUIRE(found == std::vector<bool>{ true, false, true });
+	ez::KVBatchResult batch;
+	REQUIRE(sessions.getMany(names, batch) == 2);
+	REQUIRE(batch.value(0) == "value2");
+
+	std::size_t count = 0;
+	for (const ez::KVEntryView& entry : sessions.prefix("session99")) {
+		REQUIRE(entry.key.substr(0, 9) == "session99");
+		++count;
+	}
+	REQUIRE(count == 11);
+
+	// A batch spanning tables commits or rolls back as a whole, including tables created in it.
+	store.beginBatch();
+	REQUIRE(store.set("batched", "main"));
+	REQUIRE(users.set("batched", "user"));
+	ez::KVTable temp = store.table("temp");
+	REQUIRE(temp.set("batched", "temp"));
+	store.cancelBatch();
+	REQUIRE(!store.contains("batched"));
+	REQUIRE(!users.contains("batched"));
+	REQUIRE(!temp.isOpen());
+	REQUIRE(!temp.set("batched", "temp"));
+	REQUIRE(!store.hasTable("temp"));
+	REQUIRE(users.contains("key"));
+
+	store.beginBatch();
+	REQUIRE(store.set("batched", "main"));
+	REQUIRE(users.set("batched", "user"));
+	store.commitBatch();
+	REQUIRE(store.contains("batched"));
+	REQUIRE(users.contains("batched"));
+
+	// Tables stay in the file, and other connections see them.
+	store.close();
+	REQUIRE(!sessions.isOpen());
+	REQUIRE(store.open(path, true));
+	ez::KVTable readSessions = store.table("sessions");
+	REQUIRE(readSessions.isOpen());
+	REQUIRE(readSessions.numValues() == 1000);
+	REQUIRE(!store.table("missing").isOpen());
+	REQUIRE(!store.hasTable("missing"));
+	store.close();
+
+	REQUIRE(store.open(path));
+	sessions = store.table("sessions");
+	users = store.table("users");
+
+	// Clearing and dropping don't depend on the size of the table.
+	sessions.clear();
+	REQUIRE(sessions.isOpen());
+	REQUIRE(sessions.empty());
+	REQUIRE(sessions.set("fresh", "value"));
+	REQUIRE(sessions.numValues() == 1);
+
+	// While a scan is open tables can't be dropped, clearing deletes the rows instead.
+	{
+		auto it = store.begin();
+		REQUIRE(it != store.end());
+		REQUIRE(sessions.set("other", "value"));
+		sessions.clear();
+		REQUIRE(sessions.isOpen());
+		REQUIRE(sessions.empty());
+		REQUIRE(!sessions.contains("fresh"));
+		REQUIRE(!store.dropTable("users"));
+		REQUIRE(users.isOpen());
+		REQUIRE(users.contains("key"));
+	}
+	REQUIRE(sessions.set("fresh", "value"));
+	REQUIRE(sessions.numValues() == 1);
+
+	REQUIRE(store.dropTable("users"));
+	REQUIRE(!store.dropTable("users"));
+	REQUIRE(!users.isOpen());
+	REQUIRE(!users.contains("key"));
+	REQUIRE(store.tableNames() == std::vector<std::string>{ "sessions" });
+
+	// Dropped names can be reused, starting out empty.
+	users = store.table("users");
+	REQUIRE(users.isOpen());
+	REQUIRE(users.empty());
+	REQUIRE(store.get("key", value));
+	REQUIRE(value == "main");
+
+	// Enabling codecs converts the values of the named tables too.
+	REQUIRE(sessions.set("long", std::string(1000, 'a')));
+	REQUIRE(store.enableCodec());
+	REQUIRE(sessions.get("fresh", value));
+	REQUIRE(value == "value");
+	REQUIRE(sessions.set("longer", std::string(2000, 'b')));
+	REQUIRE(sessions.get("longer", value));
+	REQUIRE(value == std::string(2000, 'b'));
+	REQUIRE(sessions.get("long", value));
+	REQUIRE(value == std::string(1000, 'a'));
+
+	store.close();
+}
+
+TEST_CASE("typed values") {
+	fs::path path = test_dir;
+	path /= "write.db3";
+
+	struct Point {
+		float x, y, z;
+		int32_t id;
+	};
+	enum class Color : uint16_t {
+		Red = 1,
+		Green = 0x0102,
+	};
+
+	ez::KVStore store;
+	REQUIRE(store.create(path, true));
+
+	REQUIRE(store.set("counter", int64_t(42)));
+	REQUIRE(store.set("point", Point{ 1.f, 2.f, 3.f, 7 }));
+	REQUIRE(store.set("color", Color::Green));
+	// Literals and views still go through the string overloads.
+	REQUIRE(store.set("string", "value"));
+	REQUIRE(store.set("view", std::string_view("value")));
+	std::string value;
+	REQUIRE(store.get("string", value));
+	REQUIRE(value == "value");
+	REQUIRE(store.get("view", value));
+	REQUIRE(value == "value");
+
+	int64_t counter = 0;
+	REQUIRE(store.get("counter", counter));
+	REQUIRE(counter == 42);
+	Point point{};
+	REQUIRE(store.get("point", point));
+	REQUIRE(point.y == 2.f);
+	REQUIRE(point.id == 7);
+	Color color{};
+	REQUIRE(store.get("color", color));
+	REQUIRE(color == Color::Green);
+
+	// Sizes have to match.
+	int32_t small;
+	REQUIRE(!store.get("counter", small));
+	REQUIRE(!store.get("point", counter));
+	REQUIRE(!store.get("missing", counter));
+
+	std::vector<float> floats(1000);
+	for (std::size_t i = 0; i < floats.size(); ++i) {
+		floats[i] = float(i) * 0.5f;
+	}
+	REQUIRE(store.setSpan("floats", floats.data(), floats.size()));
+	const float* view = nullptr;
+	std::size_t count = 0;
+	REQUIRE(store.getSpan("floats", view, count));
+	REQUIRE(count == 1000);
+	REQUIRE(view[999] == 499.5f);
+	std::vector<float> copy;
+	REQUIRE(store.getSpan("floats", copy));
+	REQUIRE(copy == floats);
+	const double* doubles;
+	REQUIRE(!store.getSpan("color", doubles, count));
+
+	// Layout tags refuse other versions, and convert the byte order of arithmetic values.
+	ez::KVLayout v1{ 1 };
+	ez::KVLayout v2{ 2 };
+	REQUIRE(store.set("tagged", point, v1));
+	REQUIRE(!store.get("tagged", point));
+	REQUIRE(!store.get("tagged", point, v2));
+	point = Point{};
+	REQUIRE(store.get("tagged", point, v1));
+	REQUIRE(point.id == 7);
+
+	ez::KVLayout other{ 1, ez::KVEndian::Native == ez::KVEndian::Little ? ez::KVEndian::Big : ez::KVEndian::Little };
+	REQUIRE(!store.set("swapped", point, other));
+	REQUIRE(store.set("swapped", uint32_t(0x01020304), other));
+	const void* raw;
+	std::size_t len;
+	REQUIRE(store.getRaw("swapped", raw, len));
+	REQUIRE(len == ez::kvLayoutBytes + 4);
+	uint32_t stored;
+	std::memcpy(&stored, (const char*)raw + ez::kvLayoutBytes, 4);
+	REQUIRE(stored == 0x04030201);
+	uint32_t swapped = 0;
+	REQUIRE(store.get("swapped", swapped, v1));
+	REQUIRE(swapped == 0x01020304);
+
+	REQUIRE(store.setSpan("swappedFloats", floats.data(), floats.size(), other));
+	REQUIRE(store.getSpan("swappedFloats", view, count, v1));
+	REQUIRE(count == 1000);
+	REQUIRE(std::equal(view, view + count, floats.begin()));
+
+	// Values with a codec header are read just the same, copied when misaligned.
+	REQUIRE(store.enableCodec(16));
+	REQUIRE(store.get("counter", counter));
+	REQUIRE(counter == 42);
+	REQUIRE(store.getSpan("floats", view, count));
+	REQUIRE(reinterpret_cast<std::uintptr_t>(view) % alignof(float) == 0);
+	REQUIRE(std::equal(view, view + count, floats.begin()));
+	REQUIRE(store.setSpan("floats", floats.data(), floats.size()));
+	REQUIRE(store.getSpan("floats", copy));
+	REQUIRE(copy == floats);
+
+	store.close();
+}
+
+TEST_CASE("read modify write") {
+	fs::path path = test_dir;
+	path /= "write.db3";
+
+	ez::KVStore store;
+	REQUIRE(store.create(path, true));
+	store.setCacheCapacity(1 << 20);
+
+	int64_t count = 0;
+	REQUIRE(store.increment("counter", 5, count));
+	REQUIRE(count == 5);
+	REQUIRE(store.increment("counter"));
+	REQUIRE(store.increment("counter", -2, count));
+	REQUIRE(count == 4);
+	int64_t stored = 0;
+	REQUIRE(store.get("counter", stored));
+	REQUIRE(stored == 4);
+	REQUIRE(store.set("counter", int64_t(100)));
+	REQUIRE(store.increment("counter", 1, count));
+	REQUIRE(count == 101);
+	REQUIRE(store.set("text", "not a counter"));
+	REQUIRE(!store.increment("text", 1, count));
+	std::string value;
+	REQUIRE(store.get("text", value));
+	REQUIRE(value == "not a counter");
+
+	REQUIRE(store.append("log", "a"));
+	REQUIRE(store.append("log", "bc"));
+	REQUIRE(store.append("log", ""));
+	REQUIRE(store.get("log", value));
+	REQUIRE(value == "abc");
+
+	REQUIRE(!store.compareAndSet("log", "wrong", "x"));
+	REQUIRE(!store.compareAndSet("missing", "", "x"));
+	REQUIRE(!store.contains("missing"));
+	REQUIRE(store.compareAndSet("log", "abc", "def"));
+	REQUIRE(store.get("log", value));
+	REQUIRE(value == "def");
+
+	REQUIRE(store.setIfAbsent("flag", "first"));
+	REQUIRE(!store.setIfAbsent("flag", "second"));
+	REQUIRE(store.get("flag", value));
+	REQUIRE(value == "first");
+	REQUIRE(store.size() == 4);
+
+	// Another connection sees every update, nothing is left in the cache only.
+	{
+		ez::KVStore other;
+		REQUIRE(other.open(path, true));
+		REQUIRE(other.get("counter", stored));
+		REQUIRE(stored == 101);
+		REQUIRE(other.get("log", value));
+		REQUIRE(value == "def");
+	}
+
+	// Values behind a codec header, including compressed ones.
+	REQUIRE(store.enableCodec(16));
+	REQUIRE(store.increment("counter", 1, count));
+	REQUIRE(count == 102);
+	std::string big(1000, 'z');
+	REQUIRE(store.append("log", big));
+	REQUIRE(store.append("log", "!"));
+	REQUIRE(store.get("log", value));
+	REQUIRE(value == "def" + big + "!");
+	REQUIRE(store.compareAndSet("log", "def" + big + "!", big));
+	REQUIRE(store.get("log", value));
+	REQUIRE(value == big);
+	REQUIRE(store.setIfAbsent("compressed", big));
+	REQUIRE(!store.setIfAbsent("compressed", "x"));
+
+	// Keys stored away from their home slot.
+	REQUIRE(store.set("a", int64_t(1)));
+	store.finishReads();
+	{
+		SQLite::Database db(path.u8string(), SQLite::OPEN_READWRITE);
+		db.exec("UPDATE \"main\" SET \"hash\" = \"hash\" + 1 WHERE \"key\" = CAST('a' AS BLOB);");
+		db.exec("INSERT INTO \"main\"(\"hash\", \"key\", \"value\") SELECT \"hash\" - 1, CAST('other' AS BLOB), X'00' FROM \"main\" WHERE \"key\" = CAST('a' AS BLOB);");
+	}
+	store.setCacheCapacity(0);
+	std::size_t size = store.size();
+	REQUIRE(store.increment("a", 1, count));
+	REQUIRE(count == 2);
+	REQUIRE(store.append("a", "x"));
+	REQUIRE(store.get("a", value));
+	REQUIRE(value.length() == 9);
+	REQUIRE(store.compareAndSet("a", value, "y"));
+	REQUIRE(!store.setIfAbsent("a", "z"));
+	REQUIRE(store.get("a", value));
+	REQUIRE(value == "y");
+	REQUIRE(store.size() == size);
+	REQUIRE(store.erase("a"));
+	REQUIRE(store.setIfAbsent("a", "z"));
+	REQUIRE(store.size() == size);
+	REQUIRE(store.get("a", value));
+	REQUIRE(value == "z");
+
+	store.close();
+}